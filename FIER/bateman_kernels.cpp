@@ -0,0 +1,705 @@
+/**@file bateman_kernels.cpp
+ *
+ * Scalar, AVX2 and AVX-512 versions of the Bateman kernels, and the runtime dispatch between them. The SIMD versions
+ * are compiled for their instruction sets through target attributes and only called when the CPU reports them, so the
+ * rest of FIER is still built for the baseline architecture.
+ *
+ * The SIMD versions evaluate 4 (AVX2) or 8 (AVX-512) stems per instruction, one per lane. Each step gathers entry J
+ * of every stem in the block, and lanes whose stem is shorter than J are masked, as is the stability test of
+ * continuous production. A lane adds the terms of its stem in the order the scalar kernels add them, so the sums agree
+ * to rounding: when the compiler contracts multiplies and adds into fused multiply-adds (GCC does at -O2 on targets
+ * with FMA), the two may round differently by an ulp per term, which --check-kernels allows through KERNEL_TOLERANCE.
+ *
+ * The scalar kernels are also specialized on stem length: when every stem of a call has the same LENGTH, up to
+ * SPECIALIZED_STEM_LENGTH, the sum of each is a fold expression over the entries, unrolled at compile time with no
+ * loop or stability branch. The SIMD kernels handle mixed lengths by masking, so they only gain full lanes from it.
+ */
+
+#include "bateman_kernels.h"
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__)
+#define FIER_X86_KERNELS
+#include <immintrin.h> // for AVX2 and AVX-512 intrinsics
+#endif
+
+/** Batch decay sum of a stem of N entries, unrolled at compile time by the fold over J.*/
+template<size_t N, size_t... J>
+static double batch_sum_unrolled(const double *coefs, const int *rates, const double *decay, index_sequence<J...>) {
+    double sum = 0.0;
+    ((sum = sum + coefs[J] * decay[rates[J]]), ...);
+    return sum;
+}
+
+/** Continuous production sum of a stem of N entries, unrolled at compile time by the fold over J. Stable isotopes
+ * before the last one are flagged rather than branched on, and zero the sum at the end.
+ */
+template<size_t N, size_t... J>
+static double cont_sum_unrolled(const double *coefs, const double *dcs, const int *rates, const double *decay,
+                                const double *growth, double dt, index_sequence<J...>) {
+    double sum = 0.0;
+    bool zeroed = false;
+    ((sum = sum + ((decay[rates[J]] < STABLE_DECAY_FACTOR) ? coefs[J] * growth[rates[J]] / dcs[J]
+                                                           : ((J == N - 1) ? coefs[J] * dt : 0.0)),
+      zeroed = zeroed | (J != N - 1 && !(decay[rates[J]] < STABLE_DECAY_FACTOR))), ...);
+    return zeroed ? 0.0 : sum;
+}
+
+/** Count window sum of a stem of N entries, unrolled at compile time by the fold over J.*/
+template<size_t N, size_t... J>
+static double rate_sum_unrolled(const double *coefs, const double *dcs, const int *rates, const double *decay,
+                                const double *decay_end, index_sequence<J...>) {
+    double sum = 0.0;
+    ((sum = sum + coefs[J] * (decay[rates[J]] - decay_end[rates[J]]) / dcs[J]), ...);
+    return sum;
+}
+
+/** Batch decay sums of stems that all have N entries.*/
+template<int N>
+static void scalar_batch_sums_of(const stem_arrays &stems, const int *nodes, int n_nodes, const double *decay,
+                                 double *out) {
+    for (int k = 0; k < n_nodes; ++k) {
+        int first = stems.offsets[nodes[k]];
+        out[k] = batch_sum_unrolled<N>(stems.coefs + first, stems.rates + first, decay, make_index_sequence<N>());
+    }
+}
+
+/** Continuous production sums of stems that all have N entries.*/
+template<int N>
+static void scalar_cont_sums_of(const stem_arrays &stems, const int *nodes, int n_nodes, const double *decay,
+                                const double *growth, double dt, double *out) {
+    for (int k = 0; k < n_nodes; ++k) {
+        int first = stems.offsets[nodes[k]];
+        out[k] = cont_sum_unrolled<N>(stems.coefs + first, stems.dcs + first, stems.rates + first, decay, growth, dt,
+                                      make_index_sequence<N>());
+    }
+}
+
+/** Count window sums of stems that all have N entries.*/
+template<int N>
+static void scalar_rate_sums_of(const stem_arrays &stems, const int *nodes, int n_nodes, const double *decay,
+                                const double *decay_end, double *out) {
+    for (int k = 0; k < n_nodes; ++k) {
+        int first = stems.offsets[nodes[k]];
+        out[k] = rate_sum_unrolled<N>(stems.coefs + first, stems.dcs + first, stems.rates + first, decay, decay_end,
+                                      make_index_sequence<N>());
+    }
+}
+
+/** Reference batch decay sums, adding the terms of each stem in order. Stems of a known LENGTH up to
+ * SPECIALIZED_STEM_LENGTH go through the kernel unrolled for that length.
+ */
+static void scalar_batch_sums(const stem_arrays &stems, int length, const int *nodes, int n_nodes,
+                              const double *decay, double *out) {
+    switch (length) {
+        case 1: return scalar_batch_sums_of<1>(stems, nodes, n_nodes, decay, out);
+        case 2: return scalar_batch_sums_of<2>(stems, nodes, n_nodes, decay, out);
+        case 3: return scalar_batch_sums_of<3>(stems, nodes, n_nodes, decay, out);
+        case 4: return scalar_batch_sums_of<4>(stems, nodes, n_nodes, decay, out);
+        case 5: return scalar_batch_sums_of<5>(stems, nodes, n_nodes, decay, out);
+        case 6: return scalar_batch_sums_of<6>(stems, nodes, n_nodes, decay, out);
+        case 7: return scalar_batch_sums_of<7>(stems, nodes, n_nodes, decay, out);
+        case 8: return scalar_batch_sums_of<8>(stems, nodes, n_nodes, decay, out);
+        default: break;
+    }
+    for (int k = 0; k < n_nodes; ++k) {
+        const double *coefs = stems.coefs + stems.offsets[nodes[k]];
+        const int *rates = stems.rates + stems.offsets[nodes[k]];
+        double sum = 0.0;
+        for (int j = 0; j < stems.lengths[nodes[k]]; ++j) {
+            sum = sum + coefs[j] * decay[rates[j]];
+        }
+        out[k] = sum;
+    }
+}
+
+/** Reference continuous production sums, adding the terms of each stem in order. Stems of a known LENGTH up to
+ * SPECIALIZED_STEM_LENGTH go through the kernel unrolled for that length.
+ */
+static void scalar_cont_sums(const stem_arrays &stems, int length, const int *nodes, int n_nodes,
+                             const double *decay, const double *growth, double dt, double *out) {
+    switch (length) {
+        case 1: return scalar_cont_sums_of<1>(stems, nodes, n_nodes, decay, growth, dt, out);
+        case 2: return scalar_cont_sums_of<2>(stems, nodes, n_nodes, decay, growth, dt, out);
+        case 3: return scalar_cont_sums_of<3>(stems, nodes, n_nodes, decay, growth, dt, out);
+        case 4: return scalar_cont_sums_of<4>(stems, nodes, n_nodes, decay, growth, dt, out);
+        case 5: return scalar_cont_sums_of<5>(stems, nodes, n_nodes, decay, growth, dt, out);
+        case 6: return scalar_cont_sums_of<6>(stems, nodes, n_nodes, decay, growth, dt, out);
+        case 7: return scalar_cont_sums_of<7>(stems, nodes, n_nodes, decay, growth, dt, out);
+        case 8: return scalar_cont_sums_of<8>(stems, nodes, n_nodes, decay, growth, dt, out);
+        default: break;
+    }
+    for (int k = 0; k < n_nodes; ++k) {
+        const double *coefs = stems.coefs + stems.offsets[nodes[k]];
+        const double *dcs = stems.dcs + stems.offsets[nodes[k]];
+        const int *rates = stems.rates + stems.offsets[nodes[k]];
+        int n = stems.lengths[nodes[k]];
+        double sum = 0.0;
+        for (int j = 0; j < n; ++j) {
+            if (decay[rates[j]] < STABLE_DECAY_FACTOR) {
+                sum = sum + coefs[j] * growth[rates[j]] / dcs[j];
+            } else if (j == n - 1) {
+                sum = sum + coefs[j] * dt;
+            } else {
+                sum = 0.0;
+                break;
+            }
+        }
+        out[k] = sum;
+    }
+}
+
+/** Reference count window sums, adding the terms of each stem in order. Stems of a known LENGTH up to
+ * SPECIALIZED_STEM_LENGTH go through the kernel unrolled for that length.
+ */
+static void scalar_rate_sums(const stem_arrays &stems, int length, const int *nodes, int n_nodes,
+                             const double *decay, const double *decay_end, double *out) {
+    switch (length) {
+        case 1: return scalar_rate_sums_of<1>(stems, nodes, n_nodes, decay, decay_end, out);
+        case 2: return scalar_rate_sums_of<2>(stems, nodes, n_nodes, decay, decay_end, out);
+        case 3: return scalar_rate_sums_of<3>(stems, nodes, n_nodes, decay, decay_end, out);
+        case 4: return scalar_rate_sums_of<4>(stems, nodes, n_nodes, decay, decay_end, out);
+        case 5: return scalar_rate_sums_of<5>(stems, nodes, n_nodes, decay, decay_end, out);
+        case 6: return scalar_rate_sums_of<6>(stems, nodes, n_nodes, decay, decay_end, out);
+        case 7: return scalar_rate_sums_of<7>(stems, nodes, n_nodes, decay, decay_end, out);
+        case 8: return scalar_rate_sums_of<8>(stems, nodes, n_nodes, decay, decay_end, out);
+        default: break;
+    }
+    for (int k = 0; k < n_nodes; ++k) {
+        const double *coefs = stems.coefs + stems.offsets[nodes[k]];
+        const double *dcs = stems.dcs + stems.offsets[nodes[k]];
+        const int *rates = stems.rates + stems.offsets[nodes[k]];
+        double sum = 0.0;
+        for (int j = 0; j < stems.lengths[nodes[k]]; ++j) {
+            double decayed = decay[rates[j]] - decay_end[rates[j]];
+            sum = sum + coefs[j] * decayed / dcs[j];
+        }
+        out[k] = sum;
+    }
+}
+
+/** Batch decay sums of stems that all have N entries, at each of N_TIMES times.*/
+template<int N>
+static void scalar_batch_times_sums_of(const stem_arrays &stems, const int *nodes, int n_nodes, const double *decay,
+                                       int n_times, int table_size, double *out, int out_stride) {
+    for (int k = 0; k < n_nodes; ++k) {
+        int first = stems.offsets[nodes[k]];
+        for (int t = 0; t < n_times; ++t) {
+            out[static_cast<size_t>(t) * out_stride + k] = batch_sum_unrolled<N>(
+                    stems.coefs + first, stems.rates + first, decay + static_cast<size_t>(t) * table_size,
+                    make_index_sequence<N>());
+        }
+    }
+}
+
+/** Count window sums of stems that all have N entries, over each of N_TIMES windows.*/
+template<int N>
+static void scalar_rate_times_sums_of(const stem_arrays &stems, const int *nodes, int n_nodes, const double *decay,
+                                      const double *decay_end, int n_times, int table_size, double *out,
+                                      int out_stride) {
+    for (int k = 0; k < n_nodes; ++k) {
+        int first = stems.offsets[nodes[k]];
+        for (int t = 0; t < n_times; ++t) {
+            size_t table = static_cast<size_t>(t) * table_size;
+            out[static_cast<size_t>(t) * out_stride + k] = rate_sum_unrolled<N>(
+                    stems.coefs + first, stems.dcs + first, stems.rates + first, decay + table, decay_end + table,
+                    make_index_sequence<N>());
+        }
+    }
+}
+
+/** Reference batch decay sums at several times. Each stem is read once, and summed in order for every time while
+ * its entries are in cache.
+ */
+static void scalar_batch_times_sums(const stem_arrays &stems, int length, const int *nodes, int n_nodes,
+                                    const double *decay, int n_times, int table_size, double *out, int out_stride) {
+    switch (length) {
+        case 1: return scalar_batch_times_sums_of<1>(stems, nodes, n_nodes, decay, n_times, table_size, out,
+                                                     out_stride);
+        case 2: return scalar_batch_times_sums_of<2>(stems, nodes, n_nodes, decay, n_times, table_size, out,
+                                                     out_stride);
+        case 3: return scalar_batch_times_sums_of<3>(stems, nodes, n_nodes, decay, n_times, table_size, out,
+                                                     out_stride);
+        case 4: return scalar_batch_times_sums_of<4>(stems, nodes, n_nodes, decay, n_times, table_size, out,
+                                                     out_stride);
+        case 5: return scalar_batch_times_sums_of<5>(stems, nodes, n_nodes, decay, n_times, table_size, out,
+                                                     out_stride);
+        case 6: return scalar_batch_times_sums_of<6>(stems, nodes, n_nodes, decay, n_times, table_size, out,
+                                                     out_stride);
+        case 7: return scalar_batch_times_sums_of<7>(stems, nodes, n_nodes, decay, n_times, table_size, out,
+                                                     out_stride);
+        case 8: return scalar_batch_times_sums_of<8>(stems, nodes, n_nodes, decay, n_times, table_size, out,
+                                                     out_stride);
+        default: break;
+    }
+    for (int k = 0; k < n_nodes; ++k) {
+        const double *coefs = stems.coefs + stems.offsets[nodes[k]];
+        const int *rates = stems.rates + stems.offsets[nodes[k]];
+        for (int t = 0; t < n_times; ++t) {
+            const double *table = decay + static_cast<size_t>(t) * table_size;
+            double sum = 0.0;
+            for (int j = 0; j < stems.lengths[nodes[k]]; ++j) {
+                sum = sum + coefs[j] * table[rates[j]];
+            }
+            out[static_cast<size_t>(t) * out_stride + k] = sum;
+        }
+    }
+}
+
+/** Reference count window sums over several windows, reading each stem once as scalar_batch_times_sums does.*/
+static void scalar_rate_times_sums(const stem_arrays &stems, int length, const int *nodes, int n_nodes,
+                                   const double *decay, const double *decay_end, int n_times, int table_size,
+                                   double *out, int out_stride) {
+    switch (length) {
+        case 1: return scalar_rate_times_sums_of<1>(stems, nodes, n_nodes, decay, decay_end, n_times, table_size, out,
+                                                    out_stride);
+        case 2: return scalar_rate_times_sums_of<2>(stems, nodes, n_nodes, decay, decay_end, n_times, table_size, out,
+                                                    out_stride);
+        case 3: return scalar_rate_times_sums_of<3>(stems, nodes, n_nodes, decay, decay_end, n_times, table_size, out,
+                                                    out_stride);
+        case 4: return scalar_rate_times_sums_of<4>(stems, nodes, n_nodes, decay, decay_end, n_times, table_size, out,
+                                                    out_stride);
+        case 5: return scalar_rate_times_sums_of<5>(stems, nodes, n_nodes, decay, decay_end, n_times, table_size, out,
+                                                    out_stride);
+        case 6: return scalar_rate_times_sums_of<6>(stems, nodes, n_nodes, decay, decay_end, n_times, table_size, out,
+                                                    out_stride);
+        case 7: return scalar_rate_times_sums_of<7>(stems, nodes, n_nodes, decay, decay_end, n_times, table_size, out,
+                                                    out_stride);
+        case 8: return scalar_rate_times_sums_of<8>(stems, nodes, n_nodes, decay, decay_end, n_times, table_size, out,
+                                                    out_stride);
+        default: break;
+    }
+    for (int k = 0; k < n_nodes; ++k) {
+        const double *coefs = stems.coefs + stems.offsets[nodes[k]];
+        const double *dcs = stems.dcs + stems.offsets[nodes[k]];
+        const int *rates = stems.rates + stems.offsets[nodes[k]];
+        for (int t = 0; t < n_times; ++t) {
+            const double *table = decay + static_cast<size_t>(t) * table_size;
+            const double *table_end = decay_end + static_cast<size_t>(t) * table_size;
+            double sum = 0.0;
+            for (int j = 0; j < stems.lengths[nodes[k]]; ++j) {
+                double decayed = table[rates[j]] - table_end[rates[j]];
+                sum = sum + coefs[j] * decayed / dcs[j];
+            }
+            out[static_cast<size_t>(t) * out_stride + k] = sum;
+        }
+    }
+}
+
+static const bateman_kernels SCALAR_KERNELS = {"scalar", true, scalar_batch_sums, scalar_cont_sums,
+                                               scalar_rate_sums, scalar_batch_times_sums, scalar_rate_times_sums};
+
+#ifdef FIER_X86_KERNELS
+#define FIER_AVX2 __attribute__((target("avx2")))
+#define FIER_AVX512 __attribute__((target("avx512f,avx2")))
+
+/** @return 32 bit lanes set where the lane index is below LEFT.*/
+FIER_AVX2 static __m128i tail_mask_avx2(int left) {
+    return _mm_cmpgt_epi32(_mm_set1_epi32(left), _mm_setr_epi32(0, 1, 2, 3));
+}
+
+/** Gathers the first pooled entry and the length of the stems of up to 4 nodes.
+ *
+ * @param stems Pooled stem arrays.
+ * @param nodes Stem trie nodes of the block.
+ * @param lanes Number of nodes in the block, from 1 to 4. Unused lanes get stems of length 0.
+ * @param offset First pooled entry of each stem.
+ * @param lengths Length of each stem.
+ * @return Length of the longest stem of the block.
+ */
+FIER_AVX2 static int load_block_avx2(const stem_arrays &stems, const int *nodes, int lanes, __m128i &offset,
+                                     __m128i &lengths) {
+    __m128i valid = tail_mask_avx2(lanes);
+    __m128i node = _mm_maskload_epi32(nodes, valid);
+    offset = _mm_mask_i32gather_epi32(_mm_setzero_si128(), stems.offsets, node, valid, 4);
+    lengths = _mm_mask_i32gather_epi32(_mm_setzero_si128(), stems.lengths, node, valid, 4);
+    __m128i longest = _mm_max_epi32(lengths, _mm_shuffle_epi32(lengths, _MM_SHUFFLE(1, 0, 3, 2)));
+    longest = _mm_max_epi32(longest, _mm_shuffle_epi32(longest, _MM_SHUFFLE(2, 3, 0, 1)));
+    return _mm_cvtsi128_si32(longest);
+}
+
+/** @return 64 bit lanes set where the 32 bit lanes of MASK are set.*/
+FIER_AVX2 static __m256d widen_mask_avx2(__m128i mask) {
+    return _mm256_castsi256_pd(_mm256_cvtepi32_epi64(mask));
+}
+
+/** Stores the first LANES lanes of SUMS to OUT.*/
+FIER_AVX2 static void store_block_avx2(double *out, __m256d sums, int lanes) {
+    _mm256_maskstore_pd(out, _mm256_castpd_si256(widen_mask_avx2(tail_mask_avx2(lanes))), sums);
+}
+
+FIER_AVX2 static void avx2_batch_sums(const stem_arrays &stems, [[maybe_unused]] int length, const int *nodes,
+                                      int n_nodes, const double *decay, double *out) {
+    for (int k = 0; k < n_nodes; k += 4) {
+        int lanes = min(n_nodes - k, 4);
+        __m128i offset, lengths;
+        int longest = load_block_avx2(stems, nodes + k, lanes, offset, lengths);
+        __m256d sum = _mm256_setzero_pd();
+        for (int j = 0; j < longest; ++j) {
+            __m128i active = _mm_cmpgt_epi32(lengths, _mm_set1_epi32(j));
+            __m256d active_pd = widen_mask_avx2(active);
+            __m128i entry = _mm_add_epi32(offset, _mm_set1_epi32(j));
+            __m128i rate = _mm_mask_i32gather_epi32(_mm_setzero_si128(), stems.rates, entry, active, 4);
+            __m256d coef = _mm256_mask_i32gather_pd(_mm256_setzero_pd(), stems.coefs, entry, active_pd, 8);
+            __m256d decayed = _mm256_mask_i32gather_pd(_mm256_setzero_pd(), decay, rate, active_pd, 8);
+            sum = _mm256_blendv_pd(sum, _mm256_add_pd(sum, _mm256_mul_pd(coef, decayed)), active_pd);
+        }
+        store_block_avx2(out + k, sum, lanes);
+    }
+}
+
+FIER_AVX2 static void avx2_cont_sums(const stem_arrays &stems, [[maybe_unused]] int length, const int *nodes,
+                                     int n_nodes, const double *decay, const double *growth, double dt, double *out) {
+    for (int k = 0; k < n_nodes; k += 4) {
+        int lanes = min(n_nodes - k, 4);
+        __m128i offset, lengths;
+        int longest = load_block_avx2(stems, nodes + k, lanes, offset, lengths);
+        __m256d sum = _mm256_setzero_pd();
+        __m256d zeroed = _mm256_setzero_pd();
+        for (int j = 0; j < longest; ++j) {
+            __m128i active = _mm_cmpgt_epi32(lengths, _mm_set1_epi32(j));
+            __m256d active_pd = widen_mask_avx2(active);
+            __m128i entry = _mm_add_epi32(offset, _mm_set1_epi32(j));
+            __m128i rate = _mm_mask_i32gather_epi32(_mm_setzero_si128(), stems.rates, entry, active, 4);
+            __m256d coef = _mm256_mask_i32gather_pd(_mm256_setzero_pd(), stems.coefs, entry, active_pd, 8);
+            __m256d dc = _mm256_mask_i32gather_pd(_mm256_setzero_pd(), stems.dcs, entry, active_pd, 8);
+            __m256d decayed = _mm256_mask_i32gather_pd(_mm256_setzero_pd(), decay, rate, active_pd, 8);
+            __m256d grown = _mm256_mask_i32gather_pd(_mm256_setzero_pd(), growth, rate, active_pd, 8);
+            // stable isotopes give COEF * DT if they end their stem, and zero the whole stem otherwise
+            __m256d stable = _mm256_and_pd(_mm256_cmp_pd(decayed, _mm256_set1_pd(STABLE_DECAY_FACTOR), _CMP_NLT_UQ),
+                                           active_pd);
+            __m256d last = widen_mask_avx2(_mm_cmpeq_epi32(lengths, _mm_set1_epi32(j + 1)));
+            zeroed = _mm256_or_pd(zeroed, _mm256_andnot_pd(last, stable));
+            __m256d term = _mm256_blendv_pd(_mm256_div_pd(_mm256_mul_pd(coef, grown), dc),
+                                            _mm256_mul_pd(coef, _mm256_set1_pd(dt)), stable);
+            sum = _mm256_blendv_pd(sum, _mm256_add_pd(sum, term), active_pd);
+        }
+        store_block_avx2(out + k, _mm256_andnot_pd(zeroed, sum), lanes);
+    }
+}
+
+FIER_AVX2 static void avx2_rate_sums(const stem_arrays &stems, [[maybe_unused]] int length, const int *nodes,
+                                     int n_nodes, const double *decay, const double *decay_end, double *out) {
+    for (int k = 0; k < n_nodes; k += 4) {
+        int lanes = min(n_nodes - k, 4);
+        __m128i offset, lengths;
+        int longest = load_block_avx2(stems, nodes + k, lanes, offset, lengths);
+        __m256d sum = _mm256_setzero_pd();
+        for (int j = 0; j < longest; ++j) {
+            __m128i active = _mm_cmpgt_epi32(lengths, _mm_set1_epi32(j));
+            __m256d active_pd = widen_mask_avx2(active);
+            __m128i entry = _mm_add_epi32(offset, _mm_set1_epi32(j));
+            __m128i rate = _mm_mask_i32gather_epi32(_mm_setzero_si128(), stems.rates, entry, active, 4);
+            __m256d coef = _mm256_mask_i32gather_pd(_mm256_setzero_pd(), stems.coefs, entry, active_pd, 8);
+            __m256d dc = _mm256_mask_i32gather_pd(_mm256_setzero_pd(), stems.dcs, entry, active_pd, 8);
+            __m256d decayed = _mm256_sub_pd(
+                    _mm256_mask_i32gather_pd(_mm256_setzero_pd(), decay, rate, active_pd, 8),
+                    _mm256_mask_i32gather_pd(_mm256_setzero_pd(), decay_end, rate, active_pd, 8));
+            __m256d term = _mm256_div_pd(_mm256_mul_pd(coef, decayed), dc);
+            sum = _mm256_blendv_pd(sum, _mm256_add_pd(sum, term), active_pd);
+        }
+        store_block_avx2(out + k, sum, lanes);
+    }
+}
+
+/** Zeroes the sums of N_TIMES times of a block of LANES nodes in OUT, which the _times kernels then add to.*/
+FIER_AVX2 static void clear_times_avx2(double *out, int lanes, int n_times, int out_stride) {
+    for (int t = 0; t < n_times; ++t) {
+        store_block_avx2(out + static_cast<size_t>(t) * out_stride, _mm256_setzero_pd(), lanes);
+    }
+}
+
+/** Gathers each stem entry of a block once and adds its term to the sum of every time, which stays in OUT between
+ * entries.
+ */
+FIER_AVX2 static void avx2_batch_times_sums(const stem_arrays &stems, [[maybe_unused]] int length, const int *nodes,
+                                            int n_nodes, const double *decay, int n_times, int table_size, double *out,
+                                            int out_stride) {
+    for (int k = 0; k < n_nodes; k += 4) {
+        int lanes = min(n_nodes - k, 4);
+        __m128i offset, lengths;
+        int longest = load_block_avx2(stems, nodes + k, lanes, offset, lengths);
+        __m256i stored = _mm256_castpd_si256(widen_mask_avx2(tail_mask_avx2(lanes)));
+        clear_times_avx2(out + k, lanes, n_times, out_stride);
+        for (int j = 0; j < longest; ++j) {
+            __m128i active = _mm_cmpgt_epi32(lengths, _mm_set1_epi32(j));
+            __m256d active_pd = widen_mask_avx2(active);
+            __m128i entry = _mm_add_epi32(offset, _mm_set1_epi32(j));
+            __m128i rate = _mm_mask_i32gather_epi32(_mm_setzero_si128(), stems.rates, entry, active, 4);
+            __m256d coef = _mm256_mask_i32gather_pd(_mm256_setzero_pd(), stems.coefs, entry, active_pd, 8);
+            for (int t = 0; t < n_times; ++t) {
+                const double *table = decay + static_cast<size_t>(t) * table_size;
+                double *sums = out + static_cast<size_t>(t) * out_stride + k;
+                __m256d sum = _mm256_maskload_pd(sums, stored);
+                __m256d decayed = _mm256_mask_i32gather_pd(_mm256_setzero_pd(), table, rate, active_pd, 8);
+                sum = _mm256_blendv_pd(sum, _mm256_add_pd(sum, _mm256_mul_pd(coef, decayed)), active_pd);
+                _mm256_maskstore_pd(sums, stored, sum);
+            }
+        }
+    }
+}
+
+FIER_AVX2 static void avx2_rate_times_sums(const stem_arrays &stems, [[maybe_unused]] int length, const int *nodes,
+                                           int n_nodes, const double *decay, const double *decay_end, int n_times,
+                                           int table_size, double *out, int out_stride) {
+    for (int k = 0; k < n_nodes; k += 4) {
+        int lanes = min(n_nodes - k, 4);
+        __m128i offset, lengths;
+        int longest = load_block_avx2(stems, nodes + k, lanes, offset, lengths);
+        __m256i stored = _mm256_castpd_si256(widen_mask_avx2(tail_mask_avx2(lanes)));
+        clear_times_avx2(out + k, lanes, n_times, out_stride);
+        for (int j = 0; j < longest; ++j) {
+            __m128i active = _mm_cmpgt_epi32(lengths, _mm_set1_epi32(j));
+            __m256d active_pd = widen_mask_avx2(active);
+            __m128i entry = _mm_add_epi32(offset, _mm_set1_epi32(j));
+            __m128i rate = _mm_mask_i32gather_epi32(_mm_setzero_si128(), stems.rates, entry, active, 4);
+            __m256d coef = _mm256_mask_i32gather_pd(_mm256_setzero_pd(), stems.coefs, entry, active_pd, 8);
+            __m256d dc = _mm256_mask_i32gather_pd(_mm256_setzero_pd(), stems.dcs, entry, active_pd, 8);
+            for (int t = 0; t < n_times; ++t) {
+                size_t table = static_cast<size_t>(t) * table_size;
+                double *sums = out + static_cast<size_t>(t) * out_stride + k;
+                __m256d sum = _mm256_maskload_pd(sums, stored);
+                __m256d decayed = _mm256_sub_pd(
+                        _mm256_mask_i32gather_pd(_mm256_setzero_pd(), decay + table, rate, active_pd, 8),
+                        _mm256_mask_i32gather_pd(_mm256_setzero_pd(), decay_end + table, rate, active_pd, 8));
+                __m256d term = _mm256_div_pd(_mm256_mul_pd(coef, decayed), dc);
+                sum = _mm256_blendv_pd(sum, _mm256_add_pd(sum, term), active_pd);
+                _mm256_maskstore_pd(sums, stored, sum);
+            }
+        }
+    }
+}
+
+/** Three gathers per four stem entries cost more than the scalar loads they replace, so these are only used when
+ * selected.
+ */
+static const bateman_kernels AVX2_KERNELS = {"avx2", false, avx2_batch_sums, avx2_cont_sums, avx2_rate_sums,
+                                             avx2_batch_times_sums, avx2_rate_times_sums};
+
+/** As load_block_avx2, for blocks of up to 8 nodes.*/
+FIER_AVX512 static int load_block_avx512(const stem_arrays &stems, const int *nodes, int lanes, __m256i &offset,
+                                         __m256i &lengths) {
+    __m256i valid = _mm256_cmpgt_epi32(_mm256_set1_epi32(lanes), _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7));
+    __m256i node = _mm256_maskload_epi32(nodes, valid);
+    offset = _mm256_mask_i32gather_epi32(_mm256_setzero_si256(), stems.offsets, node, valid, 4);
+    lengths = _mm256_mask_i32gather_epi32(_mm256_setzero_si256(), stems.lengths, node, valid, 4);
+    __m128i longest = _mm_max_epi32(_mm256_castsi256_si128(lengths), _mm256_extracti128_si256(lengths, 1));
+    longest = _mm_max_epi32(longest, _mm_shuffle_epi32(longest, _MM_SHUFFLE(1, 0, 3, 2)));
+    longest = _mm_max_epi32(longest, _mm_shuffle_epi32(longest, _MM_SHUFFLE(2, 3, 0, 1)));
+    return _mm_cvtsi128_si32(longest);
+}
+
+/** @return Mask of the lanes whose 32 bit lanes of MASK are set.*/
+FIER_AVX512 static __mmask8 lane_mask_avx512(__m256i mask) {
+    return static_cast<__mmask8>(_mm256_movemask_ps(_mm256_castsi256_ps(mask)));
+}
+
+/** @return Mask of the first LANES lanes.*/
+static __mmask8 tail_mask_avx512(int lanes) {
+    return static_cast<__mmask8>((1u << lanes) - 1);
+}
+
+FIER_AVX512 static void avx512_batch_sums(const stem_arrays &stems, [[maybe_unused]] int length, const int *nodes,
+                                          int n_nodes, const double *decay, double *out) {
+    for (int k = 0; k < n_nodes; k += 8) {
+        int lanes = min(n_nodes - k, 8);
+        __m256i offset, lengths;
+        int longest = load_block_avx512(stems, nodes + k, lanes, offset, lengths);
+        __m512d sum = _mm512_setzero_pd();
+        for (int j = 0; j < longest; ++j) {
+            __m256i active = _mm256_cmpgt_epi32(lengths, _mm256_set1_epi32(j));
+            __mmask8 active_lanes = lane_mask_avx512(active);
+            __m256i entry = _mm256_add_epi32(offset, _mm256_set1_epi32(j));
+            __m256i rate = _mm256_mask_i32gather_epi32(_mm256_setzero_si256(), stems.rates, entry, active, 4);
+            __m512d coef = _mm512_mask_i32gather_pd(_mm512_setzero_pd(), active_lanes, entry, stems.coefs, 8);
+            __m512d decayed = _mm512_mask_i32gather_pd(_mm512_setzero_pd(), active_lanes, rate, decay, 8);
+            sum = _mm512_mask_add_pd(sum, active_lanes, sum, _mm512_mul_pd(coef, decayed));
+        }
+        _mm512_mask_storeu_pd(out + k, tail_mask_avx512(lanes), sum);
+    }
+}
+
+FIER_AVX512 static void avx512_cont_sums(const stem_arrays &stems, [[maybe_unused]] int length, const int *nodes,
+                                         int n_nodes, const double *decay, const double *growth, double dt,
+                                         double *out) {
+    for (int k = 0; k < n_nodes; k += 8) {
+        int lanes = min(n_nodes - k, 8);
+        __m256i offset, lengths;
+        int longest = load_block_avx512(stems, nodes + k, lanes, offset, lengths);
+        __m512d sum = _mm512_setzero_pd();
+        __mmask8 zeroed = 0;
+        for (int j = 0; j < longest; ++j) {
+            __m256i active = _mm256_cmpgt_epi32(lengths, _mm256_set1_epi32(j));
+            __mmask8 active_lanes = lane_mask_avx512(active);
+            __m256i entry = _mm256_add_epi32(offset, _mm256_set1_epi32(j));
+            __m256i rate = _mm256_mask_i32gather_epi32(_mm256_setzero_si256(), stems.rates, entry, active, 4);
+            __m512d coef = _mm512_mask_i32gather_pd(_mm512_setzero_pd(), active_lanes, entry, stems.coefs, 8);
+            __m512d dc = _mm512_mask_i32gather_pd(_mm512_setzero_pd(), active_lanes, entry, stems.dcs, 8);
+            __m512d decayed = _mm512_mask_i32gather_pd(_mm512_setzero_pd(), active_lanes, rate, decay, 8);
+            __m512d grown = _mm512_mask_i32gather_pd(_mm512_setzero_pd(), active_lanes, rate, growth, 8);
+            // stable isotopes give COEF * DT if they end their stem, and zero the whole stem otherwise
+            __mmask8 stable = _mm512_mask_cmp_pd_mask(active_lanes, decayed, _mm512_set1_pd(STABLE_DECAY_FACTOR),
+                                                      _CMP_NLT_UQ);
+            __mmask8 last = lane_mask_avx512(_mm256_cmpeq_epi32(lengths, _mm256_set1_epi32(j + 1)));
+            zeroed = static_cast<__mmask8>(zeroed | (stable & ~last));
+            __m512d term = _mm512_div_pd(_mm512_mul_pd(coef, grown), dc);
+            term = _mm512_mask_mul_pd(term, stable, coef, _mm512_set1_pd(dt));
+            sum = _mm512_mask_add_pd(sum, active_lanes, sum, term);
+        }
+        sum = _mm512_mask_mov_pd(sum, zeroed, _mm512_setzero_pd());
+        _mm512_mask_storeu_pd(out + k, tail_mask_avx512(lanes), sum);
+    }
+}
+
+FIER_AVX512 static void avx512_rate_sums(const stem_arrays &stems, [[maybe_unused]] int length, const int *nodes,
+                                         int n_nodes, const double *decay, const double *decay_end, double *out) {
+    for (int k = 0; k < n_nodes; k += 8) {
+        int lanes = min(n_nodes - k, 8);
+        __m256i offset, lengths;
+        int longest = load_block_avx512(stems, nodes + k, lanes, offset, lengths);
+        __m512d sum = _mm512_setzero_pd();
+        for (int j = 0; j < longest; ++j) {
+            __m256i active = _mm256_cmpgt_epi32(lengths, _mm256_set1_epi32(j));
+            __mmask8 active_lanes = lane_mask_avx512(active);
+            __m256i entry = _mm256_add_epi32(offset, _mm256_set1_epi32(j));
+            __m256i rate = _mm256_mask_i32gather_epi32(_mm256_setzero_si256(), stems.rates, entry, active, 4);
+            __m512d coef = _mm512_mask_i32gather_pd(_mm512_setzero_pd(), active_lanes, entry, stems.coefs, 8);
+            __m512d dc = _mm512_mask_i32gather_pd(_mm512_setzero_pd(), active_lanes, entry, stems.dcs, 8);
+            __m512d decayed = _mm512_sub_pd(_mm512_mask_i32gather_pd(_mm512_setzero_pd(), active_lanes, rate, decay, 8),
+                                            _mm512_mask_i32gather_pd(_mm512_setzero_pd(), active_lanes, rate,
+                                                                     decay_end, 8));
+            __m512d term = _mm512_div_pd(_mm512_mul_pd(coef, decayed), dc);
+            sum = _mm512_mask_add_pd(sum, active_lanes, sum, term);
+        }
+        _mm512_mask_storeu_pd(out + k, tail_mask_avx512(lanes), sum);
+    }
+}
+
+/** As avx2_batch_times_sums, for blocks of 8 nodes.*/
+FIER_AVX512 static void avx512_batch_times_sums(const stem_arrays &stems, [[maybe_unused]] int length, const int *nodes,
+                                                int n_nodes, const double *decay, int n_times, int table_size,
+                                                double *out, int out_stride) {
+    for (int k = 0; k < n_nodes; k += 8) {
+        int lanes = min(n_nodes - k, 8);
+        __m256i offset, lengths;
+        int longest = load_block_avx512(stems, nodes + k, lanes, offset, lengths);
+        __mmask8 stored = tail_mask_avx512(lanes);
+        for (int t = 0; t < n_times; ++t) {
+            _mm512_mask_storeu_pd(out + static_cast<size_t>(t) * out_stride + k, stored, _mm512_setzero_pd());
+        }
+        for (int j = 0; j < longest; ++j) {
+            __m256i active = _mm256_cmpgt_epi32(lengths, _mm256_set1_epi32(j));
+            __mmask8 active_lanes = lane_mask_avx512(active);
+            __m256i entry = _mm256_add_epi32(offset, _mm256_set1_epi32(j));
+            __m256i rate = _mm256_mask_i32gather_epi32(_mm256_setzero_si256(), stems.rates, entry, active, 4);
+            __m512d coef = _mm512_mask_i32gather_pd(_mm512_setzero_pd(), active_lanes, entry, stems.coefs, 8);
+            for (int t = 0; t < n_times; ++t) {
+                const double *table = decay + static_cast<size_t>(t) * table_size;
+                double *sums = out + static_cast<size_t>(t) * out_stride + k;
+                __m512d sum = _mm512_maskz_loadu_pd(stored, sums);
+                __m512d decayed = _mm512_mask_i32gather_pd(_mm512_setzero_pd(), active_lanes, rate, table, 8);
+                sum = _mm512_mask_add_pd(sum, active_lanes, sum, _mm512_mul_pd(coef, decayed));
+                _mm512_mask_storeu_pd(sums, stored, sum);
+            }
+        }
+    }
+}
+
+/** As avx2_rate_times_sums, for blocks of 8 nodes.*/
+FIER_AVX512 static void avx512_rate_times_sums(const stem_arrays &stems, [[maybe_unused]] int length, const int *nodes,
+                                               int n_nodes, const double *decay, const double *decay_end, int n_times,
+                                               int table_size, double *out, int out_stride) {
+    for (int k = 0; k < n_nodes; k += 8) {
+        int lanes = min(n_nodes - k, 8);
+        __m256i offset, lengths;
+        int longest = load_block_avx512(stems, nodes + k, lanes, offset, lengths);
+        __mmask8 stored = tail_mask_avx512(lanes);
+        for (int t = 0; t < n_times; ++t) {
+            _mm512_mask_storeu_pd(out + static_cast<size_t>(t) * out_stride + k, stored, _mm512_setzero_pd());
+        }
+        for (int j = 0; j < longest; ++j) {
+            __m256i active = _mm256_cmpgt_epi32(lengths, _mm256_set1_epi32(j));
+            __mmask8 active_lanes = lane_mask_avx512(active);
+            __m256i entry = _mm256_add_epi32(offset, _mm256_set1_epi32(j));
+            __m256i rate = _mm256_mask_i32gather_epi32(_mm256_setzero_si256(), stems.rates, entry, active, 4);
+            __m512d coef = _mm512_mask_i32gather_pd(_mm512_setzero_pd(), active_lanes, entry, stems.coefs, 8);
+            __m512d dc = _mm512_mask_i32gather_pd(_mm512_setzero_pd(), active_lanes, entry, stems.dcs, 8);
+            for (int t = 0; t < n_times; ++t) {
+                size_t table = static_cast<size_t>(t) * table_size;
+                double *sums = out + static_cast<size_t>(t) * out_stride + k;
+                __m512d sum = _mm512_maskz_loadu_pd(stored, sums);
+                __m512d decayed = _mm512_sub_pd(
+                        _mm512_mask_i32gather_pd(_mm512_setzero_pd(), active_lanes, rate, decay + table, 8),
+                        _mm512_mask_i32gather_pd(_mm512_setzero_pd(), active_lanes, rate, decay_end + table, 8));
+                __m512d term = _mm512_div_pd(_mm512_mul_pd(coef, decayed), dc);
+                sum = _mm512_mask_add_pd(sum, active_lanes, sum, term);
+                _mm512_mask_storeu_pd(sums, stored, sum);
+            }
+        }
+    }
+}
+
+/** Measured no faster than the scalar kernels, which are unrolled by stem length, and not bit for bit the same as
+ * them, so these are only used when selected too.
+ */
+static const bateman_kernels AVX512_KERNELS = {"avx512", false, avx512_batch_sums, avx512_cont_sums, avx512_rate_sums,
+                                               avx512_batch_times_sums, avx512_rate_times_sums};
+#endif
+
+/** Lists the kernel implementations this CPU can run.
+ *
+ * @return Supported kernels, widest first, ending with the scalar kernels.
+ */
+vector<const bateman_kernels *> supported_kernels() {
+    vector<const bateman_kernels *> res;
+#ifdef FIER_X86_KERNELS
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx2")) {
+        res.push_back(&AVX512_KERNELS);
+    }
+    if (__builtin_cpu_supports("avx2")) {
+        res.push_back(&AVX2_KERNELS);
+    }
+#endif
+    res.push_back(&SCALAR_KERNELS);
+    return res;
+}
+
+/** @return The scalar kernels, which every other implementation is checked against.*/
+const bateman_kernels &scalar_kernels() {
+    return SCALAR_KERNELS;
+}
+
+/** @return The widest supported kernels that are faster than the scalar kernels.*/
+static const bateman_kernels *preferred_kernels() {
+    for (const bateman_kernels *kernels : supported_kernels()) {
+        if (kernels->preferred) {
+            return kernels;
+        }
+    }
+    return &SCALAR_KERNELS;
+}
+
+/** @return Pointer to the kernels in use, the preferred ones until select_kernels is called.*/
+static const bateman_kernels *&selected_kernels() {
+    static const bateman_kernels *selected = preferred_kernels();
+    return selected;
+}
+
+/** @return Kernels the Bateman solutions of product_data are evaluated with.*/
+const bateman_kernels &active_kernels() {
+    return *selected_kernels();
+}
+
+/** Picks the kernels product_data evaluates the Bateman solutions with, in place of the preferred ones.
+ *
+ * @param name Name of the kernels: scalar, avx2 or avx512.
+ * @return True if the kernels exist and this CPU supports them, otherwise the selection is unchanged.
+ */
+bool select_kernels(const string &name) {
+    for (const bateman_kernels *kernels : supported_kernels()) {
+        if (name == kernels->name) {
+            selected_kernels() = kernels;
+            return true;
+        }
+    }
+    return false;
+}
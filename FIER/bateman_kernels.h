@@ -0,0 +1,76 @@
+#ifndef FIER_BATEMAN_KERNELS_H
+#define FIER_BATEMAN_KERNELS_H
+
+
+#include "helper_functions.h"
+#include <limits> // for the machine epsilon of the kernel tolerance
+
+/** Single precision resolution near 1.0. Continuous production treats an isotope whose exp(-DC * dt) is not below
+ * this as stable.
+ */
+const double STABLE_DECAY_FACTOR = 0.9999999403953552;
+
+/** Largest difference allowed between the SIMD kernels and the scalar kernels, relative to the sum of the
+ * magnitudes of the terms of a stem: 8 ulp of that sum. Each SIMD lane adds the terms of one stem in the same order
+ * as the scalar kernels, but an optimizing build may fuse a multiply and an add in one kernel and not in the other,
+ * so a sum can round differently by an ulp of each term it adds.
+ */
+const double KERNEL_TOLERANCE = 8.0 * numeric_limits<double>::epsilon();
+
+/** Longest stem length the scalar kernels have a kernel unrolled for. Longer stems go through the generic loops.*/
+const int SPECIALIZED_STEM_LENGTH = 8;
+
+/** Pooled stem arrays of chains_data, as given by stem_trie::offsets and stem_trie::lengths.*/
+struct stem_arrays {
+    /** Bateman coefficients of every stem.*/
+    const double *coefs;
+    /** Decay constants of every stem.*/
+    const double *dcs;
+    /** Index of each decay constant in the exponential tables of a time step.*/
+    const int *rates;
+    /** First pooled entry of each stem trie node.*/
+    const int *offsets;
+    /** Length of the stem of each stem trie node.*/
+    const int *lengths;
+};
+
+/** One implementation of the sums the Bateman solutions of product_data take over the stems of a time step. Each
+ * function fills OUT[K] with the sum for stem trie node NODES[K], reading the exponentials of the time step through
+ * the rate index of each stem entry. LENGTH is the length every stem of NODES has, or 0 if their lengths differ.
+ *
+ * The _times functions take the sums of several times from one start in one pass over the stems. DECAY holds
+ * N_TIMES exponential tables of TABLE_SIZE entries each, one per time, and the sum for node NODES[K] at time T goes
+ * to OUT[T * OUT_STRIDE + K]. Each sum matches the one the single time function gives with the table of that time.
+ */
+struct bateman_kernels {
+    /** Name given to select_kernels.*/
+    const char *name;
+    /** True if these kernels are faster than the scalar kernels, so they are used without being selected.*/
+    bool preferred;
+    /** Batch decay: sum(COEF[J] * DECAY[RATE[J]]), per unit of first isotope.*/
+    void (*batch_sums)(const stem_arrays &stems, int length, const int *nodes, int n_nodes, const double *decay,
+                       double *out);
+    /** Continuous production: sum(COEF[J] * GROWTH[RATE[J]] / DC[J]), per unit production rate, taking COEF[J] * DT
+     * for a stable last isotope. 0.0 if any other isotope is stable.
+     */
+    void (*cont_sums)(const stem_arrays &stems, int length, const int *nodes, int n_nodes, const double *decay,
+                      const double *growth, double dt, double *out);
+    /** Count window: sum(COEF[J] * (DECAY[RATE[J]] - DECAY_END[RATE[J]]) / DC[J]), the decays of the last isotope
+     * per unit of first isotope and of last decay constant.
+     */
+    void (*rate_sums)(const stem_arrays &stems, int length, const int *nodes, int n_nodes, const double *decay,
+                      const double *decay_end, double *out);
+    /** batch_sums at N_TIMES times.*/
+    void (*batch_times_sums)(const stem_arrays &stems, int length, const int *nodes, int n_nodes, const double *decay,
+                             int n_times, int table_size, double *out, int out_stride);
+    /** rate_sums over N_TIMES count windows, with the tables of the window ends in DECAY_END.*/
+    void (*rate_times_sums)(const stem_arrays &stems, int length, const int *nodes, int n_nodes, const double *decay,
+                            const double *decay_end, int n_times, int table_size, double *out, int out_stride);
+};
+
+vector<const bateman_kernels *> supported_kernels();
+const bateman_kernels &scalar_kernels();
+const bateman_kernels &active_kernels();
+bool select_kernels(const string &name);
+
+#endif //FIER_BATEMAN_KERNELS_H
@@ -7,240 +7,359 @@
  */
 
 #include "chains_data.h"
+#include <thread> // for building chains in parallel
+#include <atomic> // for handing out isotopes to threads
+#include <iterator> // for appending moved chains
 /** Imports species data from DATA_IN, an object of type species_data.
      *
-     * @param data_in Class containing speices data unpacked from input files.
+     * @param data_in Class containing speices data unpacked from input files, shared with the other classes.
      */
-void chains_data::import_species_data(species_data data_in) {
+void chains_data::import_species_data(shared_ptr<const species_data> data_in) {
     data = data_in;
-    fragments = get_keys(data_in.get_yields());
+    removed_decays.assign(data->n_isotopes(), 0);
+    auto built = make_shared<chain_set>(*set);
+    built->fragments = data->get_fragments();
+    set = built;
 }
 
-/** Tests if a set of decay chains are stable. This occurs when all chain-ends have no decay modes.
+/** Number of decay modes of isotope ID, 0 if build_chains removed them.
  *
- * @param chains List of decay chains (2d list of integers).
- * @return TRUE if stable, FALSE otherwise.
+ * @param id Isotope ID.
+ * @return Number of decay modes.
  */
-bool chains_data::unstable(vector <vector<int>> chains) {
-    bool res = false;
-    for (auto chain : chains) {
-        int last = chain[chain.size() - 1];
-        if (data.n_decays(last) != 0) {
-            res = true;
-        }
-    }
-    return res;
+int chains_data::n_decays_id(int id) const {
+    return removed_decays[id] ? 0 : data->n_decays_id(id);
 }
 
-
-/** Builds all possible decay chains from each decay fragment, and then appends to field CHAINS.
- * Iteratively looks at each fragment species and checks if it has a non-infinite half-life
- * and has a listed decay daughter, and if so appends it to the species_chains lists.
- * @param error_file Optional error file to record data problems (such as non-infinite half life but no daughter).
+/** Builds the decay graph of DATA for build_chains. Isotopes on a decay cycle are found as the strongly connected
+ * components (Tarjan's algorithm) with more than one member, or with a decay to themselves.
+ *
+ * @return Decay graph.
  */
-void chains_data::build_chains(string error_file = "NONE") {
-    chains.clear();
-    chains_dcs.clear();
-    chains_brs.clear();
-    vector<int> not_fragment_produced;
-
-    for (int fragiZA : fragments) {
-        double fragDC = data.get_DC(fragiZA);
-        double fragBR = 0.0;
-
-        vector <vector<int>> species_chains;
-        vector <vector<double>> species_chains_dcs;
-        vector <vector<double>> species_chains_brs;
-
-        vector<int> first;
-        vector<double> first_dc;
-        vector<double> first_br;
-        if (not_in(fragiZA, products)) {
-            products.push_back(fragiZA);
+chains_data::decay_graph chains_data::build_decay_graph() const {
+    int n = data->n_isotopes();
+    decay_graph graph;
+    graph.cyclic.assign(n, 0);
+    graph.sub_chains.resize(n);
+
+    vector<int> index(n, -1);
+    vector<int> low(n, 0);
+    vector<char> on_stack(n, 0);
+    vector<int> stack;
+    vector<pair<int, int>> calls; // isotope ID and next decay mode to follow
+    int counter = 0;
+    for (int root = 0; root < n; ++root) {
+        if (index[root] >= 0) {
+            continue;
         }
-        first.push_back(fragiZA);
-        first_dc.push_back(fragDC);
-        first_br.push_back(fragBR);
-        species_chains.push_back(first);
-        species_chains_dcs.push_back(first_dc);
-        species_chains_brs.push_back(first_br);
-
-        while (unstable(species_chains)) {
-            for (int j = 0; j < species_chains.size(); ++j) {
-                int last = species_chains[j][species_chains[j].size() - 1];
-                for (int k = 0; k < data.n_decays(last); ++k) {
-                    if (k == 0) {
-                        int daughter = data.get_decay_daughteriZA(last, k);
-                        if (not_in(daughter, species_chains[j])) {
-                            if (not_in(daughter, products)) {
-                                products.push_back(daughter);
-                                not_fragment_produced.push_back(daughter);
-                            }
-                            species_chains[j].push_back(daughter);
-                            species_chains_dcs[j].push_back(data.get_DC(daughter));
-                            double modeBR = data.get_decay_branching(last, k);
-                            species_chains_brs[j].push_back(modeBR);
-                        } else {
-                            data.remove_decays(last);
-                            if (error_file != "NONE") {
-                                ofstream error_log;
-                                error_log.open(error_file, ios_base::app);
-                                error_log << "WARNING: non-physical decay chain ending in iZA = " << last << '\n';
-                                error_log.close();
-                            } else {
-                                cout << "WARNING: non-physical decay chain ending in iZA = " << last << '\n';
-                            }
-                        }
-                    } else {
-                        int daughter = data.get_decay_daughteriZA(last, k);
-                        if (not_in(daughter, species_chains[j])) {
-                            vector<int> copy_chain(species_chains[j].begin(), species_chains[j].end() - 1);
-                            vector<double> copy_chain_dcs(species_chains_dcs[j].begin(),
-                                                          species_chains_dcs[j].end() - 1);
-                            vector<double> copy_chain_brs(species_chains_brs[j].begin(),
-                                                          species_chains_brs[j].end() - 1);
-
-                            species_chains.push_back(copy_chain);
-                            species_chains_dcs.push_back(copy_chain_dcs);
-                            species_chains_brs.push_back(copy_chain_brs);
-                            auto m = static_cast<int>(species_chains.size() - 1);
-                            if (not_in(daughter, products)) {
-                                products.push_back(daughter);
-                                not_fragment_produced.push_back(daughter);
-                            }
-                            species_chains[m].push_back(daughter);
-                            species_chains_dcs[m].push_back(data.get_DC(daughter));
-                            double modeBR = data.get_decay_branching(last, k);
-                            species_chains_brs[m].push_back(modeBR);
-                        } else {
-                            data.remove_decays(last);
-                            if (error_file != "NONE") {
-                                ofstream error_log;
-                                error_log.open(error_file, ios_base::app);
-                                error_log << "WARNING: non-physical decay chain ending in iZA = " << last << '\n';
-                                error_log.close();
-                            } else {
-                                cout << "WARNING: non-physical decay chain ending in iZA = " << last << '\n';
-                            }
+        index[root] = low[root] = counter++;
+        stack.push_back(root);
+        on_stack[root] = 1;
+        calls.emplace_back(root, 0);
+        while (!calls.empty()) {
+            int id = calls.back().first;
+            int k = calls.back().second;
+            if (k < data->n_decays_id(id)) {
+                calls.back().second = k + 1;
+                int daughter_id = data->get_decay_daughter_id(id, k);
+                if (daughter_id == id) {
+                    graph.cyclic[id] = 1;
+                } else if (k > 0 && daughter_id == data->get_decay_daughter_id(id, 0)) {
+                    graph.cyclic[id] = 1;
+                }
+                if (index[daughter_id] < 0) {
+                    index[daughter_id] = low[daughter_id] = counter++;
+                    stack.push_back(daughter_id);
+                    on_stack[daughter_id] = 1;
+                    calls.emplace_back(daughter_id, 0);
+                } else if (on_stack[daughter_id]) {
+                    low[id] = min(low[id], index[daughter_id]);
+                }
+            } else {
+                calls.pop_back();
+                if (!calls.empty()) {
+                    low[calls.back().first] = min(low[calls.back().first], low[id]);
+                }
+                if (low[id] == index[id]) {
+                    // pop the component of ID off the stack
+                    auto first = static_cast<int>(stack.size()) - 1;
+                    while (stack[first] != id) {
+                        --first;
+                    }
+                    bool cycle = (first < static_cast<int>(stack.size()) - 1);
+                    for (auto i = static_cast<size_t>(first); i < stack.size(); ++i) {
+                        on_stack[stack[i]] = 0;
+                        if (cycle) {
+                            graph.cyclic[stack[i]] = 1;
                         }
                     }
+                    stack.resize(first);
                 }
             }
         }
-        for (int j = 0; j < species_chains.size(); ++j) {
-            chains.push_back(species_chains[j]);
-            chains_dcs.push_back(species_chains_dcs[j]);
-            chains_brs.push_back(species_chains_brs[j]);
-        }
     }
 
-    for (int i = 0; i < not_fragment_produced.size(); ++i) {
-        int iZA = not_fragment_produced[i];
-        double DC = data.get_DC(iZA);
-        double BR = 0.0;
+    // isotopes that reach a cycle, found backwards from the cycles
+    vector<int> parent_offsets(n + 1, 0);
+    for (int id = 0; id < n; ++id) {
+        for (int k = 0; k < data->n_decays_id(id); ++k) {
+            ++parent_offsets[data->get_decay_daughter_id(id, k) + 1];
+        }
+    }
+    for (int id = 0; id < n; ++id) {
+        parent_offsets[id + 1] += parent_offsets[id];
+    }
+    vector<int> parents(parent_offsets[n]);
+    vector<int> filled(parent_offsets.begin(), parent_offsets.end() - 1);
+    for (int id = 0; id < n; ++id) {
+        for (int k = 0; k < data->n_decays_id(id); ++k) {
+            parents[filled[data->get_decay_daughter_id(id, k)]++] = id;
+        }
+    }
+    graph.reaches_cycle = graph.cyclic;
+    for (int id = 0; id < n; ++id) {
+        if (graph.cyclic[id]) {
+            stack.push_back(id);
+        }
+    }
+    while (!stack.empty()) {
+        int id = stack.back();
+        stack.pop_back();
+        for (int p = parent_offsets[id]; p < parent_offsets[id + 1]; ++p) {
+            if (!graph.reaches_cycle[parents[p]]) {
+                graph.reaches_cycle[parents[p]] = 1;
+                stack.push_back(parents[p]);
+            }
+        }
+    }
 
-        vector <vector<int>> species_chains;
-        vector <vector<double>> species_chains_dcs;
-        vector <vector<double>> species_chains_brs;
+    // first-daughter sub-chains, until an isotope with no decay modes or one already in the sub-chain
+    for (int id = 0; id < n; ++id) {
+        vector<int> &sub = graph.sub_chains[id];
+        sub.push_back(id);
+        int last_id = id;
+        while (data->n_decays_id(last_id) > 0) {
+            int daughter_id = data->get_decay_daughter_id(last_id, 0);
+            if (graph.cyclic[daughter_id] && !not_in(daughter_id, sub)) {
+                break;
+            }
+            sub.push_back(daughter_id);
+            last_id = daughter_id;
+        }
+    }
+    return graph;
+}
 
-        vector<int> first;
-        vector<double> first_dc;
-        vector<double> first_br;
-        if (not_in(iZA, products)) {
-            products.push_back(iZA);
+/** Tests if isotope ID is in chain S of SLOTS.
+ *
+ * @param graph Decay graph from build_decay_graph.
+ * @param slots Chains being built.
+ * @param s Chain to search.
+ * @param id Isotope ID.
+ * @return TRUE if ID is in the chain, FALSE otherwise.
+ */
+bool chains_data::in_chain(const decay_graph &graph, const vector<chain_slot> &slots, int s, int id) const {
+    int n = slots[s].prefix + slots[s].length;
+    for (int cur = s; cur >= 0; cur = slots[cur].parent) {
+        const vector<int> &sub = graph.sub_chains[slots[cur].start];
+        for (int i = 0; i < n - slots[cur].prefix; ++i) {
+            if (sub[i] == id) {
+                return true;
+            }
         }
-        first.push_back(iZA);
-        first_dc.push_back(DC);
-        first_br.push_back(BR);
-        species_chains.push_back(first);
-        species_chains_dcs.push_back(first_dc);
-        species_chains_brs.push_back(first_br);
-
-        while (unstable(species_chains)) {
-            for (int j = 0; j < species_chains.size(); ++j) {
-                int last = species_chains[j][species_chains[j].size() - 1];
-                for (int k = 0; k < data.n_decays(last); ++k) {
-                    if (k == 0) {
-                        int daughter = data.get_decay_daughteriZA(last, k);
-                        if (not_in(daughter, species_chains[j])) {
-                            if (not_in(daughter, products)) {
-                                products.push_back(daughter);
-                                not_fragment_produced.push_back(daughter);
-                            }
-                            species_chains[j].push_back(daughter);
-                            species_chains_dcs[j].push_back(data.get_DC(daughter));
-                            double modeBR = data.get_decay_branching(last, k);
-                            species_chains_brs[j].push_back(modeBR);
-                        } else {
-                            data.remove_decays(last);
-                            if (error_file != "NONE") {
-                                ofstream error_log;
-                                error_log.open(error_file, ios_base::app);
-                                error_log << "WARNING: non-physical decay chain ending in iZA = " << last << '\n';
-                                error_log.close();
-                            } else {
-                                cout << "WARNING: non-physical decay chain ending in iZA = " << last << '\n';
-                            }
-                        }
+        n = min(n, slots[cur].prefix);
+    }
+    return false;
+}
+
+/** Builds all decay chains starting at isotope ROOT_ID into OUT. The chains grow together one isotope per pass,
+ * each through the first decay mode of its last isotope, and every other decay mode starts a new chain that grows
+ * in the same pass. Decay modes that would close a chain on itself are removed, with a warning. Only chains from
+ * isotopes that reach a cycle can do that, so chains from any other isotope can be built on any thread.
+ *
+ * @param root_id Isotope ID of the first isotope of every chain.
+ * @param graph Decay graph from build_decay_graph.
+ * @param out Chains from ROOT_ID and the isotopes they reach.
+ * @param marks Scratch space of one 0 per isotope ID, left as it was found.
+ * @param error_file Optional error file to record data problems.
+ */
+void chains_data::add_species_chains(int root_id, const decay_graph &graph, species_chains &out,
+                                     vector<char> &marks, const string &error_file) {
+    vector<chain_slot> slots;
+    slots.push_back({-1, 0, root_id, 0.0, 1});
+    vector<int> growing(1, 0);
+    vector<int> next;
+    while (!growing.empty()) {
+        next.clear();
+        for (int j = 0; j < growing.size(); ++j) {
+            int s = growing[j];
+            int last_id = graph.sub_chains[slots[s].start][slots[s].length - 1];
+            for (int k = 0; k < n_decays_id(last_id); ++k) {
+                int daughter_id = data->get_decay_daughter_id(last_id, k);
+                if (graph.cyclic[last_id] && in_chain(graph, slots, s, daughter_id)) {
+                    removed_decays[last_id] = 1;
+                    int last = data->get_iZA(last_id);
+                    if (error_file != "NONE") {
+                        ofstream error_log;
+                        error_log.open(error_file, ios_base::app);
+                        error_log << "WARNING: non-physical decay chain ending in iZA = " << last << '\n';
+                        error_log.close();
                     } else {
-                        int daughter = data.get_decay_daughteriZA(last, k);
-                        if (not_in(daughter, species_chains[j])) {
-                            vector<int> copy_chain(species_chains[j].begin(), species_chains[j].end() - 1);
-                            vector<double> copy_chain_dcs(species_chains_dcs[j].begin(),
-                                                          species_chains_dcs[j].end() - 1);
-                            vector<double> copy_chain_brs(species_chains_brs[j].begin(),
-                                                          species_chains_brs[j].end() - 1);
-
-                            species_chains.push_back(copy_chain);
-                            species_chains_dcs.push_back(copy_chain_dcs);
-                            species_chains_brs.push_back(copy_chain_brs);
-                            auto m = static_cast<int>(species_chains.size() - 1);
-                            if (not_in(daughter, products)) {
-                                products.push_back(daughter);
-                                not_fragment_produced.push_back(daughter);
-                            }
-                            species_chains[m].push_back(daughter);
-                            species_chains_dcs[m].push_back(data.get_DC(daughter));
-                            double modeBR = data.get_decay_branching(last, k);
-                            species_chains_brs[m].push_back(modeBR);
-                        } else {
-                            data.remove_decays(last);
-                            if (error_file != "NONE") {
-                                ofstream error_log;
-                                error_log.open(error_file, ios_base::app);
-                                error_log << "WARNING: non-physical decay chain ending in iZA = " << last << '\n';
-                                error_log.close();
-                            } else {
-                                cout << "WARNING: non-physical decay chain ending in iZA = " << last << '\n';
-                            }
-                        }
+                        cout << "WARNING: non-physical decay chain ending in iZA = " << last << '\n';
                     }
+                    continue;
+                }
+                if (!marks[daughter_id]) {
+                    marks[daughter_id] = 1;
+                    out.reached.push_back(daughter_id);
                 }
+                if (k == 0) {
+                    slots[s].length = slots[s].length + 1;
+                } else {
+                    // the new chain is chain S up to LAST, then DAUGHTER
+                    int prefix = slots[s].prefix + slots[s].length - 1;
+                    slots.push_back({s, prefix, daughter_id, data->get_decay_branching_id(last_id, k), 1});
+                    growing.push_back(static_cast<int>(slots.size()) - 1);
+                }
+            }
+            last_id = graph.sub_chains[slots[s].start][slots[s].length - 1];
+            if (n_decays_id(last_id) != 0) {
+                next.push_back(s);
+            }
+        }
+        swap(growing, next);
+    }
+    for (int id : out.reached) {
+        marks[id] = 0;
+    }
+
+    // chains are kept in the order they were started, after the chains they branch from
+    chain_pool &chains = out.chains;
+    for (const chain_slot &slot : slots) {
+        if (slot.parent >= 0) {
+            for (int i = chains.begin(slot.parent); i < chains.begin(slot.parent) + slot.prefix; ++i) {
+                chains.push(chains.isotopes[i], chains.dcs[i], chains.brs[i]);
+            }
+        }
+        const vector<int> &sub = graph.sub_chains[slot.start];
+        for (int i = 0; i < slot.length; ++i) {
+            chains.push(data->get_iZA(sub[i]), data->get_DC_id(sub[i]),
+                        (i == 0) ? slot.br : data->get_decay_branching_id(sub[i - 1], 0));
+        }
+        chains.close();
+    }
+}
+
+/** Builds the chains from every isotope of ROOT_IDS into OUT, splitting the isotopes across N_THREADS threads.
+ * Isotopes that reach a decay cycle are built in order on the calling thread, so decay modes are removed as they
+ * would be if every isotope were built in order.
+ *
+ * @param root_ids Isotope IDs to build chains from.
+ * @param graph Decay graph from build_decay_graph.
+ * @param out Chains from each isotope of ROOT_IDS, in the same order.
+ * @param error_file Optional error file to record data problems.
+ * @param n_threads Number of threads.
+ */
+void chains_data::add_all_species_chains(const vector<int> &root_ids, const decay_graph &graph,
+                                         vector<species_chains> &out, const string &error_file, int n_threads) {
+    out.assign(root_ids.size(), species_chains());
+    atomic<size_t> next_root(0);
+    auto build = [&]() {
+        vector<char> marks(data->n_isotopes(), 0);
+        for (size_t i = next_root++; i < root_ids.size(); i = next_root++) {
+            if (!graph.reaches_cycle[root_ids[i]]) {
+                add_species_chains(root_ids[i], graph, out[i], marks, error_file);
             }
         }
-        for (int j = 0; j < species_chains.size(); ++j) {
-            chains.push_back(species_chains[j]);
-            chains_dcs.push_back(species_chains_dcs[j]);
-            chains_brs.push_back(species_chains_brs[j]);
+    };
+    vector<thread> workers;
+    for (int i = 1; i < n_threads; ++i) {
+        workers.emplace_back(build);
+    }
+    vector<char> marks(data->n_isotopes(), 0);
+    for (size_t i = 0; i < root_ids.size(); ++i) {
+        if (graph.reaches_cycle[root_ids[i]]) {
+            add_species_chains(root_ids[i], graph, out[i], marks, error_file);
+        }
+    }
+    build();
+    for (thread &worker : workers) {
+        worker.join();
+    }
+}
+
+/** Builds all possible decay chains from each decay fragment, and then appends to field CHAINS.
+ * Iteratively looks at each fragment species and checks if it has a non-infinite half-life
+ * and has a listed decay daughter, and if so appends it to the species_chains lists. Products first found as
+ * daughters of a fragment then get chains of their own, in the order they were found. The chains of each isotope
+ * are built on N_THREADS threads and appended in that order, so the result does not depend on N_THREADS.
+ * @param error_file Optional error file to record data problems (such as non-infinite half life but no daughter).
+ * @param n_threads Number of threads, 0 for one per hardware thread.
+ */
+void chains_data::build_chains(string error_file = "NONE", int n_threads) {
+    auto built = make_shared<chain_set>(*set);
+    const vector<int> &fragments = built->fragments;
+    vector<int> &products = built->products;
+    chain_pool &chains = built->chains;
+    chains = chain_pool();
+
+    decay_graph graph = build_decay_graph();
+    vector<char> in_products(data->n_isotopes(), 0);
+    for (int product : products) {
+        in_products[data->get_id(product)] = 1;
+    }
+    vector<int> not_fragment_produced;
+    vector<int> root_ids;
+    for (int fragiZA : fragments) {
+        root_ids.push_back(data->get_id(fragiZA));
+    }
+    // fragments first, then products first found as daughters, in the order they were found
+    vector<species_chains> built_roots;
+    while (!root_ids.empty()) {
+        add_all_species_chains(root_ids, graph, built_roots, error_file, worker_threads(n_threads));
+        size_t n_found = not_fragment_produced.size();
+        for (int i = 0; i < root_ids.size(); ++i) {
+            if (!in_products[root_ids[i]]) {
+                in_products[root_ids[i]] = 1;
+                products.push_back(data->get_iZA(root_ids[i]));
+            }
+            for (int daughter_id : built_roots[i].reached) {
+                if (!in_products[daughter_id]) {
+                    in_products[daughter_id] = 1;
+                    products.push_back(data->get_iZA(daughter_id));
+                    not_fragment_produced.push_back(daughter_id);
+                }
+            }
+            const chain_pool &root_chains = built_roots[i].chains;
+            int start = static_cast<int>(chains.isotopes.size());
+            for (int j = 1; j <= root_chains.size(); ++j) {
+                chains.offsets.push_back(start + root_chains.offsets[j]);
+            }
+            chains.isotopes.insert(chains.isotopes.end(), root_chains.isotopes.begin(), root_chains.isotopes.end());
+            chains.dcs.insert(chains.dcs.end(), root_chains.dcs.begin(), root_chains.dcs.end());
+            chains.brs.insert(chains.brs.end(), root_chains.brs.begin(), root_chains.brs.end());
         }
+        root_ids.assign(not_fragment_produced.begin() + n_found, not_fragment_produced.end());
     }
 
     // adjust chains with same decay constant
     double delta = 0.0001;
     for (int i = 0; i < chains.size(); ++i) {
         double n = 1.0;
-        for (int j = 0; j < chains[i].size(); ++j) {
-            if (mult_in(chains_dcs[i][j], chains_dcs[i])) {
-                chains_dcs[i][j] = chains_dcs[i][j] * (1.0 + n * delta);
+        int first = chains.begin(i);
+        int last = first + chains.length(i);
+        for (int j = first; j < last; ++j) {
+            if (count(chains.dcs.begin() + first, chains.dcs.begin() + last, chains.dcs[j]) > 1) {
+                chains.dcs[j] = chains.dcs[j] * (1.0 + n * delta);
                 if (error_file != "NONE") {
                     ofstream error_log;
                     error_log.open(error_file, ios_base::app);
                     error_log << "WARNING: same decay constants in chain: " << '\n';
-                    for (int k = 0; k < chains[i].size(); ++k) {
-                        if (chains[i][k] == chains[i][j]) {
-                            error_log << "   " << chains[i][k] << '<' << '\n';
+                    for (int k = first; k < last; ++k) {
+                        if (chains.isotopes[k] == chains.isotopes[j]) {
+                            error_log << "   " << chains.isotopes[k] << '<' << '\n';
                         } else {
-                            error_log << "   " << chains[i][k] << '\n';
+                            error_log << "   " << chains.isotopes[k] << '\n';
                         }
                     }
                     error_log.close();
@@ -250,39 +369,198 @@ void chains_data::build_chains(string error_file = "NONE") {
         }
     }
 
+    set = built;
 }
 
-/** Extracts all possible decay stems from field CHAINS.
+/** Extracts all possible decay stems from field CHAINS. Every prefix of a chain is a stem of its last isotope; the
+ * prefixes are added to the stem trie, where a stem already reached by an earlier chain is found instead of repeated.
  */
 void chains_data::extract_stems() {
-    stems.clear();
-    stems_dcs.clear();
-    stems_brs.clear();
-
+    auto built = make_shared<chain_set>(*set);
+    const chain_pool &chains = built->chains;
+    stem_trie &stems = built->stems;
+    stems = stem_trie();
+    node_dcs.clear();
+    node_brs.clear();
+
+    unordered_map<int, int> root_nodes;
+    vector<int> first_child;
+    vector<int> next_sibling;
+    vector<int> last_child;
     for (int i = 0; i < chains.size(); ++i) {
-        for (int j = 0; j < chains[i].size(); ++j) {
-            vector<int> stem(chains[i].begin() + 0, chains[i].begin() + j + 1);
-            vector<double> stem_dcs(chains_dcs[i].begin() + 0, chains_dcs[i].begin() + j + 1);
-            vector<double> stem_brs(chains_brs[i].begin() + 0, chains_brs[i].begin() + j + 1);
-            int iZA = stem[stem.size() - 1];
-
-            if (not_in(stem, stems[iZA])) {
-                stems[iZA].push_back(stem);
-                stems_dcs[iZA].push_back(stem_dcs);
-                stems_brs[iZA].push_back(stem_brs);
+        int node = -1;
+        for (int j = chains.begin(i); j < chains.begin(i) + chains.length(i); ++j) {
+            int iZA = chains.isotopes[j];
+            int next = -1;
+            if (node == -1) {
+                auto root = root_nodes.find(iZA);
+                next = (root == root_nodes.end()) ? -1 : root->second;
+            } else {
+                for (int child = first_child[node]; child != -1; child = next_sibling[child]) {
+                    if (stems.isotopes[child] == iZA) {
+                        next = child;
+                        break;
+                    }
+                }
             }
+
+            if (next == -1) {
+                next = stems.size();
+                stems.isotopes.push_back(iZA);
+                stems.parents.push_back(node);
+                node_dcs.push_back(chains.dcs[j]);
+                node_brs.push_back(chains.brs[j]);
+                first_child.push_back(-1);
+                next_sibling.push_back(-1);
+                last_child.push_back(-1);
+                if (node == -1) {
+                    root_nodes[iZA] = next;
+                } else if (last_child[node] == -1) {
+                    first_child[node] = next;
+                    last_child[node] = next;
+                } else {
+                    next_sibling[last_child[node]] = next;
+                    last_child[node] = next;
+                }
+            }
+            node = next;
         }
     }
+    link_stems(stems);
+    set = built;
+    compute_coefficients();
 }
 
+/** Fills in everything in STEMS that follows from the isotope and parent of each node: the stem lengths, the links
+ * between parents and children, the roots and the stems of each isotope.
+ *
+ * @param stems Stem trie with ISOTOPES and PARENTS set.
+ */
+void chains_data::link_stems(stem_trie &stems) {
+    int n = stems.size();
+    stems.lengths.assign(n, 1);
+    stems.first_child.assign(n, -1);
+    stems.next_sibling.assign(n, -1);
+    stems.roots.clear();
+    stems.root_of.assign(n, -1);
+    stems.offsets.assign(n + 1, 0);
+    stems.max_length = 0;
+    vector<int> last_child(n, -1);
+    for (int node = 0; node < n; ++node) {
+        int parent = stems.parents[node];
+        if (parent == -1) {
+            stems.roots.push_back(node);
+            stems.root_of[node] = node;
+        } else {
+            stems.lengths[node] = stems.lengths[parent] + 1;
+            stems.root_of[node] = stems.root_of[parent];
+            if (last_child[parent] == -1) {
+                stems.first_child[parent] = node;
+            } else {
+                stems.next_sibling[last_child[parent]] = node;
+            }
+            last_child[parent] = node;
+        }
+        stems.offsets[node + 1] = stems.offsets[node] + stems.lengths[node];
+        stems.max_length = max(stems.max_length, stems.lengths[node]);
+    }
+
+    // group the nodes by last isotope, keeping the order within each group
+    stems.end_isotopes = stems.isotopes;
+    sort(stems.end_isotopes.begin(), stems.end_isotopes.end());
+    stems.end_isotopes.erase(unique(stems.end_isotopes.begin(), stems.end_isotopes.end()), stems.end_isotopes.end());
+    stems.end_offsets.assign(stems.end_isotopes.size() + 1, 0);
+    vector<int> groups(n);
+    for (int node = 0; node < n; ++node) {
+        groups[node] = static_cast<int>(lower_bound(stems.end_isotopes.begin(), stems.end_isotopes.end(),
+                                                    stems.isotopes[node]) - stems.end_isotopes.begin());
+        stems.end_offsets[groups[node] + 1] = stems.end_offsets[groups[node] + 1] + 1;
+    }
+    for (int i = 0; i < stems.end_isotopes.size(); ++i) {
+        stems.end_offsets[i + 1] = stems.end_offsets[i + 1] + stems.end_offsets[i];
+    }
+    vector<int> filled(stems.end_offsets.begin(), stems.end_offsets.end() - 1);
+    stems.end_nodes.resize(n);
+    for (int node = 0; node < n; ++node) {
+        stems.end_nodes[filled[groups[node]]++] = node;
+    }
+}
+
+/** Fills STEM_DCS, RATE_DCS, STEM_RATES and STEM_COEFS from NODE_DCS and NODE_BRS. Parents come before their
+ * children, so each stem extends the prefix product, rates and denominators of its parent, and only its last
+ * denominator takes a full product.
+ */
+void chains_data::compute_coefficients() {
+    const stem_trie &stems = set->stems;
+    size_t n_entries = stems.offsets.back();
+    stem_dcs.resize(n_entries);
+    stem_rates.resize(n_entries);
+    stem_coefs.resize(n_entries);
+    rate_dcs.clear();
+    unordered_map<double, int> rate_index;
+    vector<double> denoms(n_entries);
+    vector<double> prefix(stems.size());
+    for (int node = 0; node < stems.size(); ++node) {
+        int n = stems.lengths[node];
+        int parent = stems.parents[node];
+        double *dcs = &stem_dcs[stems.offsets[node]];
+        double *node_denoms = &denoms[stems.offsets[node]];
+        double dc = node_dcs[node];
+        if (parent == -1) {
+            prefix[node] = 1.0;
+        } else {
+            const double *parent_denoms = &denoms[stems.offsets[parent]];
+            copy(stem_dcs.begin() + stems.offsets[parent], stem_dcs.begin() + stems.offsets[parent] + n - 1, dcs);
+            copy(stem_rates.begin() + stems.offsets[parent], stem_rates.begin() + stems.offsets[parent] + n - 1,
+                 stem_rates.begin() + stems.offsets[node]);
+            prefix[node] = prefix[parent] * node_brs[node] * node_dcs[parent];
+            for (int j = 0; j < n - 1; ++j) {
+                node_denoms[j] = parent_denoms[j] * (dc - dcs[j]);
+            }
+        }
+        dcs[n - 1] = dc;
+        auto rate = rate_index.emplace(dc, static_cast<int>(rate_dcs.size()));
+        if (rate.second) {
+            rate_dcs.push_back(dc);
+        }
+        stem_rates[stems.offsets[node] + n - 1] = rate.first->second;
+        double denom = 1.0;
+        for (int k = 0; k < n - 1; ++k) {
+            denom = denom * (dcs[k] - dc);
+        }
+        node_denoms[n - 1] = denom;
+        for (int j = 0; j < n; ++j) {
+            stem_coefs[stems.offsets[node] + j] = prefix[node] / node_denoms[j];
+        }
+    }
+}
+
+/** Lists the nodes on the path from the root of the stem trie to NODE.
+ *
+ * @param node Stem trie node.
+ * @return Nodes of the stem of NODE, first isotope first.
+ */
+vector<int> chains_data::stem_nodes(int node) const {
+    const stem_trie &stems = set->stems;
+    vector<int> path(stems.lengths[node]);
+    for (int j = static_cast<int>(path.size()) - 1; j >= 0; --j) {
+        path[j] = node;
+        node = stems.parents[node];
+    }
+    return path;
+}
 
 /** Accessor to retrieve the stems of isotope IZA.
  *
  * @param iZA Unique isotope hash.
  * @return A list of all stems for IZA.
  */
-vector<vector<int>> chains_data::get_stems(int iZA) {
-    return stems[iZA];
+vector<vector<int>> chains_data::get_stems(int iZA) const {
+    vector<vector<int>> stems(n_stems(iZA));
+    for (int i = 0; i < stems.size(); ++i) {
+        stems[i] = get_stems_index(iZA, i);
+    }
+    return stems;
 }
 
 /** Returns the Ith stem of IZA.
@@ -291,8 +569,12 @@ vector<vector<int>> chains_data::get_stems(int iZA) {
  * @param i Element of stem to be accessed.
  * @return Ith element of STEMS[IZA] (a list)
  */
-vector<int> chains_data::get_stems_index(int iZA, int i) {
-    return stems[iZA][i];
+vector<int> chains_data::get_stems_index(int iZA, int i) const {
+    vector<int> stem = stem_nodes(set->stems.stems_of(iZA)[i]);
+    for (int &node : stem) {
+        node = set->stems.isotopes[node];
+    }
+    return stem;
 }
 
 /** The number of stems for isotope IZA.
@@ -300,8 +582,8 @@ vector<int> chains_data::get_stems_index(int iZA, int i) {
  * @param iZA Unique isotope hash.
  * @return
  */
-int chains_data::n_stems(int iZA) {
-    return static_cast<int>(stems[iZA].size());
+int chains_data::n_stems(int iZA) const {
+    return static_cast<int>(set->stems.stems_of(iZA).size());
 }
 
 
@@ -310,8 +592,12 @@ int chains_data::n_stems(int iZA) {
  * @param iZA Unique isotope hash.
  * @return List of all stem decay constants (2d list).
  */
-vector <vector<double>> chains_data::get_stems_dcs(int iZA) {
-    return stems_dcs[iZA];
+vector <vector<double>> chains_data::get_stems_dcs(int iZA) const {
+    vector<vector<double>> dcs(n_stems(iZA));
+    for (int i = 0; i < dcs.size(); ++i) {
+        dcs[i] = get_stems_dcs_index(iZA, i);
+    }
+    return dcs;
 }
 
 
@@ -321,8 +607,12 @@ vector <vector<double>> chains_data::get_stems_dcs(int iZA) {
  * @param i Element of stem to be accessed.
  * @return Ith element of STEMS_DCS[IZA] (a list)
  */
-vector<double> chains_data::get_stems_dcs_index(int iZA, int i) {
-    return stems_dcs[iZA][i];
+vector<double> chains_data::get_stems_dcs_index(int iZA, int i) const {
+    vector<double> dcs;
+    for (int node : stem_nodes(set->stems.stems_of(iZA)[i])) {
+        dcs.push_back(node_dcs[node]);
+    }
+    return dcs;
 }
 
 
@@ -331,8 +621,12 @@ vector<double> chains_data::get_stems_dcs_index(int iZA, int i) {
  * @param iZA Unique isotope hash.
  * @return List of all stem branching ratios (2d list).
  */
-vector <vector<double>> chains_data::get_stems_brs(int iZA) {
-    return stems_brs[iZA];
+vector <vector<double>> chains_data::get_stems_brs(int iZA) const {
+    vector<vector<double>> brs(n_stems(iZA));
+    for (int i = 0; i < brs.size(); ++i) {
+        brs[i] = get_stems_brs_index(iZA, i);
+    }
+    return brs;
 }
 
 /** Returns the Ith stem branching ratio of IZA.
@@ -341,28 +635,35 @@ vector <vector<double>> chains_data::get_stems_brs(int iZA) {
  * @param i Element of stem to be accessed.
  * @return Ith element of STEMS_BRS[IZA] (a list)
  */
-vector<double> chains_data::get_stems_brs_index(int iZA, int i) {
-    return stems_brs[iZA][i];
+vector<double> chains_data::get_stems_brs_index(int iZA, int i) const {
+    vector<double> brs;
+    for (int node : stem_nodes(set->stems.stems_of(iZA)[i])) {
+        brs.push_back(node_brs[node]);
+    }
+    return brs;
 }
 
 /** Returns list of produced species from field PRODUCTS.
  *
  * @return PRODUCTS field.
  */
-vector<int> chains_data::get_products() {
-    return products;
+vector<int> chains_data::get_products() const {
+    return set->products;
 }
 
 
 /** Prints all decay chains to terminal via cout.
  *
  */
-void chains_data::print_chains() {
-    for (auto &chain : chains) {
-        for (int j : chain) {
-            cout << j << ',' << data.n_decays(j) << '\n';
-            for (int k = 0; k < data.n_decays(j); ++k) {
-                cout << "   " << data.get_decay_daughteriZA(j, k) << '\n';
+void chains_data::print_chains() const {
+    const chain_pool &chains = set->chains;
+    for (int i = 0; i < chains.size(); ++i) {
+        for (int j = chains.begin(i); j < chains.begin(i) + chains.length(i); ++j) {
+            int iZA = chains.isotopes[j];
+            int id = data->get_id(iZA);
+            cout << iZA << ',' << n_decays_id(id) << '\n';
+            for (int k = 0; k < n_decays_id(id); ++k) {
+                cout << "   " << data->get_decay_daughteriZA(iZA, k) << '\n';
             }
         }
         cout << "------" << '\n';
@@ -373,17 +674,18 @@ void chains_data::print_chains() {
  *
  * @param chains_out String filename of output file.
  */
-void chains_data::save_chains(string chains_out) {
+void chains_data::save_chains(string chains_out) const {
+    const chain_pool &chains = set->chains;
     ofstream chains_file;
     chains_file.open(chains_out);
     for (int i = 0; i < chains.size(); ++i) {
-        for (int j = 0; j < chains[i].size(); ++j) {
-            int Z = chains[i][j] / 10000;
-            int I = (chains[i][j] - Z * 10000) / 1000;
-            int A = chains[i][j] - Z * 10000 - I * 1000;
+        for (int j = chains.begin(i); j < chains.begin(i) + chains.length(i); ++j) {
+            int Z = chains.isotopes[j] / 10000;
+            int I = (chains.isotopes[j] - Z * 10000) / 1000;
+            int A = chains.isotopes[j] - Z * 10000 - I * 1000;
             chains_file << Z << ',' << A << ',' << I << ',';
             cout.precision(5);
-            chains_file << data.get_energy(chains[i][j]) << ',' << chains_dcs[i][j] << ',' << chains_brs[i][j]
+            chains_file << data->get_energy(chains.isotopes[j]) << ',' << chains.dcs[j] << ',' << chains.brs[j]
                         << '\n' << scientific;
         }
         chains_file << "---------" << '\n';
@@ -395,9 +697,10 @@ void chains_data::save_chains(string chains_out) {
  *
  * @param stems_out String filename of output.
  */
-void chains_data::save_stems(string stems_out) {
+void chains_data::save_stems(string stems_out) const {
     ofstream stems_file;
     stems_file.open(stems_out);
+    vector<int> products = set->products;
     sort(products.begin(), products.end());
 
     for (int product : products) {
@@ -405,13 +708,14 @@ void chains_data::save_stems(string stems_out) {
         int I = (product - Z * 10000) / 1000;
         int A = product - Z * 10000 - I * 1000;
         stems_file << Z << ' ' << A << ' ' << I << " -->" << '\n';
-        for (int j = 0; j < stems[product].size(); ++j) {
-            for (int k = 0; k < stems[product][j].size(); ++k) {
-                Z = stems[product][j][k] / 10000;
-                I = (stems[product][j][k] - Z * 10000) / 1000;
-                A = stems[product][j][k] - Z * 10000 - I * 1000;
-                double BR = stems_brs[product][j][k];
-                double DC = stems_dcs[product][j][k];
+        for (int end : set->stems.stems_of(product)) {
+            for (int node : stem_nodes(end)) {
+                int iZA = set->stems.isotopes[node];
+                Z = iZA / 10000;
+                I = (iZA - Z * 10000) / 1000;
+                A = iZA - Z * 10000 - I * 1000;
+                double BR = node_brs[node];
+                double DC = node_dcs[node];
                 stems_file << "   " << Z << ',' << A << ',' << I << ',' << DC << ',' << BR << '\n';
             }
             stems_file << "---" << '\n';
@@ -421,22 +725,113 @@ void chains_data::save_stems(string stems_out) {
     stems_file.close();
 }
 
-/** Updates stem decay constants and branching ratios given a new species_data object.
+/** Updates stem decay constants and branching ratios given a new species_data object. NEW_DATA must share
+ * its isotope IDs with the data the chains were built from, as a gaussian_sample of it does.
  *
  * @param new_data
  * @return
  */
-void chains_data::update_stems(species_data new_data) {
+void chains_data::update_stems(shared_ptr<const species_data> new_data) {
     data = new_data;
-    for (int product : products) {
-        for (int j = 0; j < stems[product].size(); ++j) {
-            for (int k = 0; k < stems[product][j].size(); ++k) {
-                stems_dcs[product][j][k] = data.get_DC(stems[product][j][k]);
-            }
-            for (int k = 0; k < stems[product][j].size() - 1; ++k) {
-                stems_brs[product][j][k + 1] = data.find_decay_branching(stems[product][j][k],
-                                                                             stems[product][j][k + 1]);
-            }
+    const stem_trie &stems = set->stems;
+    for (int node = 0; node < stems.size(); ++node) {
+        node_dcs[node] = data->get_DC(stems.isotopes[node]);
+        if (stems.parents[node] != -1) {
+            node_brs[node] = data->find_decay_branching(stems.isotopes[stems.parents[node]], stems.isotopes[node]);
         }
     }
-}
\ No newline at end of file
+    compute_coefficients();
+}
+
+/** Identifies FIER decay chains cache files.*/
+static const char CHAINS_CACHE_MAGIC[8] = {'F', 'I', 'E', 'R', 'C', 'H', 'N', '\0'};
+/** Layout version of the decay chains cache. Increment whenever the layout written by save_cache changes.*/
+static const uint32_t CHAINS_CACHE_VERSION = 1;
+
+/** Saves the chains, stems and removed decay modes to a binary cache file, with the species_data::chains_hash of
+ * the data they were built from. Every array is written as it is held in memory; the stem trie is written as the
+ * isotope and parent of each node, from which the rest of it follows.
+ *
+ * @param cache_filename String name of the cache file.
+ * @return TRUE if the cache was written.
+ */
+bool chains_data::save_cache(string cache_filename) const {
+    string payload;
+    cache_write(payload, data->chains_hash());
+    cache_write_vector(payload, removed_decays);
+    cache_write_vector(payload, set->products);
+    cache_write_vector(payload, set->chains.offsets);
+    cache_write_vector(payload, set->chains.isotopes);
+    cache_write_vector(payload, set->chains.dcs);
+    cache_write_vector(payload, set->chains.brs);
+    cache_write_vector(payload, set->stems.isotopes);
+    cache_write_vector(payload, set->stems.parents);
+    cache_write_vector(payload, node_dcs);
+    cache_write_vector(payload, node_brs);
+    if (!write_cache_file(cache_filename, CHAINS_CACHE_MAGIC, CHAINS_CACHE_VERSION, payload)) {
+        cout << "ERROR: Cannot write decay chains cache file.\n";
+        return false;
+    }
+    return true;
+}
+
+/** Imports chains and stems from a binary cache file written by save_cache, in place of build_chains and
+ * extract_stems. The cache is rejected if it was built from data with a different species_data::chains_hash, has a
+ * different layout version, fails its hash or holds inconsistent offsets. Nothing is imported when the cache is
+ * rejected. Warnings written while the chains were built are not repeated.
+ *
+ * @param cache_filename String name of the cache file.
+ * @return TRUE if the cache was loaded, FALSE if it is missing, stale or invalid.
+ */
+bool chains_data::import_cache(string cache_filename) {
+    mapped_file cache_file;
+    cache_reader reader;
+    if (!open_cache_file(cache_file, cache_filename, CHAINS_CACHE_MAGIC, CHAINS_CACHE_VERSION, reader) ||
+        reader.read<uint64_t>() != data->chains_hash()) {
+        return false;
+    }
+
+    auto cached = make_shared<chain_set>(*set);
+    vector<char> cached_removed;
+    vector<double> cached_dcs;
+    vector<double> cached_brs;
+    reader.read_vector(cached_removed);
+    reader.read_vector(cached->products);
+    reader.read_vector(cached->chains.offsets);
+    reader.read_vector(cached->chains.isotopes);
+    reader.read_vector(cached->chains.dcs);
+    reader.read_vector(cached->chains.brs);
+    reader.read_vector(cached->stems.isotopes);
+    reader.read_vector(cached->stems.parents);
+    reader.read_vector(cached_dcs);
+    reader.read_vector(cached_brs);
+    if (!reader.ok || reader.pos != reader.end) {
+        return false;
+    }
+
+    // check that every offset and parent is in range before anything indexes with them
+    const chain_pool &chains = cached->chains;
+    stem_trie &stems = cached->stems;
+    size_t n_entries = chains.isotopes.size();
+    bool valid = cached_removed.size() == data->n_isotopes() && !chains.offsets.empty() && chains.offsets[0] == 0 &&
+                 chains.offsets.back() == n_entries && chains.dcs.size() == n_entries &&
+                 chains.brs.size() == n_entries && stems.parents.size() == stems.isotopes.size() &&
+                 cached_dcs.size() == stems.isotopes.size() && cached_brs.size() == stems.isotopes.size();
+    for (int i = 0; valid && i < chains.size(); ++i) {
+        valid = chains.offsets[i] <= chains.offsets[i + 1];
+    }
+    for (int node = 0; valid && node < stems.size(); ++node) {
+        valid = stems.parents[node] >= -1 && stems.parents[node] < node;
+    }
+    if (!valid) {
+        return false;
+    }
+    link_stems(stems);
+
+    removed_decays = move(cached_removed);
+    node_dcs = move(cached_dcs);
+    node_brs = move(cached_brs);
+    set = cached;
+    compute_coefficients();
+    return true;
+}
@@ -3,55 +3,239 @@
 
 #include "species_data.h"
 #include "helper_functions.h"
+#include "bateman_kernels.h"
 /** Creates and holds decay chains from known decay fragments. Decay fragments are the initial products of the sample's decay.
  * Decay chains are the series of species the fragments transmute through until they become stable.
  */
 class chains_data {
-    /** Data pulled from files, packed as a species_data object.*/
-    species_data data;
-    /** List of decay fragments*/
-    vector<int> fragments;
-    /** List of decay products*/
-    vector<int> products;
-    /** List of all decay chains (chains are a list).*/
-    vector <vector<int>> chains;
-    /** List of decay chain decay constants*/
-    vector <vector<double>> chains_dcs;
-    /** List of chain brancing ratios*/
-    vector <vector<double>> chains_brs;
-    /** Map of decay stems (vector<vector<int>>) with isotopes (int)*/
-    map<int, vector<vector < int> > > stems;
-    /** Map of decay stem decay constants*/
-    map<int, vector<vector < double> > > stems_dcs;
-    /** Map of decay stem branching ratios*/
-    map<int, vector<vector < double> > > stems_brs;
-
 public:
+    /** Decay stems stored as a trie, one tree per first isotope. Each node is a stem: the isotopes on the path from
+     * its root to it. Stems sharing a prefix share the nodes of that prefix, and a parent is always numbered before
+     * its children.
+     */
+    struct stem_trie {
+        /** Last isotope (IZA) of each node.*/
+        vector<int> isotopes;
+        /** Parent of each node, -1 for roots.*/
+        vector<int> parents;
+        /** Number of isotopes in the stem of each node.*/
+        vector<int> lengths;
+        /** First child of each node, -1 if it has none.*/
+        vector<int> first_child;
+        /** Next child of the parent of each node, -1 for the last child and for roots.*/
+        vector<int> next_sibling;
+        /** Root nodes, in the order they were added.*/
+        vector<int> roots;
+        /** Root of the tree of each node.*/
+        vector<int> root_of;
+        /** The stem of each node has one entry per isotope in the stem pools of chains_data, from OFFSETS[NODE]
+         * to OFFSETS[NODE] + LENGTHS[NODE] - 1.
+         */
+        vector<int> offsets = vector<int>(1, 0);
+        /** Isotopes (IZA) with stems, in increasing order.*/
+        vector<int> end_isotopes;
+        /** Stems of END_ISOTOPES[I] are END_NODES[END_OFFSETS[I]] to END_NODES[END_OFFSETS[I + 1] - 1].*/
+        vector<int> end_offsets = vector<int>(1, 0);
+        /** Nodes grouped by last isotope, each group in the order the nodes were added.*/
+        vector<int> end_nodes;
+        /** Length of the longest stem.*/
+        int max_length = 0;
+
+        /** @return Number of nodes.*/
+        int size() const { return static_cast<int>(isotopes.size()); }
+
+        /** @return Nodes whose stems end in isotope IZA, in the order they were added.*/
+        array_view<int> stems_of(int iZA) const {
+            auto it = lower_bound(end_isotopes.begin(), end_isotopes.end(), iZA);
+            if (it == end_isotopes.end() || *it != iZA) {
+                return array_view<int>();
+            }
+            size_t i = it - end_isotopes.begin();
+            return array_view<int>(end_nodes.data() + end_offsets[i], end_offsets[i + 1] - end_offsets[i]);
+        }
+
+        /** Steps through the tree of ROOT depth first, children in the order they were added.
+         *
+         * @param node Current node, in the tree of ROOT.
+         * @param root Root of the tree being walked.
+         * @return The node after NODE, or -1 once the tree is done.
+         */
+        int next(int node, int root) const {
+            if (first_child[node] != -1) {
+                return first_child[node];
+            }
+            while (node != root) {
+                if (next_sibling[node] != -1) {
+                    return next_sibling[node];
+                }
+                node = parents[node];
+            }
+            return -1;
+        }
+    };
+
+private:
+    /** Decay chains stored back to back in one array per field. Chain I is entries OFFSETS[I] to OFFSETS[I + 1] - 1.*/
+    struct chain_pool {
+        vector<int> offsets = vector<int>(1, 0);
+        /** Isotope (IZA) of each entry.*/
+        vector<int> isotopes;
+        /** Decay constant of each entry.*/
+        vector<double> dcs;
+        /** Branching ratio into each entry.*/
+        vector<double> brs;
+
+        /** @return Number of chains.*/
+        int size() const { return static_cast<int>(offsets.size()) - 1; }
+        /** @return First entry of chain I.*/
+        int begin(int i) const { return offsets[i]; }
+        /** @return Number of isotopes in chain I.*/
+        int length(int i) const { return offsets[i + 1] - offsets[i]; }
+
+        /** Adds an isotope to the end of the last chain.*/
+        void push(int iZA, double dc, double br) {
+            isotopes.push_back(iZA);
+            dcs.push_back(dc);
+            brs.push_back(br);
+        }
+        /** Ends the last chain.*/
+        void close() { offsets.push_back(static_cast<int>(isotopes.size())); }
+    };
 
-    void import_species_data(species_data data_in);
-    bool unstable(vector <vector<int>> chains);
+    /** Decay chains and stems of every product. Built once by build_chains and extract_stems, then shared by
+     * every copy of the chains_data.
+     */
+    struct chain_set {
+        /** List of decay fragments*/
+        vector<int> fragments;
+        /** List of decay products*/
+        vector<int> products;
+        /** All decay chains, with their decay constants and branching ratios.*/
+        chain_pool chains;
+        /** Decay stems of every product, as a trie of shared prefixes.*/
+        stem_trie stems;
+    };
+    /** Data pulled from files, shared with the other classes.*/
+    shared_ptr<const species_data> data;
+    /** 1 for isotope IDs whose decay modes were removed while building chains, 0 otherwise.*/
+    vector<char> removed_decays;
+    /** Chains and stems, shared between copies.*/
+    shared_ptr<const chain_set> set = make_shared<chain_set>();
+    /** Decay constant of the last isotope of each stem trie node.*/
+    vector<double> node_dcs;
+    /** Branching ratio into the last isotope of each stem trie node.*/
+    vector<double> node_brs;
+    /** Decay constants of every stem, pooled as given by stem_trie::offsets.*/
+    vector<double> stem_dcs;
+    /** Distinct decay constants of all stems, in the order they are first met in the trie.*/
+    vector<double> rate_dcs;
+    /** Index in RATE_DCS of the decay constant of every stem entry, pooled as given by stem_trie::offsets.*/
+    vector<int> stem_rates;
+    /** Bateman coefficients of every stem, pooled as given by stem_trie::offsets. Entry J of a stem of length N is
+     * the product of the branching ratios and decay constants leading to its last isotope, over the product of
+     * (DC[K] - DC[J]) for every other K, so that a population N0 of the first isotope decays to
+     * N0 * sum(COEF[J] * exp(-DC[J] * t)) of the last.
+     */
+    vector<double> stem_coefs;
 
-    void build_chains(string error_file);
+    /** Decay graph walked by build_chains. Between branchings a chain follows first daughters, so the first-daughter
+     * sub-chain of each isotope is built once and shared by every chain that reaches it.
+     */
+    struct decay_graph {
+        /** 1 for isotope IDs on a decay cycle, or whose later daughters repeat their first, 0 otherwise. Only these
+         * can close a chain on itself.
+         */
+        vector<char> cyclic;
+        /** 1 for isotope IDs that decay, directly or through daughters, to a CYCLIC isotope, 0 otherwise. Only chains
+         * from these can remove decay modes, so only these are built in order.
+         */
+        vector<char> reaches_cycle;
+        /** First-daughter sub-chain (isotope IDs) of each isotope ID.*/
+        vector<vector<int>> sub_chains;
+    };
+    /** Chain of build_chains: the first PREFIX isotopes of chain PARENT, then the first LENGTH isotopes of the
+     * sub-chain of START, which PARENT decays to with branching ratio BR.
+     */
+    struct chain_slot {
+        int parent;
+        int prefix;
+        int start;
+        double br;
+        int length;
+    };
+    /** Chains built from one isotope by add_species_chains, kept apart until they are appended in order.*/
+    struct species_chains {
+        chain_pool chains;
+        /** Isotope IDs reached as daughters, in the order they were first reached.*/
+        vector<int> reached;
+    };
+
+    int n_decays_id(int id) const;
+    decay_graph build_decay_graph() const;
+    bool in_chain(const decay_graph &graph, const vector<chain_slot> &slots, int s, int id) const;
+    void add_species_chains(int root_id, const decay_graph &graph, species_chains &out, vector<char> &marks,
+                            const string &error_file);
+    void add_all_species_chains(const vector<int> &root_ids, const decay_graph &graph, vector<species_chains> &out,
+                                const string &error_file, int n_threads);
+    vector<int> stem_nodes(int node) const;
+    static void link_stems(stem_trie &stems);
+    void compute_coefficients();
+
+public:
+    void import_species_data(shared_ptr<const species_data> data_in);
+
+    void build_chains(string error_file, int n_threads = 0);
     void extract_stems();
 
-    vector<vector<int>> get_stems(int iZA);
-    vector<int> get_stems_index(int iZA, int i);
+    /** @return Trie of all stems.*/
+    const stem_trie &get_stem_trie() const { return set->stems; }
+    /** @return Decay constant of the last isotope of each stem trie node.*/
+    const vector<double> &get_node_dcs() const { return node_dcs; }
+    /** @return Branching ratio into the last isotope of each stem trie node.*/
+    const vector<double> &get_node_brs() const { return node_brs; }
+    /** @return Decay constants of the stem of trie node NODE, first isotope first.*/
+    array_view<double> get_stem_dcs(int node) const {
+        return array_view<double>(stem_dcs.data() + set->stems.offsets[node], set->stems.lengths[node]);
+    }
+    /** @return Distinct decay constants of all stems. Functions of a decay constant shared by many stems, such as
+     * exp(-DC * dt), only need to be evaluated once for each of these.
+     */
+    const vector<double> &get_rate_dcs() const { return rate_dcs; }
+    /** @return Index in get_rate_dcs() of each decay constant of the stem of trie node NODE.*/
+    array_view<int> get_stem_rates(int node) const {
+        return array_view<int>(stem_rates.data() + set->stems.offsets[node], set->stems.lengths[node]);
+    }
+    /** @return Pooled coefficients, decay constants and rate indices of all stems, for the Bateman kernels.*/
+    stem_arrays get_stem_arrays() const {
+        return {stem_coefs.data(), stem_dcs.data(), stem_rates.data(), set->stems.offsets.data(),
+                set->stems.lengths.data()};
+    }
+    /** @return Bateman coefficients of the stem of trie node NODE.*/
+    array_view<double> get_stem_coefs(int node) const {
+        return array_view<double>(stem_coefs.data() + set->stems.offsets[node], set->stems.lengths[node]);
+    }
+
+    vector<vector<int>> get_stems(int iZA) const;
+    vector<int> get_stems_index(int iZA, int i) const;
+
+    int n_stems(int iZA) const;
 
-    int n_stems(int iZA);
+    vector<vector<double>> get_stems_dcs(int iZA) const;
+    vector<double> get_stems_dcs_index(int iZA, int i) const;
 
-    vector<vector<double>> get_stems_dcs(int iZA);
-    vector<double> get_stems_dcs_index(int iZA, int i);
+    vector<vector<double>> get_stems_brs(int iZA) const;
+    vector<double> get_stems_brs_index(int iZA, int i) const;
 
-    vector<vector<double>> get_stems_brs(int iZA);
-    vector<double> get_stems_brs_index(int iZA, int i);
+    vector<int> get_products() const;
 
-    vector<int> get_products();
+    void print_chains() const;
 
-    void print_chains();
+    void save_chains(string chains_out) const;
+    void save_stems(string stems_out) const;
+    void update_stems(shared_ptr<const species_data> new_data);
 
-    void save_chains(string chains_out);
-    void save_stems(string stems_out);
-    void update_stems(species_data new_data);
+    bool save_cache(string cache_filename) const;
+    bool import_cache(string cache_filename);
 };
 
 
@@ -0,0 +1,254 @@
+/**@file cram_solver.cpp
+ *
+ * Matrix exponential solver of the decay equations, with the order 16 CRAM coefficients of M. Pusa, "Higher-Order
+ * Chebyshev Rational Approximation Method and Application to Burnup Equations", Nucl. Sci. Eng. 182 (2016).
+ *
+ */
+
+#include "cram_solver.h"
+
+/** Number of conjugate pole pairs of the order 16 approximation.*/
+static const int CRAM_POLES = 8;
+
+/** Limit of the approximation at infinity, which scales the product of the incomplete partial fraction form.*/
+static const double CRAM_ALPHA0 = 2.124853710495224e-16;
+
+/** Residues of the incomplete partial fraction form.*/
+static const complex<double> CRAM_ALPHA[CRAM_POLES] = {
+        {+5.464930576870210e+3, -3.797983575308356e+4},
+        {+9.045112476907548e+1, -1.115537522430261e+3},
+        {+2.344818070467641e+2, -4.228020157070496e+2},
+        {+9.453304067358312e+1, -2.951294291446048e+2},
+        {+7.283792954673409e+2, -1.205646080220011e+5},
+        {+3.648229059594851e+1, -1.155509621409682e+2},
+        {+2.547321630156819e+1, -2.639500283021502e+1},
+        {+2.394538338734709e+1, -5.650522971778156e+0}};
+
+/** Poles of the incomplete partial fraction form, one of each conjugate pair.*/
+static const complex<double> CRAM_THETA[CRAM_POLES] = {
+        {+3.509103608414918, +8.436198985884374},
+        {+5.948152268951177, +3.587457362018322},
+        {-5.264971343442647, +16.22022147316793},
+        {+1.419375897185666, +10.92536348449672},
+        {+6.416177699099435, +1.194122393370139},
+        {+4.993174737717997, +5.996881713603942},
+        {-1.413928462488886, +13.49772569889275},
+        {-10.84391707869699, +19.27744616718165}};
+
+/** Builds the decay matrix of DATA_IN. A decay of an isotope to itself is dropped, as build_chains drops it.
+ *
+ * @param data_in Species data, shared with the other classes.
+ */
+cram_solver::cram_solver(shared_ptr<const species_data> data_in) : data(move(data_in)) {
+    order_rows();
+    int n = n_rows();
+    row_dcs.resize(n);
+    feed_offsets.assign(n + 1, 0);
+    for (int row = 0; row < n; ++row) {
+        int id = row_ids[row];
+        row_dcs[row] = data->get_DC_id(id);
+        for (int k = 0; k < data->n_decays_id(id); ++k) {
+            if (data->get_decay_daughter_id(id, k) != id) {
+                ++feed_offsets[id_rows[data->get_decay_daughter_id(id, k)] + 1];
+            }
+        }
+    }
+    for (int row = 0; row < n; ++row) {
+        feed_offsets[row + 1] += feed_offsets[row];
+    }
+    feed_rows.resize(feed_offsets[n]);
+    feed_rates.resize(feed_offsets[n]);
+    vector<int> filled(feed_offsets.begin(), feed_offsets.end() - 1);
+    for (int row = 0; row < n; ++row) {
+        int id = row_ids[row];
+        for (int k = 0; k < data->n_decays_id(id); ++k) {
+            int daughter_id = data->get_decay_daughter_id(id, k);
+            if (daughter_id != id) {
+                int entry = filled[id_rows[daughter_id]]++;
+                feed_rows[entry] = row;
+                feed_rates[entry] = data->get_decay_branching_id(id, k) * row_dcs[row];
+            }
+        }
+    }
+}
+
+/** Orders the isotopes parents first into ROW_IDS, ID_ROWS and BLOCK_STARTS. The strongly connected components of
+ * the decay graph (Tarjan's algorithm) come out daughters first, so they are numbered from the last row back.
+ */
+void cram_solver::order_rows() {
+    int n = data->n_isotopes();
+    row_ids.assign(n, -1);
+    id_rows.assign(n, -1);
+    vector<int> index(n, -1);
+    vector<int> low(n, 0);
+    vector<char> on_stack(n, 0);
+    vector<int> stack;
+    vector<pair<int, int>> calls; // isotope ID and next decay mode to follow
+    vector<int> block_ends;
+    int counter = 0;
+    int next_row = n;
+    for (int root = 0; root < n; ++root) {
+        if (index[root] >= 0) {
+            continue;
+        }
+        index[root] = low[root] = counter++;
+        stack.push_back(root);
+        on_stack[root] = 1;
+        calls.emplace_back(root, 0);
+        while (!calls.empty()) {
+            int id = calls.back().first;
+            int k = calls.back().second;
+            if (k < data->n_decays_id(id)) {
+                calls.back().second = k + 1;
+                int daughter_id = data->get_decay_daughter_id(id, k);
+                if (index[daughter_id] < 0) {
+                    index[daughter_id] = low[daughter_id] = counter++;
+                    stack.push_back(daughter_id);
+                    on_stack[daughter_id] = 1;
+                    calls.emplace_back(daughter_id, 0);
+                } else if (on_stack[daughter_id]) {
+                    low[id] = min(low[id], index[daughter_id]);
+                }
+            } else {
+                calls.pop_back();
+                if (!calls.empty()) {
+                    low[calls.back().first] = min(low[calls.back().first], low[id]);
+                }
+                if (low[id] == index[id]) {
+                    // the component of ID takes the rows before those of every component it decays to
+                    auto first = static_cast<int>(stack.size()) - 1;
+                    while (stack[first] != id) {
+                        --first;
+                    }
+                    block_ends.push_back(next_row);
+                    for (auto i = static_cast<size_t>(first); i < stack.size(); ++i) {
+                        on_stack[stack[i]] = 0;
+                        --next_row;
+                        row_ids[next_row] = stack[i];
+                        id_rows[stack[i]] = next_row;
+                    }
+                    stack.resize(first);
+                }
+            }
+        }
+    }
+    block_starts.assign(1, 0);
+    for (auto end = block_ends.rbegin(); end != block_ends.rend(); ++end) {
+        block_starts.push_back(*end);
+    }
+}
+
+/** Solves (A * DT - THETA) Z = B one block of rows at a time, parents first. A block of one row is a division; the
+ * rows of a decay cycle are solved together by Gaussian elimination with partial pivoting.
+ *
+ * @param dt Time step (seconds).
+ * @param theta Pole of the approximation.
+ * @param b Right hand side, by row.
+ * @param z Solution, by row.
+ */
+void cram_solver::solve(double dt, complex<double> theta, const vector<complex<double>> &b,
+                        vector<complex<double>> &z) const {
+    z.resize(b.size());
+    for (size_t block = 0; block + 1 < block_starts.size(); ++block) {
+        int first = block_starts[block];
+        int m = block_starts[block + 1] - first;
+        if (m == 1) {
+            complex<double> acc = b[first];
+            for (int j = feed_offsets[first]; j < feed_offsets[first + 1]; ++j) {
+                acc -= feed_rates[j] * dt * z[feed_rows[j]];
+            }
+            z[first] = acc / (-1.0 * row_dcs[first] * dt - theta);
+            continue;
+        }
+        vector<complex<double>> M(static_cast<size_t>(m) * m, 0.0);
+        vector<complex<double>> rhs(m);
+        for (int i = 0; i < m; ++i) {
+            int row = first + i;
+            rhs[i] = b[row];
+            M[i * m + i] = -1.0 * row_dcs[row] * dt - theta;
+            for (int j = feed_offsets[row]; j < feed_offsets[row + 1]; ++j) {
+                if (feed_rows[j] >= first) {
+                    M[i * m + feed_rows[j] - first] += feed_rates[j] * dt;
+                } else {
+                    rhs[i] -= feed_rates[j] * dt * z[feed_rows[j]];
+                }
+            }
+        }
+        for (int col = 0; col < m; ++col) {
+            int pivot = col;
+            for (int i = col + 1; i < m; ++i) {
+                if (abs(M[i * m + col]) > abs(M[pivot * m + col])) {
+                    pivot = i;
+                }
+            }
+            if (pivot != col) {
+                swap_ranges(M.begin() + pivot * m, M.begin() + (pivot + 1) * m, M.begin() + col * m);
+                swap(rhs[pivot], rhs[col]);
+            }
+            for (int i = col + 1; i < m; ++i) {
+                complex<double> factor = M[i * m + col] / M[col * m + col];
+                for (int j = col; j < m; ++j) {
+                    M[i * m + j] -= factor * M[col * m + j];
+                }
+                rhs[i] -= factor * rhs[col];
+            }
+        }
+        for (int i = m - 1; i >= 0; --i) {
+            complex<double> acc = rhs[i];
+            for (int j = i + 1; j < m; ++j) {
+                acc -= M[i * m + j] * z[first + j];
+            }
+            z[first + i] = acc / M[i * m + i];
+        }
+    }
+}
+
+/** Advances populations over a time step with a production rate that changes linearly. The production rate is
+ * carried as two more isotopes, one that holds a population of 1 and feeds isotope I at SOURCE[I], and one that grows
+ * as the time from the start and feeds it at RAMP[I], so the step is still one matrix exponential. In each solve the
+ * first only adds SOURCE * DT * Y_SOURCE / THETA to the right hand side, and the second RAMP * DT times its own
+ * solution (DT * Z_SOURCE - Y_RAMP) / THETA.
+ *
+ * @param n0 Population of each isotope ID at the start of the step.
+ * @param source Production rate of each isotope ID at the start of the step (per second), or empty for none.
+ * @param dt Time step (seconds).
+ * @param ramp Rate of increase of the production rate of each isotope ID (per second squared), or empty for none.
+ * @return Population of each isotope ID at the end of the step.
+ */
+vector<double> cram_solver::advance(const vector<double> &n0, const vector<double> &source, double dt,
+                                    const vector<double> &ramp) const {
+    int n = n_rows();
+    vector<double> y(n);
+    for (int row = 0; row < n; ++row) {
+        y[row] = n0[row_ids[row]];
+    }
+    double y_source = 1.0;
+    double y_ramp = 0.0;
+    vector<complex<double>> b(n), z(n);
+    for (int k = 0; k < CRAM_POLES; ++k) {
+        complex<double> theta = CRAM_THETA[k];
+        complex<double> z_source = -1.0 * y_source / theta;
+        complex<double> z_ramp = (dt * z_source - y_ramp) / theta;
+        for (int row = 0; row < n; ++row) {
+            b[row] = y[row];
+            if (!source.empty()) {
+                b[row] += source[row_ids[row]] * dt * y_source / theta;
+            }
+            if (!ramp.empty()) {
+                b[row] -= ramp[row_ids[row]] * dt * z_ramp;
+            }
+        }
+        solve(dt, theta, b, z);
+        for (int row = 0; row < n; ++row) {
+            y[row] = y[row] + 2.0 * real(CRAM_ALPHA[k] * z[row]);
+        }
+        y_source = y_source + 2.0 * real(CRAM_ALPHA[k] * z_source);
+        y_ramp = y_ramp + 2.0 * real(CRAM_ALPHA[k] * z_ramp);
+    }
+
+    vector<double> res(n);
+    for (int row = 0; row < n; ++row) {
+        res[row_ids[row]] = CRAM_ALPHA0 * y[row];
+    }
+    return res;
+}
@@ -0,0 +1,47 @@
+#ifndef FIER_CRAM_SOLVER_H
+#define FIER_CRAM_SOLVER_H
+
+
+#include "species_data.h"
+#include <complex> // for the poles of the rational approximation
+
+/** Second solver of FIER, which advances the population of every isotope of a species_data at once instead of
+ * summing Bateman solutions over decay stems. The decay matrix A has -DC[I] on its diagonal and BR * DC[P] from each
+ * parent P of isotope I, and populations advance as exp(A * dt) N0, found with the order 16 Chebyshev Rational
+ * Approximation Method (CRAM) in its incomplete partial fraction form. Each of the 8 poles takes one solve of
+ * (A * dt - THETA) z = b, which is block lower triangular once the isotopes are ordered parents first, so no decay
+ * constants need perturbing and decay cycles are solved as they are.
+ */
+class cram_solver {
+    /** Species data the matrix was built from, shared with the other classes.*/
+    shared_ptr<const species_data> data;
+    /** Isotope ID of each row, parents before daughters. Isotopes on a decay cycle are in consecutive rows.*/
+    vector<int> row_ids;
+    /** Row of each isotope ID.*/
+    vector<int> id_rows;
+    /** First row of each block of rows that decay into each other, and the end of the last block.*/
+    vector<int> block_starts;
+    /** Decay constant of each row.*/
+    vector<double> row_dcs;
+    /** First entry of each row in FEED_ROWS and FEED_RATES, and the end of the last row.*/
+    vector<int> feed_offsets;
+    /** Parent row of each entry.*/
+    vector<int> feed_rows;
+    /** BR * DC of the parent of each entry, the rate at which it feeds its row.*/
+    vector<double> feed_rates;
+
+    void order_rows();
+    void solve(double dt, complex<double> theta, const vector<complex<double>> &b, vector<complex<double>> &z) const;
+
+public:
+    explicit cram_solver(shared_ptr<const species_data> data_in);
+
+    /** @return Number of isotopes.*/
+    int n_rows() const { return static_cast<int>(row_ids.size()); }
+
+    vector<double> advance(const vector<double> &n0, const vector<double> &source, double dt,
+                           const vector<double> &ramp = {}) const;
+};
+
+
+#endif //FIER_CRAM_SOLVER_H
@@ -0,0 +1,344 @@
+/**@file expsum_solver.cpp
+ *
+ * Sums of exponentials solver of the decay equations, propagated down the decay graph parents first.
+ *
+ */
+
+#include "expsum_solver.h"
+
+/** Relative step a decay constant that repeats one of an ancestor is moved by, as build_chains moves those that
+ * repeat in a chain.
+ */
+static const double REPEAT_DC_DELTA = 0.0001;
+
+/** Builds the decay graph the stems of CHAINS span and the terms each of its isotopes carries.
+ *
+ * @param data_in Species data, shared with the other classes.
+ * @param chains Chains data with stems extracted from DATA_IN or from data with the same isotope IDs.
+ */
+expsum_solver::expsum_solver(shared_ptr<const species_data> data_in, const chains_data &chains)
+        : data(move(data_in)) {
+    vector<vector<pair<int, double>>> parents;
+    order_rows(chains, parents);
+    build_terms(parents);
+}
+
+/** Finds the parent of each isotope along the stems of CHAINS, and orders the isotopes parents first into ROW_IDS
+ * and ID_ROWS (Kahn's algorithm), in the order of chains_data::get_products where the graph leaves a choice.
+ *
+ * @param chains Chains data with stems extracted.
+ * @param parents Isotope ID and branching ratio of each parent, by isotope ID.
+ */
+void expsum_solver::order_rows(const chains_data &chains, vector<vector<pair<int, double>>> &parents) {
+    const chains_data::stem_trie &trie = chains.get_stem_trie();
+    const vector<double> &node_brs = chains.get_node_brs();
+    int n = data->n_isotopes();
+    parents.assign(n, vector<pair<int, double>>());
+    vector<int> n_waiting(n, 0);
+    vector<vector<int>> daughters(n);
+    for (int node = 0; node < trie.size(); ++node) {
+        if (trie.parents[node] == -1) {
+            continue;
+        }
+        int parent_id = data->get_id(trie.isotopes[trie.parents[node]]);
+        int id = data->get_id(trie.isotopes[node]);
+        bool found = false;
+        for (auto &parent : parents[id]) {
+            found = found || parent.first == parent_id;
+        }
+        if (!found) {
+            parents[id].emplace_back(parent_id, node_brs[node]);
+            daughters[parent_id].push_back(id);
+            ++n_waiting[id];
+        }
+    }
+
+    id_rows.assign(n, -1);
+    row_ids.clear();
+    vector<int> ready;
+    for (int product : chains.get_products()) {
+        int id = data->get_id(product);
+        if (n_waiting[id] == 0) {
+            ready.push_back(id);
+        }
+    }
+    for (size_t i = 0; i < ready.size(); ++i) {
+        int id = ready[i];
+        id_rows[id] = static_cast<int>(row_ids.size());
+        row_ids.push_back(id);
+        for (int daughter_id : daughters[id]) {
+            if (--n_waiting[daughter_id] == 0) {
+                ready.push_back(daughter_id);
+            }
+        }
+    }
+    // isotopes left on a decay cycle follow in product order, without the feeds that close the cycle
+    for (int product : chains.get_products()) {
+        int id = data->get_id(product);
+        if (id_rows[id] == -1) {
+            id_rows[id] = static_cast<int>(row_ids.size());
+            row_ids.push_back(id);
+        }
+    }
+}
+
+/** Fills the feeds and terms of every row. A row carries the terms of every parent before it, a term for 0.0 and one
+ * for its own decay constant, which is perturbed while it equals the decay constant of another of its terms.
+ *
+ * @param parents Isotope ID and branching ratio of each parent, by isotope ID.
+ */
+void expsum_solver::build_terms(const vector<vector<pair<int, double>>> &parents) {
+    int n = n_rows();
+    unordered_map<double, int> rate_index;
+    rate_dcs.assign(1, 0.0);
+    rate_index.emplace(0.0, 0);
+    row_dcs.resize(n);
+    own_terms.resize(n);
+    feed_offsets.assign(1, 0);
+    feed_rows.clear();
+    feed_rates.clear();
+    feed_maps.clear();
+    term_maps.clear();
+    term_offsets.assign(1, 0);
+    term_rates.clear();
+    vector<int> rates;
+    for (int row = 0; row < n; ++row) {
+        int id = row_ids[row];
+        rates.assign(1, 0);
+        for (auto &parent : parents[id]) {
+            int parent_row = id_rows[parent.first];
+            if (parent_row >= 0 && parent_row < row) {
+                rates.insert(rates.end(), term_rates.begin() + term_offsets[parent_row],
+                             term_rates.begin() + term_offsets[parent_row + 1]);
+            }
+        }
+        sort(rates.begin(), rates.end());
+        rates.erase(unique(rates.begin(), rates.end()), rates.end());
+
+        double dc = data->get_DC_id(id);
+        double step = 1.0;
+        int rate = 0;
+        while (dc != 0.0) {
+            double moved = dc * (1.0 + (step - 1.0) * REPEAT_DC_DELTA);
+            auto found = rate_index.emplace(moved, static_cast<int>(rate_dcs.size()));
+            if (found.second) {
+                rate_dcs.push_back(moved);
+            }
+            rate = found.first->second;
+            if (!binary_search(rates.begin(), rates.end(), rate)) {
+                dc = moved;
+                break;
+            }
+            step = step + 1.0;
+        }
+        row_dcs[row] = dc;
+        rates.insert(lower_bound(rates.begin(), rates.end(), rate), rate);
+        rates.erase(unique(rates.begin(), rates.end()), rates.end());
+        int first = term_offsets[row];
+        own_terms[row] = static_cast<int>(lower_bound(rates.begin(), rates.end(), rate) - rates.begin());
+        term_rates.insert(term_rates.end(), rates.begin(), rates.end());
+        term_offsets.push_back(first + static_cast<int>(rates.size()));
+
+        for (auto &parent : parents[id]) {
+            int parent_row = id_rows[parent.first];
+            if (parent_row < 0 || parent_row >= row) {
+                continue;
+            }
+            feed_rows.push_back(parent_row);
+            feed_rates.push_back(parent.second * row_dcs[parent_row]);
+            feed_maps.push_back(static_cast<int>(term_maps.size()));
+            for (int k = term_offsets[parent_row]; k < term_offsets[parent_row + 1]; ++k) {
+                term_maps.push_back(static_cast<int>(lower_bound(rates.begin(), rates.end(), term_rates[k]) -
+                                                     rates.begin()));
+            }
+        }
+        feed_offsets.push_back(static_cast<int>(feed_rows.size()));
+    }
+}
+
+/** Fills FACTORS with exp(-DC * DT) for each decay constant of RATE_DCS.
+ *
+ * @param dt Time (seconds).
+ * @param factors Table to fill.
+ */
+void expsum_solver::fill_factors(double dt, vector<double> &factors) const {
+    factors.resize(rate_dcs.size());
+    for (size_t i = 0; i < rate_dcs.size(); ++i) {
+        factors[i] = exp(-1.0 * rate_dcs[i] * dt);
+    }
+}
+
+/** Fills FACTORS with exp(-DC * DT) - 1 for each decay constant of RATE_DCS, the factors of the terms of an
+ * expansion with STARTS.
+ *
+ * @param dt Time (seconds).
+ * @param factors Table to fill.
+ */
+void expsum_solver::fill_rebased_factors(double dt, vector<double> &factors) const {
+    factors.resize(rate_dcs.size());
+    for (size_t i = 0; i < rate_dcs.size(); ++i) {
+        factors[i] = expm1(-1.0 * rate_dcs[i] * dt);
+    }
+}
+
+/** Fills WEIGHTS with the integral of exp(-DC * T) - 1 from 0.0 to DT, -(DC * DT - 1 + exp(-DC * DT)) / DC, for
+ * each decay constant of RATE_DCS. Where DC * DT is small the difference is taken from its series.
+ *
+ * @param dt Time (seconds).
+ * @param weights Table to fill.
+ */
+void expsum_solver::fill_rebased_weights(double dt, vector<double> &weights) const {
+    weights.resize(rate_dcs.size());
+    for (size_t i = 0; i < rate_dcs.size(); ++i) {
+        double x = rate_dcs[i] * dt;
+        double ramp = (x < 1.0e-3) ? x * x * (0.5 - x * (1.0 / 6.0 - x * (1.0 / 24.0 - x / 120.0)))
+                                   : x + expm1(-1.0 * x);
+        weights[i] = (rate_dcs[i] == 0.0) ? 0.0 : -1.0 * ramp / rate_dcs[i];
+    }
+}
+
+/** Expands the populations from N0 and a production rate that changes linearly into sums of exponentials, one row
+ * at a time, parents first. The inflow of a row is the sum over its feeds of the terms of the parent times the feed
+ * rate, and each term K of that inflow gives the row a term INFLOW[K] / (DC - DC[K]); its own term makes up N0. An
+ * inflow growing as T gives the row LIN = INFLOW_LIN / DC, less LIN / DC on its constant term. Isotopes with a decay
+ * constant of 0.0 are stable, and with a production rate so are those that exp(-DC * DT) leaves at or above
+ * STABLE_DECAY_FACTOR, as in the continuous production stem sums: they take a constant inflow as LIN and one
+ * growing as T as QUAD, and feed nothing.
+ *
+ * @param n0 Population of each isotope ID at the start, or empty for none.
+ * @param source Production rate of each isotope ID at the start (per second), or empty for none.
+ * @param dt Time step the production lasts (seconds).
+ * @param ramp Rate of increase of the production rate of each isotope ID (per second squared), or empty for none.
+ * @return Populations as sums of exponentials of the time from the start.
+ */
+expsum_solver::expansion expsum_solver::expand(const vector<double> &n0, const vector<double> &source, double dt,
+                                               const vector<double> &ramp) const {
+    int n = n_rows();
+    expansion sums;
+    sums.coefs.assign(term_rates.size(), 0.0);
+    sums.lins.assign(n, 0.0);
+    sums.quads.assign(n, 0.0);
+    bool produced = !source.empty() || !ramp.empty();
+    if (produced) {
+        sums.starts.assign(n, 0.0);
+    }
+    vector<char> held(n, 0);
+    for (int row = 0; row < n; ++row) {
+        int id = row_ids[row];
+        int first = term_offsets[row];
+        int n_terms = term_offsets[row + 1] - first;
+        double *coefs = sums.coefs.data() + first;
+        double inflow_lin = ramp.empty() ? 0.0 : ramp[id];
+        for (int j = feed_offsets[row]; j < feed_offsets[row + 1]; ++j) {
+            int parent_row = feed_rows[j];
+            if (held[parent_row]) {
+                continue;
+            }
+            const double *parent_coefs = sums.coefs.data() + term_offsets[parent_row];
+            const int *maps = term_maps.data() + feed_maps[j];
+            int n_parent_terms = term_offsets[parent_row + 1] - term_offsets[parent_row];
+            inflow_lin = inflow_lin + feed_rates[j] * sums.lins[parent_row];
+            for (int k = 0; k < n_parent_terms; ++k) {
+                coefs[maps[k]] = coefs[maps[k]] + feed_rates[j] * parent_coefs[k];
+            }
+        }
+        if (!source.empty()) {
+            coefs[0] = coefs[0] + source[id];
+        }
+
+        double dc = row_dcs[row];
+        held[row] = (dc == 0.0 || (produced && !(exp(-1.0 * dc * dt) < STABLE_DECAY_FACTOR)));
+        int self = own_terms[row];
+        if (held[row]) {
+            dc = 0.0;
+            self = 0;
+            sums.lins[row] = coefs[self];
+            sums.quads[row] = inflow_lin / 2.0;
+            coefs[self] = 0.0;
+        } else if (inflow_lin != 0.0) {
+            sums.lins[row] = inflow_lin / dc;
+            coefs[0] = coefs[0] - sums.lins[row];
+        }
+        double total = 0.0;
+        for (int k = 0; k < n_terms; ++k) {
+            if (k != self) {
+                coefs[k] = coefs[k] / (dc - rate_dcs[term_rates[first + k]]);
+                total = total + coefs[k];
+            }
+        }
+        coefs[self] = (n0.empty() ? 0.0 : n0[id]) - total;
+        if (produced) {
+            sums.starts[row] = n0.empty() ? 0.0 : n0[id];
+        }
+    }
+    return sums;
+}
+
+/** Evaluates the populations of an expansion.
+ *
+ * @param sums Populations from expand.
+ * @param dt Time from the start of the expansion (seconds).
+ * @return Population of each isotope ID, 0.0 for isotopes with no stems.
+ */
+vector<double> expsum_solver::evaluate(const expansion &sums, double dt) const {
+    bool rebased = !sums.starts.empty();
+    vector<double> factors;
+    if (rebased) {
+        fill_rebased_factors(dt, factors);
+    } else {
+        fill_factors(dt, factors);
+    }
+    vector<double> res(data->n_isotopes(), 0.0);
+    for (int row = 0; row < n_rows(); ++row) {
+        double sum = (sums.lins[row] + sums.quads[row] * dt) * dt;
+        if (rebased) {
+            sum = sum + sums.starts[row];
+        }
+        for (int k = term_offsets[row]; k < term_offsets[row + 1]; ++k) {
+            sum = sum + sums.coefs[k] * factors[term_rates[k]];
+        }
+        res[row_ids[row]] = sum;
+    }
+    return res;
+}
+
+/** Integrates the populations of an expansion over a time window. Each term integrates to
+ * C * (exp(-DC * DT1) - exp(-DC * DT2)) / DC, or C * (DT2 - DT1) for a decay constant of 0.0, and LIN and QUAD to
+ * LIN * (DT2^2 - DT1^2) / 2 and QUAD * (DT2^3 - DT1^3) / 3. The terms of an expansion with STARTS integrate as
+ * fill_rebased_weights gives instead.
+ *
+ * @param sums Populations from expand.
+ * @param dt1 Start of the window, from the start of the expansion (seconds).
+ * @param dt2 End of the window, from the start of the expansion (seconds).
+ * @return Integral of the population of each isotope ID (seconds), 0.0 for isotopes with no stems.
+ */
+vector<double> expsum_solver::integrate(const expansion &sums, double dt1, double dt2) const {
+    bool rebased = !sums.starts.empty();
+    vector<double> weights, factors_end;
+    if (rebased) {
+        fill_rebased_weights(dt2, weights);
+        fill_rebased_weights(dt1, factors_end);
+        for (size_t i = 0; i < rate_dcs.size(); ++i) {
+            weights[i] = weights[i] - factors_end[i];
+        }
+    } else {
+        fill_factors(dt1, weights);
+        fill_factors(dt2, factors_end);
+        for (size_t i = 0; i < rate_dcs.size(); ++i) {
+            weights[i] = (rate_dcs[i] == 0.0) ? dt2 - dt1 : (weights[i] - factors_end[i]) / rate_dcs[i];
+        }
+    }
+    vector<double> res(data->n_isotopes(), 0.0);
+    for (int row = 0; row < n_rows(); ++row) {
+        double sum = sums.lins[row] * (dt2 * dt2 - dt1 * dt1) / 2.0 +
+                     sums.quads[row] * (dt2 * dt2 * dt2 - dt1 * dt1 * dt1) / 3.0;
+        if (rebased) {
+            sum = sum + sums.starts[row] * (dt2 - dt1);
+        }
+        for (int k = term_offsets[row]; k < term_offsets[row + 1]; ++k) {
+            sum = sum + sums.coefs[k] * weights[term_rates[k]];
+        }
+        res[row_ids[row]] = sum;
+    }
+    return res;
+}
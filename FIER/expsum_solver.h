@@ -0,0 +1,90 @@
+#ifndef FIER_EXPSUM_SOLVER_H
+#define FIER_EXPSUM_SOLVER_H
+
+
+#include "chains_data.h"
+
+/** Third solver of FIER, which propagates sums of exponentials down the decay graph instead of summing a Bateman
+ * solution per decay stem. The population of every isotope is held as
+ * N(t) = sum(C[K] * exp(-DC[K] * t)) + LIN * t + QUAD * t^2 over the decay constants of itself and its ancestors,
+ * and isotopes are visited parents first, each taking the terms of its parents through the decay modes that feed it.
+ * A stem sum costs the square of the stem length for every path down the graph, while a pass here costs each decay
+ * mode times the terms of its parent, so branching decay graphs no longer multiply the work.
+ *
+ * The graph is the one the stems of chains_data span: each parent and daughter that follow each other in a stem,
+ * with the branching ratio the stems use, so the decay modes build_chains removed are left out here too. An isotope
+ * with the decay constant of one of its ancestors has its own perturbed as build_chains does.
+ */
+class expsum_solver {
+public:
+    /** Populations of every isotope as sums of exponentials, from expand.*/
+    struct expansion {
+        /** Coefficient of each term of each row, pooled as given by TERM_OFFSETS.*/
+        vector<double> coefs;
+        /** Coefficient of T of each row. Isotopes held stable under a production have one, and under a production
+         * that changes linearly so do the others.
+         */
+        vector<double> lins;
+        /** Coefficient of T^2 of each row. Only isotopes held stable under a production that changes linearly have
+         * one.
+         */
+        vector<double> quads;
+        /** Population of each row at the start, only for expansions with a production. Their terms are then taken as
+         * C[K] * (exp(-DC[K] * t) - 1) on top of it, so the production that long lived isotopes gain is not lost to
+         * the cancellation of their large terms.
+         */
+        vector<double> starts;
+    };
+
+private:
+    /** Species data the graph was built from, shared with the other classes.*/
+    shared_ptr<const species_data> data;
+    /** Isotope ID of each row, parents before daughters.*/
+    vector<int> row_ids;
+    /** Row of each isotope ID, -1 for isotopes with no stems.*/
+    vector<int> id_rows;
+    /** Decay constant of each row, perturbed where it repeats that of an ancestor.*/
+    vector<double> row_dcs;
+    /** First entry of each row in FEED_ROWS, FEED_RATES and FEED_MAPS, and the end of the last row.*/
+    vector<int> feed_offsets;
+    /** Parent row of each entry.*/
+    vector<int> feed_rows;
+    /** BR * DC of the parent of each entry, the rate at which it feeds its row.*/
+    vector<double> feed_rates;
+    /** First entry of each feed in TERM_MAPS.*/
+    vector<int> feed_maps;
+    /** Term of the fed row that each term of the parent of a feed adds to, one run per feed.*/
+    vector<int> term_maps;
+    /** First term of each row in TERM_RATES, and the end of the last row.*/
+    vector<int> term_offsets;
+    /** Index in RATE_DCS of the decay constant of each term, in increasing order within a row, so the first term of
+     * every row is for 0.0 and carries constant production.
+     */
+    vector<int> term_rates;
+    /** Term of each row for its own decay constant.*/
+    vector<int> own_terms;
+    /** Distinct decay constants of all terms, 0.0 first.*/
+    vector<double> rate_dcs;
+
+    void order_rows(const chains_data &chains, vector<vector<pair<int, double>>> &parents);
+    void build_terms(const vector<vector<pair<int, double>>> &parents);
+    void fill_factors(double dt, vector<double> &factors) const;
+    void fill_rebased_factors(double dt, vector<double> &factors) const;
+    void fill_rebased_weights(double dt, vector<double> &weights) const;
+
+public:
+    expsum_solver(shared_ptr<const species_data> data_in, const chains_data &chains);
+
+    /** @return Number of isotopes with stems.*/
+    int n_rows() const { return static_cast<int>(row_ids.size()); }
+    /** @return Number of terms over all rows.*/
+    int n_terms() const { return static_cast<int>(term_rates.size()); }
+
+    expansion expand(const vector<double> &n0, const vector<double> &source, double dt,
+                     const vector<double> &ramp = {}) const;
+    vector<double> evaluate(const expansion &sums, double dt) const;
+    vector<double> integrate(const expansion &sums, double dt1, double dt2) const;
+};
+
+
+#endif //FIER_EXPSUM_SOLVER_H
@@ -7,6 +7,14 @@
  */
 
 #include "helper_functions.h"
+#include <charconv> // for allocation free number parsing
+#include <stdexcept> // for conversion errors
+#include <sys/stat.h> // for file modification times
+#ifndef _WIN32
+#include <sys/mman.h> // for memory-mapped files
+#include <fcntl.h>
+#include <unistd.h>
+#endif
 /**
  * Extra definition of PI for CLION users.
  */
@@ -39,6 +47,85 @@ vector <string> split(string str, char delimiter) {
     return internal;
 }
 
+/**
+ * Tokenizes lines without copying or allocating. Tokens are views into LINE, so they are only valid
+ * while LINE is unchanged. Splits the same way as split, then pads PARTS with empty tokens up to MIN_PARTS
+ * so that missing columns fail to convert instead of being read out of bounds.
+ *
+ * @param line Line to be tokenized.
+ * @param delimiter Character that separates tokens. Usually a comma.
+ * @param parts Filled with the tokens. Its storage is reused between calls.
+ * @param min_parts Minimum number of tokens returned (OPTIONAL).
+ */
+void split_view(string_view line, char delimiter, vector<string_view> &parts, size_t min_parts) {
+    parts.clear();
+    size_t start = 0;
+    while (start < line.size()) {
+        size_t stop = line.find(delimiter, start);
+        if (stop == string_view::npos) {
+            stop = line.size();
+        }
+        parts.push_back(line.substr(start, stop - start));
+        start = stop + 1;
+    }
+    while (parts.size() < min_parts) {
+        parts.emplace_back();
+    }
+}
+
+/** Skips the leading whitespace and plus sign that stoi and stod accept but from_chars does not.
+ *
+ * @param token Token to be trimmed.
+ * @return Start of the number in TOKEN.
+ */
+static const char *number_start(string_view token) {
+    const char *first = token.data();
+    const char *last = token.data() + token.size();
+    while (first != last && isspace(static_cast<unsigned char>(*first))) {
+        ++first;
+    }
+    if (first != last && *first == '+' && (first + 1 == last || *(first + 1) != '-')) {
+        ++first;
+    }
+    return first;
+}
+
+/** Converts a token to an integer with the same rules as stoi: leading whitespace and a sign are
+ * allowed, and parsing stops at the first character that is not a digit.
+ *
+ * @param token Token to be converted.
+ * @return Integer value of TOKEN. Throws invalid_argument if there is no number, or out_of_range.
+ */
+int to_int(string_view token) {
+    int res = 0;
+    from_chars_result parsed = from_chars(number_start(token), token.data() + token.size(), res);
+    if (parsed.ec == errc::invalid_argument) {
+        throw invalid_argument("stoi");
+    }
+    if (parsed.ec == errc::result_out_of_range) {
+        throw out_of_range("stoi");
+    }
+    return res;
+}
+
+/** Converts a token to a double with the same rules as stod: leading whitespace and a sign are
+ * allowed, and parsing stops at the first character that is not part of the number.
+ *
+ * @param token Token to be converted.
+ * @return Double value of TOKEN. Throws invalid_argument if there is no number, or out_of_range.
+ */
+double to_double(string_view token) {
+    double res = 0.0;
+    from_chars_result parsed = from_chars(number_start(token), token.data() + token.size(), res);
+    if (parsed.ec == errc::invalid_argument) {
+        throw invalid_argument("stod");
+    }
+    if (parsed.ec == errc::result_out_of_range) {
+        throw out_of_range("stod");
+    }
+    return res;
+}
+
 
 
 /** Retrieves all integer keys from a given map of doubles on integers.
@@ -241,4 +328,242 @@ double erfinv(double x) {
     r -= (erf(r) - x) / (2 / sqrt(M_PI) * exp(-r * r));
 
     return r;
-}
\ No newline at end of file
+}
+
+/** Checks that a file exists and was not modified after a reference file.
+ *
+ * @param filename File being checked.
+ * @param reference File it is compared against.
+ * @return TRUE if FILENAME exists and REFERENCE exists and is not newer than it, FALSE otherwise.
+ */
+bool up_to_date(string filename, string reference) {
+    struct stat file_stat;
+    struct stat reference_stat;
+    if (stat(filename.c_str(), &file_stat) != 0 || stat(reference.c_str(), &reference_stat) != 0) {
+        return false;
+    }
+    return reference_stat.st_mtime <= file_stat.st_mtime;
+}
+
+/** Number of threads to split work across.
+ *
+ * @param requested Number of threads asked for, 0 or less for one per hardware thread.
+ * @return REQUESTED if positive, otherwise the number of hardware threads, at least 1.
+ */
+int worker_threads(int requested) {
+    if (requested > 0) {
+        return requested;
+    }
+    return max(1, static_cast<int>(thread::hardware_concurrency()));
+}
+
+/** Starts the workers of a pool.
+ *
+ * @param n_threads Number of threads jobs run on, including the calling thread.
+ */
+thread_pool::thread_pool(int n_threads) {
+    for (int i = 1; i < n_threads; ++i) {
+        workers.emplace_back(&thread_pool::work, this);
+    }
+}
+
+/** Stops and joins the workers.*/
+thread_pool::~thread_pool() {
+    {
+        lock_guard<mutex> lock(job_mutex);
+        stopping = true;
+    }
+    job_ready.notify_all();
+    for (thread &worker : workers) {
+        worker.join();
+    }
+}
+
+/** Runs tasks of a job until none are left.
+ *
+ * @param call_in Runs one task.
+ * @param context_in Task of the job.
+ * @param n Number of tasks of the job.
+ */
+void thread_pool::take_tasks(void (*call_in)(void *, int), void *context_in, int n) {
+    for (int i = next_task++; i < n; i = next_task++) {
+        call_in(context_in, i);
+    }
+}
+
+/** Loop of each worker: waits for a job, takes its tasks along with the other threads, and reports when done.*/
+void thread_pool::work() {
+    long jobs_seen = 0;
+    unique_lock<mutex> lock(job_mutex);
+    while (true) {
+        job_ready.wait(lock, [&]() { return stopping || n_jobs != jobs_seen; });
+        if (stopping) {
+            return;
+        }
+        jobs_seen = n_jobs;
+        void (*call_in)(void *, int) = call;
+        void *context_in = context;
+        int n = n_tasks;
+        lock.unlock();
+        take_tasks(call_in, context_in, n);
+        lock.lock();
+        if (--busy == 0) {
+            job_done.notify_one();
+        }
+    }
+}
+
+/** Runs a job of N tasks on the calling thread and every worker. Jobs of one task, and pools with no workers, run
+ * on the calling thread alone.
+ *
+ * @param n Number of tasks.
+ * @param call_in Runs one task.
+ * @param context_in Task of the job.
+ */
+void thread_pool::run_job(int n, void (*call_in)(void *, int), void *context_in) {
+    if (workers.empty() || n <= 1) {
+        for (int i = 0; i < n; ++i) {
+            call_in(context_in, i);
+        }
+        return;
+    }
+    {
+        lock_guard<mutex> lock(job_mutex);
+        call = call_in;
+        context = context_in;
+        n_tasks = n;
+        next_task = 0;
+        busy = static_cast<int>(workers.size());
+        ++n_jobs;
+    }
+    job_ready.notify_all();
+    take_tasks(call_in, context_in, n);
+    unique_lock<mutex> lock(job_mutex);
+    job_done.wait(lock, [&]() { return busy == 0; });
+}
+
+/** Computes the 64 bit FNV-1a hash of a block of memory. Used to validate binary data files.
+ *
+ * @param bytes Start of the block.
+ * @param n Length of the block in bytes.
+ * @return The hash value.
+ */
+uint64_t fnv1a_hash(const char *bytes, size_t n) {
+    uint64_t hash = 14695981039346656037ULL;
+    for (size_t i = 0; i < n; ++i) {
+        hash = hash ^ static_cast<unsigned char>(bytes[i]);
+        hash = hash * 1099511628211ULL;
+    }
+    return hash;
+}
+
+/** Opens FILENAME for reading, replacing any file already held.
+ *
+ * @param filename File to be opened.
+ * @return TRUE on success, FALSE if the file cannot be read.
+ */
+bool mapped_file::open(string filename) {
+    close();
+#ifndef _WIN32
+    int fd = ::open(filename.c_str(), O_RDONLY);
+    if (fd < 0) {
+        return false;
+    }
+    struct stat file_stat;
+    if (fstat(fd, &file_stat) == 0 && file_stat.st_size > 0) {
+        void *view = mmap(nullptr, static_cast<size_t>(file_stat.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+        if (view != MAP_FAILED) {
+            bytes = static_cast<const char *>(view);
+            length = static_cast<size_t>(file_stat.st_size);
+            mapped = true;
+            ::close(fd);
+            return true;
+        }
+    }
+    ::close(fd);
+#endif
+    ifstream file(filename, ios::binary);
+    if (!file.is_open()) {
+        return false;
+    }
+    buffer.assign(istreambuf_iterator<char>(file), istreambuf_iterator<char>());
+    bytes = buffer.data();
+    length = buffer.size();
+    return true;
+}
+
+/** Releases the file contents.
+ */
+void mapped_file::close() {
+#ifndef _WIN32
+    if (mapped) {
+        munmap(const_cast<char *>(bytes), length);
+    }
+#endif
+    buffer.clear();
+    bytes = nullptr;
+    length = 0;
+    mapped = false;
+}
+
+/** Size of a cache file header: magic, version, padding, payload size and payload hash.*/
+static const size_t CACHE_HEADER_SIZE = 32;
+
+/** Writes a binary cache file: a 32 byte header holding MAGIC, VERSION, and the size and FNV-1a hash of PAYLOAD,
+ * followed by PAYLOAD.
+ *
+ * @param filename File to be written.
+ * @param magic Eight bytes identifying the kind of cache.
+ * @param version Layout version of the payload.
+ * @param payload Cache contents.
+ * @return TRUE if the file was written.
+ */
+bool write_cache_file(string filename, const char *magic, uint32_t version, const string &payload) {
+    string header;
+    header.append(magic, 8);
+    cache_write(header, version);
+    cache_write(header, static_cast<uint32_t>(0));
+    cache_write(header, static_cast<uint64_t>(payload.size()));
+    cache_write(header, fnv1a_hash(payload.data(), payload.size()));
+
+    ofstream cache_file(filename, ios::binary);
+    if (!cache_file.is_open()) {
+        return false;
+    }
+    cache_file.write(header.data(), header.size());
+    cache_file.write(payload.data(), payload.size());
+    cache_file.close();
+    return !cache_file.fail();
+}
+
+/** Opens a binary cache file written by write_cache_file and checks its header and hash.
+ *
+ * @param file Holds the file contents while READER is in use.
+ * @param filename File to be read.
+ * @param magic Eight bytes identifying the kind of cache.
+ * @param version Layout version the payload must have.
+ * @param reader Set to read the payload.
+ * @return TRUE if the file exists, has the right magic and version and its payload is intact.
+ */
+bool open_cache_file(mapped_file &file, string filename, const char *magic, uint32_t version, cache_reader &reader) {
+    if (!file.open(filename) || file.size() < CACHE_HEADER_SIZE) {
+        return false;
+    }
+    cache_reader header = {file.data(), file.data() + CACHE_HEADER_SIZE, true};
+    char file_magic[8];
+    header.read(file_magic, sizeof(file_magic));
+    auto file_version = header.read<uint32_t>();
+    header.read<uint32_t>();
+    auto payload_size = header.read<uint64_t>();
+    auto payload_hash = header.read<uint64_t>();
+    if (memcmp(file_magic, magic, sizeof(file_magic)) != 0 || file_version != version ||
+        payload_size != file.size() - CACHE_HEADER_SIZE) {
+        return false;
+    }
+    const char *payload = file.data() + CACHE_HEADER_SIZE;
+    if (fnv1a_hash(payload, payload_size) != payload_hash) {
+        return false;
+    }
+    reader = {payload, payload + payload_size, true};
+    return true;
+}
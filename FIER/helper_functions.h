@@ -13,6 +13,13 @@
 #include <chrono> // for time reading, useful for benching
 #include <random> // for random number generation
 #include <algorithm>
+#include <cstdint> // for fixed width integers in binary files
+#include <cstring> // for reading binary files
+#include <string_view> // for tokenizing without copies
+#include <thread> // for thread pools
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
 
 using namespace std;
 
@@ -35,6 +42,34 @@ int hashIsotope(int I, int Z, int A);
  */
 vector <string> split(string str, char delimiter);
 
+/**
+ * Tokenizes lines without copying or allocating. Tokens are views into LINE, so they are only valid
+ * while LINE is unchanged. Splits the same way as split, then pads PARTS with empty tokens up to MIN_PARTS
+ * so that missing columns fail to convert instead of being read out of bounds.
+ *
+ * @param line Line to be tokenized.
+ * @param delimiter Character that separates tokens. Usually a comma.
+ * @param parts Filled with the tokens. Its storage is reused between calls.
+ * @param min_parts Minimum number of tokens returned (OPTIONAL).
+ */
+void split_view(string_view line, char delimiter, vector<string_view> &parts, size_t min_parts = 0);
+
+/** Converts a token to an integer with the same rules as stoi: leading whitespace and a sign are
+ * allowed, and parsing stops at the first character that is not a digit.
+ *
+ * @param token Token to be converted.
+ * @return Integer value of TOKEN. Throws invalid_argument if there is no number, or out_of_range.
+ */
+int to_int(string_view token);
+
+/** Converts a token to a double with the same rules as stod: leading whitespace and a sign are
+ * allowed, and parsing stops at the first character that is not part of the number.
+ *
+ * @param token Token to be converted.
+ * @return Double value of TOKEN. Throws invalid_argument if there is no number, or out_of_range.
+ */
+double to_double(string_view token);
+
 
 /** Retrieves all integer keys from a given map of doubles on integers.
  *
@@ -120,4 +155,261 @@ vector<double> copy_incl(vector<double> in, int j) ;
  */
 double erfinv(double x) ;
 
+/** Checks that a file exists and was not modified after a reference file.
+ *
+ * @param filename File being checked.
+ * @param reference File it is compared against.
+ * @return TRUE if FILENAME exists and REFERENCE exists and is not newer than it, FALSE otherwise.
+ */
+bool up_to_date(string filename, string reference);
+
+/** Number of threads to split work across.
+ *
+ * @param requested Number of threads asked for, 0 or less for one per hardware thread.
+ * @return REQUESTED if positive, otherwise the number of hardware threads, at least 1.
+ */
+int worker_threads(int requested);
+
+/** Computes the 64 bit FNV-1a hash of a block of memory. Used to validate binary data files.
+ *
+ * @param bytes Start of the block.
+ * @param n Length of the block in bytes.
+ * @return The hash value.
+ */
+uint64_t fnv1a_hash(const char *bytes, size_t n);
+
+/** Read-only view of an entire file. The file is memory-mapped where the platform allows it,
+ * otherwise it is read into memory.
+ */
+class mapped_file {
+    /** Start of the file contents.*/
+    const char *bytes = nullptr;
+    /** Length of the file in bytes.*/
+    size_t length = 0;
+    /** True if BYTES points into a memory map rather than BUFFER.*/
+    bool mapped = false;
+    /** Holds the contents when the file cannot be mapped.*/
+    vector<char> buffer;
+
+public:
+    mapped_file() = default;
+    mapped_file(const mapped_file &) = delete;
+    mapped_file &operator=(const mapped_file &) = delete;
+    ~mapped_file() { close(); }
+
+    bool open(string filename);
+    void close();
+
+    /** @return Start of the file contents.*/
+    const char *data() const { return bytes; }
+    /** @return Length of the file in bytes.*/
+    size_t size() const { return length; }
+};
+
+/** Fixed set of threads that run the tasks of one job at a time. The tasks of a job are numbered from 0 and each
+ * thread takes the next one from a shared counter as soon as it is done with the last, so a few long tasks do not
+ * hold up the others. The thread that calls run works on the job too, so a pool of N threads starts N - 1 workers.
+ */
+class thread_pool {
+    /** Worker threads.*/
+    vector<thread> workers;
+    /** Guards every field below but NEXT_TASK.*/
+    mutex job_mutex;
+    /** Signals the workers that a job started or the pool is stopping.*/
+    condition_variable job_ready;
+    /** Signals run that the last worker left the job.*/
+    condition_variable job_done;
+    /** Runs task I of the job with CONTEXT.*/
+    void (*call)(void *context, int i) = nullptr;
+    /** Task of the job being run.*/
+    void *context = nullptr;
+    /** Number of tasks of the job being run.*/
+    int n_tasks = 0;
+    /** Next task of the job being run to hand out.*/
+    atomic<int> next_task{0};
+    /** Number of workers still on the job being run.*/
+    int busy = 0;
+    /** Number of jobs started, so that a worker can tell a new job from the one it finished.*/
+    long n_jobs = 0;
+    /** True once the pool is being destroyed.*/
+    bool stopping = false;
+
+    void work();
+    void take_tasks(void (*call_in)(void *, int), void *context_in, int n);
+    void run_job(int n, void (*call_in)(void *, int), void *context_in);
+
+public:
+    explicit thread_pool(int n_threads);
+    thread_pool(const thread_pool &) = delete;
+    thread_pool &operator=(const thread_pool &) = delete;
+    ~thread_pool();
+
+    /** @return Number of threads a job runs on, including the calling thread.*/
+    int size() const { return static_cast<int>(workers.size()) + 1; }
+
+    /** Runs TASK(I) for I from 0 to N - 1 across the pool, and returns once all of them are done. TASK must not
+     * throw or call run.
+     *
+     * @param n Number of tasks.
+     * @param task Called with the number of each task.
+     */
+    template<typename Task>
+    void run(int n, Task &task) {
+        run_job(n, [](void *task_in, int i) { (*static_cast<Task *>(task_in))(i); }, &task);
+    }
+};
+
+/** Read-only view of N consecutive values owned by another container, used like a const vector without
+ * copying it. A view is only valid while the values it points to are unchanged.
+ */
+template<typename T>
+class array_view {
+    /** First value.*/
+    const T *first = nullptr;
+    /** Number of values.*/
+    size_t n = 0;
+
+public:
+    array_view() = default;
+    array_view(const T *first_in, size_t n_in) : first(first_in), n(n_in) {}
+    array_view(const vector<T> &v) : first(v.data()), n(v.size()) {}
+
+    /** @return Number of values.*/
+    size_t size() const { return n; }
+    /** @return The Ith value.*/
+    const T &operator[](size_t i) const { return first[i]; }
+    /** @return Start of the values.*/
+    const T *begin() const { return first; }
+    /** @return End of the values.*/
+    const T *end() const { return first + n; }
+};
+
+/** Appends the raw bytes of N values to a binary buffer.
+ *
+ * @param buf Buffer being written.
+ * @param values Start of the values.
+ * @param n Number of values.
+ */
+template<typename T>
+void cache_write(string &buf, const T *values, size_t n) {
+    buf.append(reinterpret_cast<const char *>(values), n * sizeof(T));
+}
+
+/** Appends a single value to a binary buffer.
+ *
+ * @param buf Buffer being written.
+ * @param value Value to append.
+ */
+template<typename T>
+void cache_write(string &buf, T value) {
+    cache_write(buf, &value, 1);
+}
+
+/** Appends a vector to a binary buffer, its length first.
+ *
+ * @param buf Buffer being written.
+ * @param values Values to append.
+ */
+template<typename T>
+void cache_write_vector(string &buf, const vector<T> &values) {
+    cache_write(buf, static_cast<uint64_t>(values.size()));
+    cache_write(buf, values.data(), values.size());
+}
+
+/** Reads values back out of a binary cache payload. Every read is bounds checked, and OK is cleared
+ * when the payload runs out.
+ */
+struct cache_reader {
+    /** Current read position.*/
+    const char *pos = nullptr;
+    /** End of the payload.*/
+    const char *end = nullptr;
+    /** False once a read has run past END.*/
+    bool ok = false;
+
+    /** Copies N values out of the payload.
+     *
+     * @param values Destination of the values.
+     * @param n Number of values.
+     */
+    template<typename T>
+    void read(T *values, size_t n) {
+        size_t n_bytes = n * sizeof(T);
+        if (!ok || n > static_cast<size_t>(end - pos) / sizeof(T)) {
+            ok = false;
+            return;
+        }
+        if (n_bytes > 0) {
+            memcpy(values, pos, n_bytes);
+        }
+        pos = pos + n_bytes;
+    }
+
+    /** @return The next value in the payload.*/
+    template<typename T>
+    T read() {
+        T value = T();
+        read(&value, 1);
+        return value;
+    }
+
+    /** @return The next length-prefixed string in the payload.*/
+    string read_string() {
+        auto n = read<uint32_t>();
+        if (!ok || n > static_cast<size_t>(end - pos)) {
+            ok = false;
+            return "";
+        }
+        string res(pos, n);
+        pos = pos + n;
+        return res;
+    }
+
+    /** Reads N values into a vector.
+     *
+     * @param values Vector being filled.
+     * @param n Number of values.
+     */
+    template<typename T>
+    void read_vector(vector<T> &values, uint64_t n) {
+        if (!ok || n > static_cast<size_t>(end - pos) / sizeof(T)) {
+            ok = false;
+            return;
+        }
+        values.resize(n);
+        read(values.data(), n);
+    }
+
+    /** Reads a vector written by cache_write_vector.
+     *
+     * @param values Vector being filled.
+     */
+    template<typename T>
+    void read_vector(vector<T> &values) {
+        read_vector(values, read<uint64_t>());
+    }
+};
+
+/** Writes a binary cache file: a 32 byte header holding MAGIC, VERSION, and the size and FNV-1a hash of PAYLOAD,
+ * followed by PAYLOAD.
+ *
+ * @param filename File to be written.
+ * @param magic Eight bytes identifying the kind of cache.
+ * @param version Layout version of the payload.
+ * @param payload Cache contents.
+ * @return TRUE if the file was written.
+ */
+bool write_cache_file(string filename, const char *magic, uint32_t version, const string &payload);
+
+/** Opens a binary cache file written by write_cache_file and checks its header and hash.
+ *
+ * @param file Holds the file contents while READER is in use.
+ * @param filename File to be read.
+ * @param magic Eight bytes identifying the kind of cache.
+ * @param version Layout version the payload must have.
+ * @param reader Set to read the payload.
+ * @return TRUE if the file exists, has the right magic and version and its payload is intact.
+ */
+bool open_cache_file(mapped_file &file, string filename, const char *magic, uint32_t version, cache_reader &reader);
+
 #endif
\ No newline at end of file
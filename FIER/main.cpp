@@ -27,20 +27,45 @@ using namespace std;
 #include "product_data.h"
 #include "monte_carlo.h"
 
+/** Reads the first space separated word of a deck line.
+ *
+ * @param line Deck line.
+ * @param parts Token buffer reused between lines.
+ * @return The first word, or an empty string for an empty line.
+ */
+string first_word(const string &line, vector<string_view> &parts){
+    split_view(line, ' ', parts, 1);
+    return string(parts[0]);
+}
+
+/** Location of the packed yields library built by fier.exe --compile-yields.*/
+const string YIELDS_LIBRARY = "yields/yields.lib";
+
 /** Retrieves the yields file from the included library if indicated, otherwise passes on the custom
  * filename. If using the yields file, the top line should read YIELDS:ER, and the second line should be formatted:
  * ELEMENT_NAME,ATOMIC_NUMBER,FISSION_ENERGY. The possible fission energy choices are: Thermal, Fission, DD, DT, SF (spontaneous fission).
  * The library yields are parsed from England and Rider and should be located in "/yields/". See the manual for more info.
+ * When the packed yields library YIELDS_LIBRARY holds the requested file, the yields are imported from it straight
+ * into DATA, unless the matching .csv file has been edited since the library was built.
  *
  * @param yieldline1 Switch that determines if library is searched. Should be either YIELDS:ER (for library) or YIELDS:FILE (for custom yields file location)
  * @param yieldline2 Either an ordered triple that indicates which library file to use, or a custom file path.
- * @return location of the yields file (custom or library). -1 if neither ER or FILE is written, -2 if a related library file does not exist.
+ * @param data Nuclear data that library yields are imported into.
+ * @return location of the yields file (custom or library), or YIELDS_LIBRARY if the yields were already imported into DATA. -1 if neither ER or FILE is written, -2 if a related library file does not exist.
  */
-string get_yield_file(string yieldline1, string yieldline2){
+string get_yield_file(string yieldline1, string yieldline2, species_data &data){
     if(yieldline1.find("ER") != string::npos){
         vector<string> isotope = split(yieldline2,',');
+        if(isotope.size() < 3){
+            return "-2";
+        }
         transform(isotope[2].begin(), isotope[2].end(), isotope[2].begin(), ::tolower);
-        string yields_filename = "yields/"+isotope[1]+isotope[0]+"_"+isotope[2]+".csv";
+        string yields_key = isotope[1]+isotope[0]+"_"+isotope[2];
+        string yields_filename = "yields/"+yields_key+".csv";
+        bool edited = ifstream(yields_filename).good() && !up_to_date(YIELDS_LIBRARY, yields_filename);
+        if (!edited && data.import_yields_library(YIELDS_LIBRARY, yields_key)) {
+            return YIELDS_LIBRARY;
+        }
         ifstream yields_file(yields_filename);
                     if (yields_file.is_open()) {
                         yields_file.close();
@@ -56,6 +81,273 @@ string get_yield_file(string yieldline1, string yieldline2){
     }
 }
 
+/** Determines where the binary nuclear data cache for an isotopes file lives. The cache is named
+ * nuclear_data.bin and sits in the same directory as the isotopes file.
+ *
+ * @param isotopes_filename Location of the isotopes file.
+ * @return Location of the cache file.
+ */
+string get_cache_file(string isotopes_filename){
+    size_t slash = isotopes_filename.find_last_of("/\\");
+    if(slash == string::npos){
+        return "nuclear_data.bin";
+    }
+    return isotopes_filename.substr(0, slash + 1) + "nuclear_data.bin";
+}
+
+/** Reads a tabulated power profile into irradiation steps of PRODUCTS. Each line of the profile is TIME,FISSIONS at
+ * an absolute time (seconds), and the fission rate changes linearly from one line to the next, so each pair of lines
+ * is one step that ramps between them. Up to the first line the fission rate is that of the first line. Lines at or
+ * before T_LAST only set the fission rate the next step starts from.
+ *
+ * @param profile_file Location of the profile.
+ * @param t_last End of the irradiation so far (seconds), moved to the end of the profile.
+ * @param products Products the steps are added to.
+ * @return false if the profile could not be opened.
+ */
+bool read_power_profile(const string &profile_file, double &t_last, product_data &products){
+    ifstream profile(profile_file);
+    if(!profile.good()){
+        return false;
+    }
+    string line;
+    vector<string_view> parts;
+    bool started = false;
+    double P_last = 0.0;
+    while(getline(profile, line)){
+        if(!line.empty() && line.back() == '\r'){
+            line.pop_back();
+        }
+        if(line.empty()){
+            continue;
+        }
+        split_view(line, ',', parts, 2);
+        double t = to_double(parts[0]);
+        double P = to_double(parts[1]);
+        if(t > t_last){
+            products.add_irrad(t, started ? P_last : P, P);
+            t_last = t;
+        }
+        P_last = P;
+        started = true;
+    }
+    return true;
+}
+
+/** Writes the series a SERIES line of the POPULATIONS block asks for, formatted
+ * SERIES:GRID,T_START,T_END,N_POINTS,QUANTITY,FILE. GRID is LIN for times spaced evenly, or LOG for times spaced
+ * evenly in their logarithm from the irradiation end, and QUANTITY is POPULATIONS or ACTIVITIES.
+ *
+ * @param line SERIES line of the deck.
+ * @param t_irrad Irradiation end time (seconds).
+ * @param products Products with their populations at T_IRRAD.
+ * @return false if the line is not valid or the series could not be written.
+ */
+bool save_series_line(const string &line, double t_irrad, product_data &products){
+    vector<string_view> parts;
+    split_view(line, ',', parts, 6);
+    string grid = string(parts[0].substr(parts[0].find(':') + 1));
+    string quantity = string(parts[4]);
+    vector<string_view> words;
+    string series_file = first_word(string(parts[5]), words);
+    if(!series_file.empty() && series_file.back() == '\r'){
+        series_file.pop_back();
+    }
+    if((grid != "LIN" && grid != "LOG") || (quantity != "POPULATIONS" && quantity != "ACTIVITIES")){
+        return false;
+    }
+    return products.save_series(series_file, to_double(parts[1]), to_double(parts[2]), to_int(parts[3]),
+                                grid == "LOG", quantity == "ACTIVITIES", t_irrad);
+}
+
+/** Compiles the isotopes, decays and gammas files into a binary nuclear data cache. Run with
+ * fier.exe --compile-data ISOTOPES DECAYS GAMMAS [CACHE]. If CACHE is not given the cache is placed
+ * next to the isotopes file, which is where the input deck looks for it.
+ *
+ * @param argc Argument count passed to main.
+ * @param argv Arguments passed to main.
+ * @return 0 on success.
+ */
+int compile_data(int argc, char *argv[]){
+    if(argc < 5){
+        cerr << "!!! Usage: fier.exe --compile-data ISOTOPES DECAYS GAMMAS [CACHE] !!!" << endl;
+        return 1;
+    }
+    vector<string> sources = {argv[2], argv[3], argv[4]};
+    string cache_file = (argc > 5) ? string(argv[5]) : get_cache_file(sources[0]);
+
+    if(!species_data::save_cache(cache_file, sources)){
+        return 1;
+    }
+    cout << "Nuclear data cache written to " << cache_file << '\n';
+    return 0;
+}
+
+/** Packs the yields files into the yields library that YIELDS:ER decks read from. Run with
+ * fier.exe --compile-yields [DIRECTORY] [LIBRARY]. The defaults are the yields directory and YIELDS_LIBRARY.
+ *
+ * @param argc Argument count passed to main.
+ * @param argv Arguments passed to main.
+ * @return 0 on success.
+ */
+int compile_yields(int argc, char *argv[]){
+    string yields_directory = (argc > 2) ? string(argv[2]) : "yields";
+    string library_file = (argc > 3) ? string(argv[3]) : YIELDS_LIBRARY;
+    int n_files = species_data::save_yields_library(yields_directory, library_file);
+    if(n_files < 0){
+        return 1;
+    }
+    cout << "Yields library of " << n_files << " files written to " << library_file << '\n';
+    return 0;
+}
+
+/** @return Difference between A and the reference B, relative to MAGNITUDE. Equal when both are NaN.*/
+double kernel_error(double a, double b, double magnitude){
+    if(isnan(a) && isnan(b)){
+        return 0.0;
+    }
+    if(a == b){
+        return 0.0;
+    }
+    return abs(a - b) / magnitude;
+}
+
+/** Checks every kernel implementation the CPU supports against the generic loops of the scalar kernels, on all
+ * stems of a yields file over a range of time steps. Each implementation is run on all stems at once, in trie node
+ * order, and on the stems bucketed by length, as product_data runs them, so the kernels specialized on stem length
+ * are checked too, as are the multi-time kernels, given the tables of every time step at once. The sum of each stem
+ * must match to KERNEL_TOLERANCE times the sum of the magnitudes of its terms. Run with fier.exe --check-kernels [YIELDS].
+ *
+ * @param argc Argument count passed to main.
+ * @param argv Arguments passed to main.
+ * @return 0 if every implementation is within tolerance.
+ */
+int check_kernels(int argc, char *argv[]){
+    string yields_file = (argc > 2) ? string(argv[2]) : "yields/235U_fission.csv";
+    species_data data;
+    data.import_all("input_data/isotopes.csv", "input_data/decays.csv", "input_data/gammas.csv", yields_file);
+    data.check_data(true);
+    chains_data chains;
+    chains.import_species_data(make_shared<const species_data>(move(data)));
+    chains.build_chains("NONE");
+    chains.extract_stems();
+
+    const vector<double> &rate_dcs = chains.get_rate_dcs();
+    stem_arrays stems = chains.get_stem_arrays();
+    vector<int> nodes(chains.get_stem_trie().size());
+    // buckets of stem trie nodes by stem length, as product_data::bucket_pass makes them
+    vector<vector<int>> buckets(SPECIALIZED_STEM_LENGTH + 1);
+    for (int node = 0; node < nodes.size(); ++node) {
+        nodes[node] = node;
+        buckets[(stems.lengths[node] <= SPECIALIZED_STEM_LENGTH) ? stems.lengths[node] : 0].push_back(node);
+    }
+    auto n_nodes = static_cast<int>(nodes.size());
+    vector<double> decay(rate_dcs.size()), decay_end(rate_dcs.size()), growth(rate_dcs.size());
+    vector<double> reference(nodes.size()), sums(nodes.size()), bucket_sums(nodes.size());
+    vector<double> magnitudes(nodes.size());
+
+    // largest error of SUM over every node, run on all nodes at once and by bucket, against REFERENCE
+    auto sums_error = [&](auto &&sum) {
+        double res = 0.0;
+        sum(0, nodes.data(), n_nodes, sums.data());
+        for (int node : nodes) {
+            res = max(res, kernel_error(sums[node], reference[node], magnitudes[node]));
+        }
+        for (int length = 0; length <= SPECIALIZED_STEM_LENGTH; ++length) {
+            const vector<int> &bucket = buckets[length];
+            sum(length, bucket.data(), static_cast<int>(bucket.size()), bucket_sums.data());
+            for (size_t k = 0; k < bucket.size(); ++k) {
+                res = max(res, kernel_error(bucket_sums[k], reference[bucket[k]], magnitudes[bucket[k]]));
+            }
+        }
+        return res;
+    };
+
+    // exponential tables of every time step, one after another, for the multi-time kernels
+    const vector<double> dts = {0.0, 1.0e-3, 1.0, 1.0e3, 1.0e6, 1.0e9};
+    auto n_dts = static_cast<int>(dts.size());
+    auto table_size = static_cast<int>(rate_dcs.size());
+    vector<double> decay_tables(dts.size() * rate_dcs.size()), decay_tables_end(dts.size() * rate_dcs.size());
+    for (size_t d = 0; d < dts.size(); ++d) {
+        for (size_t i = 0; i < rate_dcs.size(); ++i) {
+            decay_tables[d * rate_dcs.size() + i] = exp(-1.0 * rate_dcs[i] * dts[d]);
+            decay_tables_end[d * rate_dcs.size() + i] = exp(-1.0 * rate_dcs[i] * (10.0 * dts[d] + 1.0));
+        }
+    }
+    vector<double> times_sums(dts.size() * nodes.size());
+
+    const bateman_kernels &scalar = scalar_kernels();
+    int failed = 0;
+    for (const bateman_kernels *kernels : supported_kernels()) {
+        double max_error = 0.0;
+        for (int d = 0; d < n_dts; ++d) {
+            double dt = dts[d];
+            for (size_t i = 0; i < rate_dcs.size(); ++i) {
+                decay[i] = exp(-1.0 * rate_dcs[i] * dt);
+                decay_end[i] = exp(-1.0 * rate_dcs[i] * (10.0 * dt + 1.0));
+                growth[i] = 1.0 - decay[i];
+            }
+
+            for (int node : nodes) {
+                magnitudes[node] = 0.0;
+                for (int j = stems.offsets[node]; j < stems.offsets[node] + stems.lengths[node]; ++j) {
+                    magnitudes[node] += abs(stems.coefs[j] * decay[stems.rates[j]]);
+                }
+            }
+            scalar.batch_sums(stems, 0, nodes.data(), n_nodes, decay.data(), reference.data());
+            max_error = max(max_error, sums_error([&](int length, const int *group, int n, double *out) {
+                kernels->batch_sums(stems, length, group, n, decay.data(), out);
+            }));
+            max_error = max(max_error, sums_error([&](int length, const int *group, int n, double *out) {
+                kernels->batch_times_sums(stems, length, group, n, decay_tables.data(), n_dts, table_size,
+                                          times_sums.data(), n);
+                copy_n(times_sums.begin() + d * n, n, out);
+            }));
+
+            for (int node : nodes) {
+                magnitudes[node] = 0.0;
+                for (int j = stems.offsets[node]; j < stems.offsets[node] + stems.lengths[node]; ++j) {
+                    magnitudes[node] += abs(stems.coefs[j] * growth[stems.rates[j]] / stems.dcs[j])
+                                        + abs(stems.coefs[j] * dt);
+                }
+            }
+            scalar.cont_sums(stems, 0, nodes.data(), n_nodes, decay.data(), growth.data(), dt, reference.data());
+            max_error = max(max_error, sums_error([&](int length, const int *group, int n, double *out) {
+                kernels->cont_sums(stems, length, group, n, decay.data(), growth.data(), dt, out);
+            }));
+
+            for (int node : nodes) {
+                magnitudes[node] = 0.0;
+                for (int j = stems.offsets[node]; j < stems.offsets[node] + stems.lengths[node]; ++j) {
+                    magnitudes[node] += abs(stems.coefs[j] * (decay[stems.rates[j]] - decay_end[stems.rates[j]])
+                                            / stems.dcs[j]);
+                }
+            }
+            scalar.rate_sums(stems, 0, nodes.data(), n_nodes, decay.data(), decay_end.data(), reference.data());
+            max_error = max(max_error, sums_error([&](int length, const int *group, int n, double *out) {
+                kernels->rate_sums(stems, length, group, n, decay.data(), decay_end.data(), out);
+            }));
+            max_error = max(max_error, sums_error([&](int length, const int *group, int n, double *out) {
+                kernels->rate_times_sums(stems, length, group, n, decay_tables.data(), decay_tables_end.data(),
+                                         n_dts, table_size, times_sums.data(), n);
+                copy_n(times_sums.begin() + d * n, n, out);
+            }));
+        }
+        if (max_error <= KERNEL_TOLERANCE) {
+            cout << kernels->name << " kernels match the scalar reference (largest relative difference " << max_error
+                 << ", tolerance " << KERNEL_TOLERANCE << ")" << '\n';
+        } else {
+            cout << "ERROR: " << kernels->name << " kernels differ from the scalar reference by " << max_error
+                 << ", more than the tolerance of " << KERNEL_TOLERANCE << '\n';
+            ++failed;
+        }
+    }
+    if (supported_kernels().size() == 1) {
+        cout << "No SIMD kernels are supported on this CPU" << '\n';
+    }
+    return (failed == 0) ? 0 : 1;
+}
+
 
 
 
@@ -64,11 +356,25 @@ string get_yield_file(string yieldline1, string yieldline2){
 /** Main process. To see where each input deck line is being read, look for comments in the form of
  * LINE X in this function.
  *
- * @param argc Should be 1.
- * @param argv FIER takes one argument, the input deck location/name as a .txt.
+ * @param argc Should be 2, plus 2 for each option.
+ * @param argv FIER takes one argument, the input deck location/name as a .txt, optionally after --threads N to set
+ * the number of threads decay chains are built and products evaluated on (default: one per hardware thread), and
+ * --chains-cache FILE to import the decay chains and stems from FILE when it was built from the same nuclear data and
+ * yields, or to build them and write FILE otherwise, and --kernels NAME to evaluate the Bateman solutions with the scalar, avx2 or avx512
+ * kernels instead of the fastest ones the CPU supports.
  * @return 0 on successful run.
  */
 int main(int argc, char *argv[]) {
+    if (argc > 1 && string(argv[1]) == "--compile-data") {
+        return compile_data(argc, argv);
+    }
+    if (argc > 1 && string(argv[1]) == "--compile-yields") {
+        return compile_yields(argc, argv);
+    }
+    if (argc > 1 && string(argv[1]) == "--check-kernels") {
+        return check_kernels(argc, argv);
+    }
+
     // get time in milliseconds since start of epoch
     /** Holds absolute start time in ms dataed from start of epoch. Used for program timing.*/
     long t_start = std::chrono::system_clock::now().time_since_epoch() / std::chrono::milliseconds(1);
@@ -96,7 +402,7 @@ int main(int argc, char *argv[]) {
 
     //declares all fields
     species_data data;
-    chains_data chains;
+    auto chains = make_shared<chains_data>();
     product_data products;
     string check_data;
     string isotopes_file;
@@ -114,43 +420,63 @@ int main(int argc, char *argv[]) {
     int n_trials = 0;
     monte_carlo MC;
 
-    string input_deck = argv[1];
+    int n_threads = 0;
+    string chains_cache;
+    string input_deck;
+    for (int i = 1; i < argc; ++i) {
+        if (string(argv[i]) == "--threads" && i + 1 < argc) {
+            n_threads = stoi(argv[++i]);
+        } else if (string(argv[i]) == "--chains-cache" && i + 1 < argc) {
+            chains_cache = argv[++i];
+        } else if (string(argv[i]) == "--kernels" && i + 1 < argc) {
+            string kernels = argv[++i];
+            if (!select_kernels(kernels)) {
+                cout << "ERROR: " << kernels << " kernels are not available on this CPU" << '\n';
+                return 1;
+            }
+        } else {
+            input_deck = argv[i];
+        }
+    }
     string line;
+    vector<string_view> parts;
     ifstream deck(input_deck);
     if (deck.is_open()) {
         // read if FIER is to be run in single or multiple run mode (only single is available currently)
         getline(deck, line); //LINE 1
-        if (split(line, ':')[0] != "MODE") {
+        split_view(line, ':', parts, 2);
+        if (parts[0] != "MODE") {
             cout << "ERROR: Input deck not properly formatted. Line 1 must specify MODE." << '\n';
         } else {
-            if (split(split(line, ':')[1], ' ')[0] == "MONTECARLO") {
-                n_trials = stoi(split(split(line, ':')[1], ' ')[1]);
+            split_view(parts[1], ' ', parts, 2);
+            if (parts[0] == "MONTECARLO") {
+                n_trials = to_int(parts[1]);
             }
         }
 
         // read if FIER should predict decay mode prediction
         getline(deck, line); // LINE 2
-        check_data = split(line, ' ')[0];
+        check_data = first_word(line, parts);
 
         cout << "Importing input data..." << '\n';
 
         // read isotopes file
         getline(deck, line); //LINE 3
-        isotopes_file = split(line, ' ')[0];
+        isotopes_file = first_word(line, parts);
         // read decays file
         getline(deck, line); // LINE 4
-        decays_file = split(line, ' ')[0];
+        decays_file = first_word(line, parts);
 
         // read gammas file
         getline(deck, line); // LINE 5
-        gammas_file = split(line, ' ')[0];
+        gammas_file = first_word(line, parts);
 
         getline(deck, line); //LINE 6
-        string yieldline1 = split(line, ' ')[0];
+        string yieldline1 = first_word(line, parts);
         getline(deck, line); // LINE 7
-        string yieldline2 = split(line,' ')[0];
+        string yieldline2 = first_word(line, parts);
 
-        yields_file = get_yield_file(yieldline1, yieldline2);
+        yields_file = get_yield_file(yieldline1, yieldline2, data);
         if(yields_file == "-1"){
             cerr << "!!! Yield File Read Mode not Recognized (Should be ER or FILE) !!!" << endl;
             return 0;
@@ -163,23 +489,23 @@ int main(int argc, char *argv[]) {
 
         // read output chains file
         getline(deck, line); //LINE 8
-        chains_out = split(line, ' ')[0];
+        chains_out = first_word(line, parts);
 
         //read output stems file
         getline(deck, line); //LINE 9
-        stems_out = split(line, ' ')[0];
+        stems_out = first_word(line, parts);
 
         //read output population file
         getline(deck, line); //LINE 10
-        pops_out = split(line, ' ')[0];
+        pops_out = first_word(line, parts);
 
         //read output gamma spectrum file.
         getline(deck, line); //LINE 11
-        gammas_out = split(line, ' ')[0];
+        gammas_out = first_word(line, parts);
 
         //read optional error output file.
         getline(deck, line);//LINE 12
-        error_log = split(line, ' ')[0];
+        error_log = first_word(line, parts);
 
         if (error_log != "NONE") {
             ofstream error_file;
@@ -187,37 +513,72 @@ int main(int argc, char *argv[]) {
             error_file.close();
         }
 
-        // import nuclear data from files
-        data.import_isotopes(isotopes_file, error_log);
-        data.import_decays(decays_file, error_log);
-        cout << "imported decays\n";
-        data.import_gammas(gammas_file);
-        cout << "imported gammas\n";
-
-        data.import_yields(yields_file);
-        cout << "imported yields\n";
+        // import nuclear data from the binary cache if it is current, otherwise from files
+        string cache_file = get_cache_file(isotopes_file);
+        if (data.import_cache(cache_file, {isotopes_file, decays_file, gammas_file}, error_log)) {
+            cout << "imported nuclear data cache\n";
+            if (yields_file != YIELDS_LIBRARY) {
+                data.import_yields(yields_file);
+            }
+        } else {
+            if (ifstream(cache_file).good()) {
+                cout << "Nuclear data cache is out of date, reading data files..." << '\n';
+            }
+            data.import_all(isotopes_file, decays_file, gammas_file,
+                            (yields_file == YIELDS_LIBRARY) ? "NONE" : yields_file, error_log);
+            cout << "imported decays\n";
+            cout << "imported gammas\n";
+        }
+        cout << ((yields_file == YIELDS_LIBRARY) ? "imported yields library\n" : "imported yields\n");
         // check nuclear data
         cout << "Checking imported data..." << '\n';
         data.check_data(check_data != "FALSE", error_log);
+        // the checked data is shared, not copied, by the chains, products and Monte Carlo trials
+        auto nuclear_data = make_shared<const species_data>(move(data));
 
 
-        // build decay chains
-        chains.import_species_data(data);
-        cout << "Building decay chains..." << '\n';
-        chains.build_chains(error_log);
-        cout << "Extracting decay stems..." << '\n';
-        chains.extract_stems();
+        // build decay chains, or import them from the chains cache if it was built from the same data
+        chains->import_species_data(nuclear_data);
+        if (!chains_cache.empty() && chains->import_cache(chains_cache)) {
+            cout << "imported decay chains cache\n";
+        } else {
+            cout << "Building decay chains..." << '\n';
+            auto t_chains = chrono::steady_clock::now();
+            chains->build_chains(error_log, n_threads);
+            chrono::duration<double> t_build = chrono::steady_clock::now() - t_chains;
+            cout << "   built on " << worker_threads(n_threads) << " threads in " << t_build.count() << " s" << '\n';
+            cout << "Extracting decay stems..." << '\n';
+            chains->extract_stems();
+            if (!chains_cache.empty() && chains->save_cache(chains_cache)) {
+                cout << "Decay chains cache written to " << chains_cache << '\n';
+            }
+        }
 
 
         // read key word to initialize populations
-        products.import_species_data(data);
+        products.import_species_data(nuclear_data);
         products.import_chains_data(chains);
+        products.set_threads(n_threads);
 
         getline(deck, line);
-        string init = split(line, ' ')[0];
+        string init = first_word(line, parts);
         if (init[init.length() - 1] == '\r') {
             init.pop_back();
         }
+        // optional solver, STEMS (default), CRAM or EXPSUM
+        if (init.rfind("SOLVER:", 0) == 0) {
+            string solver = init.substr(7);
+            if (!products.set_solver(solver)) {
+                cout << "ERROR: Solver " << solver << " not recognized (should be STEMS, CRAM or EXPSUM)." << '\n';
+                return 1;
+            }
+            cout << "Using the " << solver << " solver" << '\n';
+            getline(deck, line);
+            init = first_word(line, parts);
+            if (init[init.length() - 1] == '\r') {
+                init.pop_back();
+            }
+        }
         if (init != "INITIALIZE") {
             cout << "ERROR: Keyword INITIALIZE not in input deck." << '\n';
         }
@@ -227,65 +588,97 @@ int main(int argc, char *argv[]) {
         cout << "Importing initial populations..." << '\n';
         getline(deck, line);
         while (line != "IRRADIATION" && line != "IRRADIATION\r") {
-            vector <string> parts = split(line, ',');
-            int Z = stoi(parts[0]);
-            int A = stoi(parts[1]);
-            int I = stoi(parts[2]);
-            double pop = stod(parts[3]);
+            split_view(line, ',', parts, 4);
+            int Z = to_int(parts[0]);
+            int A = to_int(parts[1]);
+            int I = to_int(parts[2]);
+            double pop = to_double(parts[3]);
             products.set_population(hashIsotope(I,Z,A), 0.0, pop);
             getline(deck, line);
         }
-        // loop over production periods
+        // loop over production periods, steps of the same length sharing their stem sums. A step is TIME,FISSIONS,
+        // TIME,FISSIONS,FISSIONS_END for a fission rate that ramps over the step, or PROFILE:FILE for a tabulated one
         cout << "Calculating populations from irradiation..." << '\n';
         getline(deck, line);
-        double t_last = 0.0;
         double t_irrad = 0.0;
         while (line != "POPULATIONS" && line != "POPULATIONS\r") {
-            vector <string> parts = split(line, ',');
-            double t_cur = stod(parts[0]);
-            double P = stod(parts[1]);
-            products.add_irrad(t_cur, P);
-            products.batch_decay_all(t_cur, t_last);
-            products.cont_prod_all(P, t_cur, t_last);
+            if (line.rfind("PROFILE:", 0) == 0) {
+                string profile_file = first_word(line.substr(8), parts);
+                if (!profile_file.empty() && profile_file.back() == '\r') {
+                    profile_file.pop_back();
+                }
+                if (!read_power_profile(profile_file, t_irrad, products)) {
+                    cout << "ERROR: Power profile " << profile_file << " could not be opened." << '\n';
+                    return 1;
+                }
+                getline(deck, line);
+                continue;
+            }
+            split_view(line, ',', parts, 2);
+            double t_cur = to_double(parts[0]);
+            double P = to_double(parts[1]);
+            if (parts.size() > 2 && !parts[2].empty() && parts[2] != "\r") {
+                products.add_irrad(t_cur, P, to_double(parts[2]));
+            } else {
+                products.add_irrad(t_cur, P);
+            }
             getline(deck, line);
-            t_last = t_cur;
             t_irrad = t_cur;
         }
+        products.irradiate(products.get_irrad_scheme());
 
 
-        // loop over populations after production
+        // loop over populations after production, all evaluated in one pass. SERIES lines are streamed to their
+        // own files afterwards
         cout << "Calculating populations after irradiation..." << '\n';
         getline(deck, line);
+        vector<double> after_times;
+        vector<string> series_lines;
         while (line != "COUNTS" && line != "COUNTS\r") {
-            double t_cur = stod(line);
+            if (line.rfind("SERIES:", 0) == 0) {
+                series_lines.push_back(line);
+                getline(deck, line);
+                continue;
+            }
+            double t_cur = to_double(line);
             products.add_after(t_cur);
-            products.batch_decay_all(t_cur, t_irrad);
+            after_times.push_back(t_cur);
             getline(deck, line);
         }
+        products.batch_decay_times(after_times, t_irrad);
+        for (const string &series_line : series_lines) {
+            cout << "Writing series..." << '\n';
+            if (!save_series_line(series_line, t_irrad, products)) {
+                cout << "ERROR: Series " << series_line << " could not be written." << '\n';
+                return 1;
+            }
+        }
 
-        // loop over spectra periods
+        // loop over spectra periods, all evaluated in one pass
         cout << "Calculating spectra..." << '\n';
         
         getline(deck, line);
+        vector<pair<double, double>> windows;
         while (line != "END" && line != "END\r") {
-            vector <string> parts = split(line, ',');
-            double t1 = stod(parts[0]);
-            double t2 = stod(parts[1]);
+            split_view(line, ',', parts, 2);
+            double t1 = to_double(parts[0]);
+            double t2 = to_double(parts[1]);
             products.add_count(t1, t2);
-            products.batch_spectrum_all(t1, t2, t_irrad);
+            windows.emplace_back(t1, t2);
             getline(deck, line);
         }
+        products.batch_spectrum_windows(windows, t_irrad);
         deck.close();
         // output chains
         if (chains_out != "NONE") {
             cout << "Writing chains file..." << '\n';
-            chains.save_chains(chains_out);
+            chains->save_chains(chains_out);
         }
 
         // output stems
         if (stems_out != "NONE") {
             cout << "Writing stems file..." << '\n';
-            chains.save_stems(stems_out);
+            chains->save_stems(stems_out);
         }
         // if in SINGLE mode output data, else run MONTECARLO mode
         if (n_trials == 0) {
@@ -303,7 +696,7 @@ int main(int argc, char *argv[]) {
 
         } else {
         // import calculated data
-        MC.import_species_data(data);
+        MC.import_species_data(nuclear_data);
         MC.import_chains_data(chains);
         MC.import_centroid_data(products);
         // run trials
@@ -11,19 +11,19 @@
 // function to import original nuclear data class
 /** Imports original nuclear data.
  *
- * @param data_in species_data object containing nuclear data.
+ * @param data_in species_data object containing nuclear data, shared with the other classes.
  */
-void monte_carlo::import_species_data(species_data data_in) {
+void monte_carlo::import_species_data(shared_ptr<const species_data> data_in) {
     original_data = data_in;
 }
 // function to import chains data
 /** Imports decay stem/chains data.
  *
- * @param chains_in chains_data object containing stem/chains data.
+ * @param chains_in chains_data object containing stem/chains data, shared with the other classes.
  */
-void monte_carlo::import_chains_data(chains_data chains_in) {
+void monte_carlo::import_chains_data(shared_ptr<const chains_data> chains_in) {
     chains = chains_in;
-    products = chains.get_products();
+    products = chains->get_products();
 }
 // function to import centroid product data
 /** Imports product data of the centroid.
@@ -53,35 +53,26 @@ void monte_carlo::run_trials(int n_trials_in) {
             cout << "   Trial No. " << i << '\n';
         }
 
-        varied_data = original_data.gaussian_sample();
-        chains.update_stems(varied_data);
+        // the trial shares the isotope table and chain set, and only owns the varied values
+        auto varied_data = make_shared<const species_data>(original_data->gaussian_sample());
+        auto varied_chains = make_shared<chains_data>(*chains);
+        varied_chains->update_stems(varied_data);
         // update product_data fields and initialize populations
         product_data trial_cur;
         trial_cur.import_species_data(varied_data);
-        trial_cur.import_chains_data(chains);
+        trial_cur.import_chains_data(varied_chains);
+        trial_cur.set_solver(centroid_data.get_solver());
         trial_cur.initialize(centroid_data.get_initial());
         // populations from irradiation
-        double t_last = 0.0;
-        double t_irrad = 0.0;
-        for (auto &j : irrad_scheme) {
-            double t_cur = get<0>(j);
-            double P = get<1>(j);
-            trial_cur.batch_decay_all(t_cur, t_last);
-            trial_cur.cont_prod_all(P, t_cur, t_last);
-            t_last = t_cur;
-            t_irrad = t_cur;
-        }
+        trial_cur.irradiate(irrad_scheme);
+        double t_irrad = irrad_scheme.empty() ? 0.0 : get<0>(irrad_scheme.back());
         // populations after irradiation
-        for (double t_cur : after_irrad) {
-            trial_cur.batch_decay_all(t_cur, t_irrad);
-        }
+        trial_cur.batch_decay_times(after_irrad, t_irrad);
         // spectrum calculation
         for (auto &j : count_scheme) {
-            double t1 = get<0>(j);
-            double t2 = get<1>(j);
-            trial_cur.add_count(t1, t2);
-            trial_cur.batch_spectrum_all(t1, t2, t_irrad);
+            trial_cur.add_count(get<0>(j), get<1>(j));
         }
+        trial_cur.batch_spectrum_windows(count_scheme, t_irrad);
         trials.push_back(trial_cur);
     }
 }
@@ -89,61 +80,71 @@ void monte_carlo::run_trials(int n_trials_in) {
 /** Calcuates the standard deviation of all trials. This is saved into POPULATIONS_STDEV and SPECTRA_STDEV.
  */
 void monte_carlo::calculate_stdevs() {
-    // calculate stdevs for populations from irradiation
+    // calculate stdevs for populations from irradiation and after irradiation
+    vector<double> times;
     for (auto &i : irrad_scheme) {
-        double t_cur = get<0>(i);
-        for (int product : products) {
-            double avg = 0.0;
-            for (int k = 0; k < n_trials; ++k) {
-                avg = avg + trials[k].get_population(product, t_cur);
-            }
-            avg = avg / n_trials;
-            double nsum = 0.0;
+        times.push_back(get<0>(i));
+    }
+    times.insert(times.end(), after_irrad.begin(), after_irrad.end());
+    // every trial is built the same way, so their population columns line up with those of the first trial
+    vector<int> cols;
+    for (int product : products) {
+        populations_stdev.add_product(product);
+        cols.push_back(trials.empty() ? -1 : trials[0].get_populations().find_product(product));
+    }
+    vector<int> trial_rows(n_trials);
+    vector<double> pops(n_trials);
+    for (double t_cur : times) {
+        int row = populations_stdev.add_time(t_cur);
+        for (int k = 0; k < n_trials; ++k) {
+            trial_rows[k] = trials[k].get_populations().find_time(t_cur);
+        }
+        for (int p = 0; p < products.size(); ++p) {
             for (int k = 0; k < n_trials; ++k) {
-                nsum = nsum + (trials[k].get_population(product, t_cur) - avg) *
-                              (trials[k].get_population(product, t_cur) - avg);
+                bool missing = trial_rows[k] < 0 || cols[p] < 0;
+                pops[k] = missing ? 0.0 : trials[k].get_populations().at(trial_rows[k], cols[p]);
             }
-            double variance = nsum / n_trials;
-            double stdev = sqrt(variance);
-            populations_stdev[t_cur][product] = stdev;
-        }
-    }
-    // calculate stdevs for populations after irradiation
-    for (double t_cur : after_irrad) {
-        for (int product : products) {
             double avg = 0.0;
             for (int k = 0; k < n_trials; ++k) {
-                avg = avg + trials[k].get_population(product, t_cur);
+                avg = avg + pops[k];
             }
             avg = avg / n_trials;
             double nsum = 0.0;
             for (int k = 0; k < n_trials; ++k) {
-                nsum = nsum + (trials[k].get_population(product, t_cur) - avg) *
-                              (trials[k].get_population(product, t_cur) - avg);
+                nsum = nsum + (pops[k] - avg) * (pops[k] - avg);
             }
             double variance = nsum / n_trials;
             double stdev = sqrt(variance);
-            populations_stdev[t_cur][product] = stdev;
+            populations_stdev.at(row, populations_stdev.find_product(products[p])) = stdev;
         }
     }
     // calculate stdevs for gamma spectra
+    spectra_stdev = spectrum_matrix(original_data->n_gamma_lines());
+    vector<double> emissions(n_trials);
     for (auto t_key : count_scheme) {
+        int row = spectra_stdev.add_window(t_key);
+        for (int k = 0; k < n_trials; ++k) {
+            trial_rows[k] = trials[k].get_spectra().find_window(t_key);
+        }
         for (int product : products) {
-            for (int g = 0; g < original_data.n_gammas(product); ++g) {
+            int id = original_data->get_id(product);
+            for (int g = 0; g < original_data->n_gammas(product); ++g) {
+                int line = original_data->get_gamma_line_id(id, g);
+                for (int k = 0; k < n_trials; ++k) {
+                    emissions[k] = (trial_rows[k] < 0) ? 0.0 : trials[k].get_spectra().at(trial_rows[k], line);
+                }
                 double avg = 0.0;
-                double Eg = original_data.get_gamma_energy(product, g);
                 for (int k = 0; k < n_trials; ++k) {
-                    avg = avg + trials[k].get_emissions(product, t_key, Eg);
+                    avg = avg + emissions[k];
                 }
                 avg = avg / n_trials;
                 double nsum = 0.0;
                 for (int k = 0; k < n_trials; ++k) {
-                    nsum = nsum + (trials[k].get_emissions(product, t_key, Eg) - avg) *
-                                  (trials[k].get_emissions(product, t_key, Eg) - avg);
+                    nsum = nsum + (emissions[k] - avg) * (emissions[k] - avg);
                 }
                 double variance = nsum / n_trials;
                 double stdev = sqrt(variance);
-                spectra_stdev[t_key][product][Eg] = stdev;
+                spectra_stdev.at(row, line) = stdev;
             }
         }
     }
@@ -156,8 +157,7 @@ void monte_carlo::calculate_stdevs() {
 void monte_carlo::save_populations(string pops_out) {
     ofstream pops_file;
     pops_file.open(pops_out);
-    vector<double> times = get_keys(populations);
-    sort(times.begin(), times.end());
+    vector<double> times = populations.get_times();
     sort(products.begin(), products.end());
     pops_file << 'Z';
     for (int product : products) {
@@ -180,24 +180,26 @@ void monte_carlo::save_populations(string pops_out) {
     pops_file << "t_1/2";
     cout.precision(5);
     for (int product : products) {
-        pops_file << ',' << original_data.get_halflife(product) << scientific;
+        pops_file << ',' << original_data->get_halflife(product) << scientific;
     }
     pops_file << '\n';
     pops_file << "t (s) / E (keV)";
     cout.precision(5);
     for (int product : products) {
-        pops_file << ',' << original_data.get_energy(product) << scientific;
+        pops_file << ',' << original_data->get_energy(product) << scientific;
     }
     pops_file << '\n';
     for (double time : times) {
+        int row = populations.find_time(time);
+        int stdev_row = populations_stdev.find_time(time);
         pops_file << time;
         for (int product : products) {
-            pops_file << ',' << populations[time][product];
+            pops_file << ',' << populations.get(row, product);
         }
         pops_file << '\n';
         pops_file << "UNC:";
         for (int product : products) {
-            pops_file << ',' << populations_stdev[time][product];
+            pops_file << ',' << ((stdev_row < 0) ? 0.0 : populations_stdev.get(stdev_row, product));
         }
         pops_file << '\n';
     }
@@ -210,13 +212,12 @@ void monte_carlo::save_populations(string pops_out) {
 void monte_carlo::save_spectra(string gammas_out) {
     ofstream gammas_file;
     gammas_file.open(gammas_out);
-    vector <pair<double, double>> times = get_keys(spectra);
-    sort(times.begin(), times.end());
+    vector <pair<double, double>> times = spectra.get_windows();
     sort(products.begin(), products.end());
     gammas_file << ",Z";
     for (int product : products) {
         int Z = product / 10000;
-        for (int j = 0; j < original_data.n_gammas(product); ++j) {
+        for (int j = 0; j < original_data->n_gammas(product); ++j) {
             gammas_file << ',' << Z;
         }
     }
@@ -226,7 +227,7 @@ void monte_carlo::save_spectra(string gammas_out) {
         int Z = product / 10000;
         int I = (product - Z * 10000) / 1000;
         int A = product - Z * 10000 - I * 1000;
-        for (int j = 0; j < original_data.n_gammas(product); ++j) {
+        for (int j = 0; j < original_data->n_gammas(product); ++j) {
             gammas_file << ',' << A;
         }
     }
@@ -235,46 +236,49 @@ void monte_carlo::save_spectra(string gammas_out) {
     for (int product : products) {
         int Z = product / 10000;
         int I = (product - Z * 10000) / 1000;
-        for (int j = 0; j < original_data.n_gammas(product); ++j) {
+        for (int j = 0; j < original_data->n_gammas(product); ++j) {
             gammas_file << ',' << I;
         }
     }
     gammas_file << '\n';
     gammas_file << ",t_1/2";
     for (int product : products) {
-        for (int j = 0; j < original_data.n_gammas(product); ++j) {
-            gammas_file << ',' << original_data.get_halflife(product);
+        for (int j = 0; j < original_data->n_gammas(product); ++j) {
+            gammas_file << ',' << original_data->get_halflife(product);
         }
     }
     gammas_file << '\n';
     gammas_file << ",E_level (keV)";
     for (int product : products) {
-        for (int j = 0; j < original_data.n_gammas(product); ++j) {
-            gammas_file << ',' << original_data.get_energy(product);
+        for (int j = 0; j < original_data->n_gammas(product); ++j) {
+            gammas_file << ',' << original_data->get_energy(product);
         }
     }
     gammas_file << '\n';
     gammas_file << "t0 (s),t1 (s)/E_gamma (keV)";
     for (int product : products) {
-        for (int j = 0; j < original_data.n_gammas(product); ++j) {
-            gammas_file << ',' << original_data.get_gamma_energy(product, j);
+        for (int j = 0; j < original_data->n_gammas(product); ++j) {
+            gammas_file << ',' << original_data->get_gamma_energy(product, j);
         }
     }
     gammas_file << '\n';
     for (auto &time : times) {
+        int row = spectra.find_window(time);
+        int stdev_row = spectra_stdev.find_window(time);
         gammas_file << get<0>(time) << ',' << get<1>(time);
         for (int product : products) {
-            for (int k = 0; k < original_data.n_gammas(product); ++k) {
-                gammas_file << ','
-                            << spectra[time][product][original_data.get_gamma_energy(product, k)];
+            int id = original_data->get_id(product);
+            for (int k = 0; k < original_data->n_gammas(product); ++k) {
+                gammas_file << ',' << spectra.at(row, original_data->get_gamma_line_id(id, k));
             }
         }
         gammas_file << '\n';
         gammas_file << ",UNC:";
         for (int product : products) {
-            for (int k = 0; k < original_data.n_gammas(product); ++k) {
-                gammas_file << ','
-                            << spectra_stdev[time][product][original_data.get_gamma_energy(product, k)];
+            int id = original_data->get_id(product);
+            for (int k = 0; k < original_data->n_gammas(product); ++k) {
+                int line = original_data->get_gamma_line_id(id, k);
+                gammas_file << ',' << ((stdev_row < 0) ? 0.0 : spectra_stdev.at(stdev_row, line));
             }
         }
         gammas_file << '\n';
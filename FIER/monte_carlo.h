@@ -10,12 +10,10 @@
  * the results of these trials is printed in the population and gamma spectrum output files.
  */
 class monte_carlo {
-    /** Species data derived from earlier in the program.*/
-    species_data original_data;
-    /** Gaussian sampled variation on ORIGINAL_DATA.*/
-    species_data varied_data;
-    /** Object that holds decay chains and stems.*/
-    chains_data chains;
+    /** Species data derived from earlier in the program, shared with the other classes.*/
+    shared_ptr<const species_data> original_data;
+    /** Object that holds decay chains and stems, shared with the other classes.*/
+    shared_ptr<const chains_data> chains;
     /** A list of decay products.*/
     vector<int> products;
     /** Class that holds product data generated from ORIGINAL_DATA.*/
@@ -23,28 +21,28 @@ class monte_carlo {
     /** A list of product data results for each trial.*/
     vector <product_data> trials;
     /** Irradiation scheme.*/
-    vector <pair<double, double>> irrad_scheme;
+    vector <tuple<double, double, double>> irrad_scheme;
     /** Times to sample after irradiation.*/
     vector<double> after_irrad;
     /** Count scheme.*/
     vector <pair<double, double>> count_scheme;
     /** Populations of each product.*/
-    map<double, map<int, double> > populations;
+    population_matrix populations;
     /** Gamma spectra of each product.*/
-    map <pair<double, double>, map<int, map < double, double>> > spectra;
+    spectrum_matrix spectra;
     /** Standard deviation of population for each product.*/
-    map<double, map<int, double> > populations_stdev;
+    population_matrix populations_stdev;
     /** Standard deviation of the gamma spectrum for each product.*/
-    map <pair<double, double>, map<int, map < double, double>> > spectra_stdev;
+    spectrum_matrix spectra_stdev;
     /** Number of trials to run.*/
     int n_trials;
 
 public:
 
 
-    void import_species_data(species_data data_in);
+    void import_species_data(shared_ptr<const species_data> data_in);
 
-    void import_chains_data(chains_data chains_in);
+    void import_chains_data(shared_ptr<const chains_data> chains_in);
 
     void import_centroid_data(product_data products_in);
 
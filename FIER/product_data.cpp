@@ -8,32 +8,265 @@
 
 #include "product_data.h"
 
+/** Finds the row of time T, adding a row of zeros if there is none.
+ *
+ * @param t Time in seconds.
+ * @return Row of T.
+ */
+int population_matrix::add_time(double t) {
+    auto it = time_rows.find(t);
+    if (it != time_rows.end()) {
+        return it->second;
+    }
+    int row = static_cast<int>(time_rows.size());
+    time_rows[t] = row;
+    values.resize(values.size() + column_products.size(), 0.0);
+    return row;
+}
+
+/** Finds the column of isotope IZA, adding a column of zeros if there is none.
+ *
+ * @param iZA Unique isotope hash.
+ * @return Column of IZA.
+ */
+int population_matrix::add_product(int iZA) {
+    auto it = product_columns.find(iZA);
+    if (it != product_columns.end()) {
+        return it->second;
+    }
+    int col = static_cast<int>(column_products.size());
+    product_columns[iZA] = col;
+    column_products.push_back(iZA);
+    if (!values.empty()) {
+        // widen every row by one column
+        size_t n_rows = time_rows.size();
+        vector<double> widened(n_rows * (col + 1), 0.0);
+        for (size_t row = 0; row < n_rows; ++row) {
+            copy(values.begin() + row * col, values.begin() + (row + 1) * col, widened.begin() + row * (col + 1));
+        }
+        values = move(widened);
+    }
+    return col;
+}
+
+/** Finds the row of time T.
+ *
+ * @param t Time in seconds.
+ * @return Row of T, -1 if there is none.
+ */
+int population_matrix::find_time(double t) const {
+    auto it = time_rows.find(t);
+    return (it == time_rows.end()) ? -1 : it->second;
+}
+
+/** Finds the column of isotope IZA.
+ *
+ * @param iZA Unique isotope hash.
+ * @return Column of IZA, -1 if there is none.
+ */
+int population_matrix::find_product(int iZA) const {
+    auto it = product_columns.find(iZA);
+    return (it == product_columns.end()) ? -1 : it->second;
+}
+
+/** Times of all rows.
+ *
+ * @return Times in ascending order.
+ */
+vector<double> population_matrix::get_times() const {
+    vector<double> times;
+    for (auto &it : time_rows) {
+        times.push_back(it.first);
+    }
+    return times;
+}
+
+/** Population of isotope IZA in ROW.
+ *
+ * @param row Row of the time.
+ * @param iZA Unique isotope hash.
+ * @return Population, 0.0 if IZA has no column.
+ */
+double population_matrix::get(int row, int iZA) const {
+    int col = find_product(iZA);
+    return (col < 0) ? 0.0 : at(row, col);
+}
+
+/** Population of isotope IZA at time T.
+ *
+ * @param iZA Unique isotope hash.
+ * @param t Time in seconds.
+ * @return Population, 0.0 if there is no entry for IZA at T.
+ */
+double population_matrix::get(int iZA, double t) const {
+    int row = find_time(t);
+    return (row < 0) ? 0.0 : get(row, iZA);
+}
+
+/** Finds the row of count window WINDOW, adding a row of zeros if there is none.
+ *
+ * @param window Pair of times (seconds) that bound the count.
+ * @return Row of WINDOW.
+ */
+int spectrum_matrix::add_window(pair<double, double> window) {
+    auto it = window_rows.find(window);
+    if (it != window_rows.end()) {
+        return it->second;
+    }
+    int row = static_cast<int>(window_rows.size());
+    window_rows[window] = row;
+    values.resize(values.size() + n_lines, 0.0);
+    return row;
+}
+
+/** Makes room for N_MORE rows after those there are, so adding that many count windows one at a time does not move
+ * the rows already added.
+ *
+ * @param n_more Number of rows to make room for.
+ */
+void spectrum_matrix::reserve_windows(int n_more) {
+    values.reserve(values.size() + static_cast<size_t>(n_more) * n_lines);
+}
+
+/** Finds the row of count window WINDOW.
+ *
+ * @param window Pair of times (seconds) that bound the count.
+ * @return Row of WINDOW, -1 if there is none.
+ */
+int spectrum_matrix::find_window(pair<double, double> window) const {
+    auto it = window_rows.find(window);
+    return (it == window_rows.end()) ? -1 : it->second;
+}
+
+/** Count windows of all rows.
+ *
+ * @return Count windows in ascending order.
+ */
+vector<pair<double, double>> spectrum_matrix::get_windows() const {
+    vector<pair<double, double>> windows;
+    for (auto &it : window_rows) {
+        windows.push_back(it.first);
+    }
+    return windows;
+}
+
 /** Imports species data from external class.
- * @param data_in species_data object being imported.
+ * @param data_in species_data object being imported, shared with the other classes.
  */
-void product_data::import_species_data(species_data data_in) {
+void product_data::import_species_data(shared_ptr<const species_data> data_in) {
     data = data_in;
+    spectra = spectrum_matrix(data->n_gamma_lines());
 }
 
 /** Imports chains data from external class.
- * @param chains_in chains_data object being imported.
+ * @param chains_in chains_data object being imported, shared with the other classes.
  */
-void product_data::import_chains_data(chains_data chains_in) {
+void product_data::import_chains_data(shared_ptr<const chains_data> chains_in) {
     chains = chains_in;
-    products = chains.get_products();
+    products = chains->get_products();
+    for (int product : products) {
+        populations.add_product(product);
+    }
+}
+
+/** Sets the number of threads the Bateman kernels and the loops over every product run on. Each stem sum and each
+ * product total is computed the same way on any thread, so the results do not depend on N_THREADS.
+ *
+ * @param n_threads Number of threads, 0 for one per hardware thread.
+ */
+void product_data::set_threads(int n_threads) {
+    n_threads = worker_threads(n_threads);
+    pool = (n_threads > 1) ? make_shared<thread_pool>(n_threads) : nullptr;
+}
+
+/** Selects how populations and spectra are calculated: STEMS sums Bateman solutions over the decay stems of
+ * chains_data, CRAM advances every isotope of the species data with cram_solver, and EXPSUM propagates sums of
+ * exponentials down the graph of the stems with expsum_solver. Species data, and for EXPSUM chains data, must be
+ * imported first.
+ *
+ * @param name STEMS, CRAM or EXPSUM.
+ * @return FALSE if NAME is not a solver.
+ */
+bool product_data::set_solver(const string &name) {
+    if (name != "STEMS" && name != "CRAM" && name != "EXPSUM") {
+        return false;
+    }
+    cram = (name == "CRAM") ? make_shared<const cram_solver>(data) : nullptr;
+    expsums = (name == "EXPSUM") ? make_shared<const expsum_solver>(data, *chains) : nullptr;
+    return true;
+}
+
+/** @return Name of the solver set_solver selected.*/
+string product_data::get_solver() const {
+    return cram ? "CRAM" : (expsums ? "EXPSUM" : "STEMS");
+}
+
+/** Gathers the populations of a row of POPULATIONS by isotope ID, for cram_solver.
+ *
+ * @param row Row of POPULATIONS.
+ * @return Population of each isotope ID, 0.0 for isotopes with no column.
+ */
+vector<double> product_data::isotope_populations(int row) const {
+    vector<double> res(data->n_isotopes(), 0.0);
+    const vector<int> &columns = populations.get_products();
+    for (int col = 0; col < columns.size(); ++col) {
+        int id = data->get_id(columns[col]);
+        if (id >= 0) {
+            res[id] = populations.at(row, col);
+        }
+    }
+    return res;
+}
+
+/** Adds the population of every product in TOTALS, by isotope ID, to its population at T, as add_totals does for
+ * the stems.
+ *
+ * @param t Time in seconds.
+ * @param totals Population of each isotope ID.
+ */
+void product_data::add_isotope_totals(double t, const vector<double> &totals) {
+    for (int product : products) {
+        int col = populations.add_product(product);
+        populations.at(populations.add_time(t), col) += totals[data->get_id(product)];
+    }
+}
+
+/** Adds the emissions of every product in the count window from T1 to T2 to SPECTRA, from the populations of the
+ * EXPSUM solver integrated over the window.
+ *
+ * @param t1 Lower time of interval.
+ * @param t2 Upper time of interval.
+ * @param sums Populations from T0 as sums of exponentials.
+ * @param t0 Offset from 0 (irradiation end time).
+ */
+void product_data::add_isotope_spectra(double t1, double t2, const expsum_solver::expansion &sums, double t0) {
+    vector<double> integral = expsums->integrate(sums, t1 - t0, t2 - t0);
+    for (int product : products) {
+        int id = data->get_id(product);
+        add_spectrum(product, data->get_DC_id(id) * integral[id], t1, t2, true);
+    }
 }
 
 /** Imports the initial species population from a map.
  * @param init_pops Initial population configuration as a map of isotopes and quantites.
  */
 void product_data::initialize(map<int, double> init_pops) {
-    populations[0.0] = init_pops;
+    for (auto &it : init_pops) {
+        populations.add_product(it.first);
+    }
+    int row = populations.add_time(0.0);
+    for (int col = 0; col < populations.n_products(); ++col) {
+        populations.at(row, col) = 0.0;
+    }
+    for (auto &it : init_pops) {
+        populations.at(row, populations.find_product(it.first)) = it.second;
+    }
 }
 
 /** Accesses the entire population field.
  * @return this.POPULATIONS
  */
-map<double, map<int, double> > product_data::get_populations() {
+const population_matrix &product_data::get_populations() const {
     return populations;
 }
 
@@ -44,7 +277,8 @@ map<double, map<int, double> > product_data::get_populations() {
  * @param pop_in Population value to be set.
  */
 void product_data::set_population(int iZA, double t, double pop_in) {
-    populations[t][iZA] = pop_in;
+    int col = populations.add_product(iZA);
+    populations.at(populations.add_time(t), col) = pop_in;
     if (not_in(iZA, products)) {
         products.push_back(iZA);
     }
@@ -56,15 +290,7 @@ void product_data::set_population(int iZA, double t, double pop_in) {
  * @return Population at time T.
  */
 double product_data::get_population(int iZA, double t) {
-	double res = 0.0; //if the element doesn't exist, 0.0 will be returned
-	//check if element exists
-	//if ( populations.find(t) != populations.end() && populations[t].find(iZA) != populations[t].end() ) {
-	if ( populations.count(t) > 0 ) {
-		if( populations[t].count(iZA) > 0 ) {
-			res = populations[t][iZA]; //it exists, return the population
-		}
-	}
-    return res;
+    return populations.get(iZA, t); //if the element doesn't exist, 0.0 will be returned
 }
 
 /** Retrieves gamma emissions from SPECTRA for isotope IZA in a particular time bin (between T1,T2)
@@ -77,7 +303,7 @@ double product_data::get_population(int iZA, double t) {
  * @return Gamma emissions.
  */
 double product_data::get_emissions(int iZA, double t1, double t2, double Eg) {
-    return spectra[make_pair(t1, t2)][iZA][Eg];
+    return get_emissions(iZA, make_pair(t1, t2), Eg);
 }
 
 /** Retrieves gamma emissions from SPECTRA for isotope IZA in a particular time bin represented as a pair
@@ -86,16 +312,26 @@ double product_data::get_emissions(int iZA, double t1, double t2, double Eg) {
  * @param iZA Unique isotope hash.
  * @param t_key Pair of times (seconds) that represents the interval of the time bin.
  * @param Eg Energy to retrieve from.
- * @return Gamma emissions.
+ * @return Gamma emissions, summed over the lines of IZA at energy EG.
  */
 double product_data::get_emissions(int iZA, pair<double, double> t_key, double Eg) {
-    return spectra[t_key][iZA][Eg];
+    double res = 0.0;
+    int row = spectra.find_window(t_key);
+    int id = data->get_id(iZA);
+    if (row >= 0 && id >= 0) {
+        for (int j = 0; j < data->n_gammas_id(id); ++j) {
+            if (data->get_gamma_energy_id(id, j) == Eg) {
+                res = res + spectra.at(row, data->get_gamma_line_id(id, j));
+            }
+        }
+    }
+    return res;
 }
 
 /** Retrieves gamma spectrum from SPECTRUM.
  * @return Entire gamma spectrum.
  */
-map<pair<double, double>,map<int,map<double,double>>> product_data::get_spectra() {
+const spectrum_matrix &product_data::get_spectra() const {
     return spectra;
 }
 
@@ -105,14 +341,25 @@ map<pair<double, double>,map<int,map<double,double>>> product_data::get_spectra(
  * @param P Fissions/Second.
  */
 void product_data::add_irrad(double t, double P) {
-    irrad_scheme.emplace_back(t, P);
+    irrad_scheme.emplace_back(t, P, P);
+}
+
+/** Adds an irradiation step whose fission rate changes linearly from P at its start to P_END at time T to the list
+ * of all irradiation schemes IRRAD_SCHEME.
+ *
+ * @param t Irradiation time (seconds)
+ * @param P Fissions/Second at the start of the step.
+ * @param P_end Fissions/Second at T.
+ */
+void product_data::add_irrad(double t, double P, double P_end) {
+    irrad_scheme.emplace_back(t, P, P_end);
 }
 
 /** Accesses the entire irradiation scheme.
  *
  * @return IRRAD_SCHEME field.
  */
-vector <pair<double, double>> product_data::get_irrad_scheme() {
+vector <tuple<double, double, double>> product_data::get_irrad_scheme() {
     return irrad_scheme;
 }
 
@@ -155,46 +402,178 @@ vector <pair<double, double>> product_data::get_count_scheme() {
  * @return POPULATIONS[0.0].
  */
 map<int, double> product_data::get_initial() {
-    return populations[0.0];
+    map<int, double> init_pops;
+    int row = populations.add_time(0.0);
+    for (int product : populations.get_products()) {
+        init_pops[product] = populations.get(row, product);
+    }
+    return init_pops;
 }
 
-/** Calculates the population after decay using batch decay solution with a decay stem.
+/** Adds up the contributions in NODE_VALUES of the stems of IZA, in the order of the stems.
  *
- * @param stem Decay stem.
- * @param stem_dcs Stem decay constants.
- * @param stem_brs Stem branching ratio.
- * @param t1 Final time (seconds).
- * @param t0 Initial time (default 0).
- * @return Population at time t1 for the given stem.
+ * @param iZA Unique isotope hash.
+ * @return Sum over the stems of IZA (0.0 if it has none).
  */
-double product_data::batch_decay_stem(vector<int> &stem, vector<double> &stem_dcs, vector<double> &stem_brs, double t1,
-                        double t0 = 0.0) {
+double product_data::stems_total(int iZA) const {
+    const chains_data::stem_trie &trie = chains->get_stem_trie();
     double res = 0.0;
-    double N0 = populations[t0][stem[0]];
-    double dt = t1 - t0;
-    auto n = static_cast<int>(stem.size());
-    if (N0 != 0.0) {
-        double left = N0;
-        for (int q = 0; q < n - 1; ++q) {
-            left = left * stem_brs[q + 1] * stem_dcs[q];
-        }
-
-        double right = 0.0;
-        for (int j = 0; j < n; ++j) {
-            double numer = exp(-1.0 * stem_dcs[j] * dt);
-            double denom = 1.0;
-            for (int k = 0; k < n; ++k) {
-                if (k != j) {
-                    denom = denom * (stem_dcs[k] - stem_dcs[j]);
-                }
-            }
-            right = right + (numer / denom);
-        }
-        res = left * right;
+    for (int node : trie.stems_of(iZA)) {
+        res = res + node_values[node];
     }
     return res;
 }
 
+/** Fills FACTORS with exp(-DC * DT) for each distinct stem decay constant, in one pass over
+ * chains_data::get_rate_dcs. The stem kernels look their exponentials up here, so a time step takes one exp per
+ * decay constant rather than one per stem entry.
+ *
+ * @param factors Table to fill, resized to the number of distinct decay constants.
+ * @param dt Time step (seconds).
+ */
+void product_data::fill_decay_factors(vector<double> &factors, double dt) const {
+    const vector<double> &rate_dcs = chains->get_rate_dcs();
+    factors.resize(rate_dcs.size());
+    for (size_t i = 0; i < rate_dcs.size(); ++i) {
+        factors[i] = exp(-1.0 * rate_dcs[i] * dt);
+    }
+}
+
+/** Fills GROWTH_FACTORS with 1 - DECAY_FACTORS.*/
+void product_data::fill_growth_factors() {
+    growth_factors.resize(decay_factors.size());
+    for (size_t i = 0; i < decay_factors.size(); ++i) {
+        growth_factors[i] = 1.0 - decay_factors[i];
+    }
+}
+
+/** Fills RAMP_FACTORS with (DC * DT - (1 - exp(-DC * DT))) / DC for each distinct stem decay constant, the
+ * GROWTH_FACTORS of a production rate that rises linearly from zero. Where DC * DT is small the difference loses
+ * the digits its two terms share, so it is taken from its series instead.
+ *
+ * @param dt Time step (seconds).
+ */
+void product_data::fill_ramp_factors(double dt) {
+    const vector<double> &rate_dcs = chains->get_rate_dcs();
+    ramp_factors.resize(rate_dcs.size());
+    for (size_t i = 0; i < rate_dcs.size(); ++i) {
+        double x = rate_dcs[i] * dt;
+        double ramp = (x < 1.0e-3) ? x * x * (0.5 - x * (1.0 / 6.0 - x * (1.0 / 24.0 - x / 120.0)))
+                                   : x + expm1(-1.0 * x);
+        ramp_factors[i] = (rate_dcs[i] == 0.0) ? 0.0 : ramp / rate_dcs[i];
+    }
+}
+
+/** Fills TABLES with the exp(-DC * DT) table of fill_decay_factors for each time step of DTS, one after another.
+ *
+ * @param tables Tables to fill, resized to the number of distinct decay constants times the size of DTS.
+ * @param dts Time steps (seconds).
+ */
+void product_data::fill_decay_tables(vector<double> &tables, const vector<double> &dts) const {
+    const vector<double> &rate_dcs = chains->get_rate_dcs();
+    tables.resize(rate_dcs.size() * dts.size());
+    for (size_t t = 0; t < dts.size(); ++t) {
+        double *table = tables.data() + t * rate_dcs.size();
+        for (size_t i = 0; i < rate_dcs.size(); ++i) {
+            table[i] = exp(-1.0 * rate_dcs[i] * dts[t]);
+        }
+    }
+}
+
+/** Fills TABLES as fill_decay_tables would for the N_STEPS time steps DT_FIRST + K * STEP, with exp(-DC * STEP)
+ * found once and each table after the first the one before it times that factor.
+ *
+ * @param tables Tables to fill, resized to the number of distinct decay constants times N_STEPS.
+ * @param dt_first First time step (seconds).
+ * @param step Spacing of the time steps (seconds).
+ * @param n_steps Number of time steps.
+ */
+void product_data::fill_decay_steps(vector<double> &tables, double dt_first, double step, int n_steps) const {
+    const vector<double> &rate_dcs = chains->get_rate_dcs();
+    size_t table_size = rate_dcs.size();
+    tables.resize(table_size * n_steps);
+    vector<double> factors(table_size);
+    for (size_t i = 0; i < table_size; ++i) {
+        tables[i] = exp(-1.0 * rate_dcs[i] * dt_first);
+        factors[i] = exp(-1.0 * rate_dcs[i] * step);
+    }
+    for (size_t t = 1; t < static_cast<size_t>(n_steps); ++t) {
+        const double *last = tables.data() + (t - 1) * table_size;
+        double *table = tables.data() + t * table_size;
+        for (size_t i = 0; i < table_size; ++i) {
+            table[i] = last[i] * factors[i];
+        }
+    }
+}
+
+/** Groups PASS_NODES into BUCKET_NODES by stem length with a counting sort, so that each length up to
+ * SPECIALIZED_STEM_LENGTH goes through the kernel unrolled for it. Nodes keep their order within a bucket. Each
+ * bucket is then cut into chunks of at most PASS_CHUNK nodes, the tasks the kernels run as.
+ */
+void product_data::bucket_pass() {
+    const chains_data::stem_trie &trie = chains->get_stem_trie();
+    bucket_offsets.assign(SPECIALIZED_STEM_LENGTH + 2, 0);
+    for (int node : pass_nodes) {
+        int length = trie.lengths[node];
+        bucket_offsets[(length <= SPECIALIZED_STEM_LENGTH) ? length + 1 : 1] += 1;
+    }
+    for (int length = 0; length <= SPECIALIZED_STEM_LENGTH; ++length) {
+        bucket_offsets[length + 1] += bucket_offsets[length];
+    }
+    int filled[SPECIALIZED_STEM_LENGTH + 1];
+    copy(bucket_offsets.begin(), bucket_offsets.end() - 1, filled);
+    bucket_nodes.resize(pass_nodes.size());
+    bucket_order.resize(pass_nodes.size());
+    bucket_sums.resize(pass_nodes.size());
+    for (int k = 0; k < pass_nodes.size(); ++k) {
+        int length = trie.lengths[pass_nodes[k]];
+        int i = filled[(length <= SPECIALIZED_STEM_LENGTH) ? length : 0]++;
+        bucket_nodes[i] = pass_nodes[k];
+        bucket_order[i] = k;
+    }
+    chunk_firsts.clear();
+    chunk_lengths.clear();
+    for (int length = 0; length <= SPECIALIZED_STEM_LENGTH; ++length) {
+        for (int first = bucket_offsets[length]; first < bucket_offsets[length + 1]; first += PASS_CHUNK) {
+            chunk_firsts.push_back(first);
+            chunk_lengths.push_back(length);
+        }
+    }
+    chunk_firsts.push_back(static_cast<int>(pass_nodes.size()));
+}
+
+/** Copies BUCKET_SUMS back into PASS_SUMS, in the order of PASS_NODES.
+ *
+ * @param n_times Number of times the pass has sums for, stored one after another.
+ */
+void product_data::unbucket_pass(int n_times) {
+    size_t n_pass = pass_nodes.size();
+    pass_sums.resize(n_pass * n_times);
+    for (int t = 0; t < n_times; ++t) {
+        size_t first = t * n_pass;
+        for (size_t i = 0; i < n_pass; ++i) {
+            pass_sums[first + bucket_order[i]] = bucket_sums[first + i];
+        }
+    }
+}
+
+/** Sums the stems of PASS_NODES with the batch decay solution, from the Bateman coefficients chains_data computed
+ * for them and the exponentials in DECAY_FACTORS. Each sum is the population of the last isotope of a stem at the
+ * end of the time step, per unit population of its first isotope at the start. Fills PASS_SUMS.
+ */
+void product_data::batch_decay_pass() {
+    const bateman_kernels &kernels = active_kernels();
+    stem_arrays stems = chains->get_stem_arrays();
+    bucket_pass();
+    auto sums = [&](int chunk) {
+        int first = chunk_firsts[chunk];
+        kernels.batch_sums(stems, chunk_lengths[chunk], bucket_nodes.data() + first, chunk_firsts[chunk + 1] - first,
+                           decay_factors.data(), bucket_sums.data() + first);
+    };
+    run_tasks(static_cast<int>(chunk_lengths.size()), sums);
+    unbucket_pass();
+}
+
 /** Calculates the population of a given isotope (IZA) after decay using batch decay solution. Saved in
  * POPULATION[T1][IZA] field. Works by calculating the population for each stem and adding them up into the final
  * result.
@@ -206,80 +585,313 @@ double product_data::batch_decay_stem(vector<int> &stem, vector<double> &stem_dc
  * @return Population of IZA after T0.
  */
 double product_data::batch_decay(int iZA, double t1, double t0 = 0.0, bool add = true) {
+    const chains_data::stem_trie &trie = chains->get_stem_trie();
     double res = 0.0;
-    vector <vector<int>> stems = chains.get_stems(iZA);
-    vector <vector<double>> stems_dcs = chains.get_stems_dcs(iZA);
-    vector <vector<double>> stems_brs = chains.get_stems_brs(iZA);
+    array_view<int> stems = trie.stems_of(iZA);
 
-    for (int i = 0; i < stems.size(); ++i) {
-        res = res + batch_decay_stem(stems[i], stems_dcs[i], stems_brs[i], t1, t0);
+    if (stems.size() > 0) {
+        int row0 = populations.add_time(t0);
+        fill_decay_factors(decay_factors, t1 - t0);
+        pass_nodes.clear();
+        pass_scales.clear();
+        for (int node : stems) {
+            double N0 = populations.get(row0, trie.isotopes[trie.root_of[node]]);
+            if (N0 != 0.0) {
+                pass_nodes.push_back(node);
+                pass_scales.push_back(N0);
+            }
+        }
+        batch_decay_pass();
+        for (size_t k = 0; k < pass_nodes.size(); ++k) {
+            res = res + pass_scales[k] * pass_sums[k];
+        }
     }
 
     if (add) {
-        populations[t1][iZA] = res + get_population(iZA,t1);
+        int col = populations.add_product(iZA);
+        populations.at(populations.add_time(t1), col) += res;
     }
 
     return res;
 }
 
 /** Calculates the batch decay for every product at time T1 starting at T0. This is
- * saved into POPULATIONS field at POPULATIONS[T1][IZA].
+ * saved into POPULATIONS field at POPULATIONS[T1][IZA]. Walks the stem trie once, skipping the trees of first
+ * isotopes with no population at T0. With the CRAM or EXPSUM solver, every isotope is advanced from T0 to T1 at once
+ * instead.
  *
  * @param t1 Final time.
  * @param t0 Initial time (default = 0.0)
  */
 void product_data::batch_decay_all(double t1, double t0 = 0.0) {
+    if (cram) {
+        int row0 = populations.add_time(t0);
+        add_isotope_totals(t1, cram->advance(isotope_populations(row0), {}, t1 - t0));
+        return;
+    }
+    if (expsums) {
+        int row0 = populations.add_time(t0);
+        add_isotope_totals(t1, expsums->evaluate(expsums->expand(isotope_populations(row0), {}, 0.0), t1 - t0));
+        return;
+    }
+    const chains_data::stem_trie &trie = chains->get_stem_trie();
+    node_values.resize(trie.size());
+    if (trie.size() > 0) {
+        int row0 = populations.add_time(t0);
+        fill_decay_factors(decay_factors, t1 - t0);
+        pass_nodes.clear();
+        pass_scales.clear();
+        for (int root : trie.roots) {
+            double N0 = populations.get(row0, trie.isotopes[root]);
+            for (int node = root; node != -1; node = trie.next(node, root)) {
+                node_values[node] = 0.0;
+                if (N0 != 0.0) {
+                    pass_nodes.push_back(node);
+                    pass_scales.push_back(N0);
+                }
+            }
+        }
+        batch_decay_pass();
+        for (size_t k = 0; k < pass_nodes.size(); ++k) {
+            node_values[pass_nodes[k]] = pass_scales[k] * pass_sums[k];
+        }
+    }
+
+    add_totals(t1);
+}
+
+/** As batch_decay_pass, at N_TIMES times from the same start with their exponentials in DECAY_TABLES. The kernels
+ * read each stem once for all the times. Fills PASS_SUMS with the sums of each time after those of the time before.
+ *
+ * @param n_times Number of times.
+ */
+void product_data::batch_decay_times_pass(int n_times) {
+    const bateman_kernels &kernels = active_kernels();
+    stem_arrays stems = chains->get_stem_arrays();
+    bucket_pass();
+    auto n_pass = static_cast<int>(pass_nodes.size());
+    auto table_size = static_cast<int>(chains->get_rate_dcs().size());
+    bucket_sums.resize(static_cast<size_t>(n_pass) * n_times);
+    auto sums = [&](int chunk) {
+        int first = chunk_firsts[chunk];
+        kernels.batch_times_sums(stems, chunk_lengths[chunk], bucket_nodes.data() + first,
+                                 chunk_firsts[chunk + 1] - first, decay_tables.data(), n_times, table_size,
+                                 bucket_sums.data() + first, n_pass);
+    };
+    run_tasks(static_cast<int>(chunk_lengths.size()), sums);
+    unbucket_pass(n_times);
+}
+
+/** Sets NODE_VALUES to the contributions of the stems of PASS_NODES at one time of a multi-time pass, and 0.0 for
+ * every other node.
+ *
+ * @param time Index of the time in the pass.
+ */
+void product_data::set_node_values(int time) {
+    size_t first = static_cast<size_t>(time) * pass_nodes.size();
+    fill(node_values.begin(), node_values.end(), 0.0);
+    for (size_t k = 0; k < pass_nodes.size(); ++k) {
+        node_values[pass_nodes[k]] = pass_scales[k] * pass_sums[first + k];
+    }
+}
+
+/** Adds the total of the stems of every product in NODE_VALUES to its population at T. Each product has its own
+ * column of the row of T, so the products are split across POOL with no locking, and each total is the same sum
+ * in the same order whatever the number of threads.
+ *
+ * @param t Time in seconds.
+ */
+void product_data::add_totals(double t) {
+    if (products.empty()) {
+        return;
+    }
+    product_cols.resize(products.size());
+    for (size_t i = 0; i < products.size(); ++i) {
+        product_cols[i] = populations.add_product(products[i]);
+    }
+    int row = populations.add_time(t);
+    auto n_products = static_cast<int>(products.size());
+    auto totals = [&](int task) {
+        for (int i = task * PRODUCT_CHUNK; i < min(n_products, (task + 1) * PRODUCT_CHUNK); ++i) {
+            populations.at(row, product_cols[i]) += stems_total(products[i]);
+        }
+    };
+    run_tasks((n_products + PRODUCT_CHUNK - 1) / PRODUCT_CHUNK, totals);
+}
+
+/** Fills TOTALS with the total of the stems of every product in NODE_VALUES, in the order of PRODUCTS, with the
+ * products split across POOL.
+ *
+ * @param totals Total of each product.
+ */
+void product_data::fill_product_totals(double *totals) {
+    auto n_products = static_cast<int>(products.size());
+    auto fill_totals = [&](int task) {
+        for (int i = task * PRODUCT_CHUNK; i < min(n_products, (task + 1) * PRODUCT_CHUNK); ++i) {
+            totals[i] = stems_total(products[i]);
+        }
+    };
+    run_tasks((n_products + PRODUCT_CHUNK - 1) / PRODUCT_CHUNK, fill_totals);
+}
+
+/** Adds the emissions of every product in the count window from T1 to T2 to SPECTRA, splitting the decays of each
+ * product into gamma lines as add_spectrum does. The gamma lines of each product have their own columns, so the
+ * products are split across POOL with no locking.
+ *
+ * @param t1 Lower time of interval.
+ * @param t2 Upper time of interval.
+ * @param decays Decays of each product in the window, in the order of PRODUCTS.
+ */
+void product_data::add_spectra(double t1, double t2, const double *decays) {
+    int row = -1;
     for (int product : products) {
-        batch_decay(product, t1, t0);
+        int id = data->get_id(product);
+        if (id >= 0 && data->n_gammas_id(id) > 0) {
+            row = spectra.add_window(make_pair(t1, t2));
+            break;
+        }
+    }
+    if (row < 0) {
+        return;
     }
+    auto n_products = static_cast<int>(products.size());
+    auto emissions = [&](int task) {
+        for (int i = task * PRODUCT_CHUNK; i < min(n_products, (task + 1) * PRODUCT_CHUNK); ++i) {
+            int id = data->get_id(products[i]);
+            int n_gammas = (id < 0) ? 0 : data->n_gammas_id(id);
+            for (int j = 0; j < n_gammas; ++j) {
+                double emissions = decays[i] * data->get_gamma_intensity_id(id, j);
+                spectra.at(row, data->get_gamma_line_id(id, j)) += emissions;
+            }
+        }
+    };
+    run_tasks((n_products + PRODUCT_CHUNK - 1) / PRODUCT_CHUNK, emissions);
 }
 
-/** Calculates the population after decay using a continuous production solution for a stem (vs batch decay).
+/** Fills PASS_NODES with every stem whose first isotope has a population in ROW0, and PASS_SCALES with that
+ * population, for a batch decay pass from ROW0.
  *
- * @param stem Decay stem.
- * @param stem_dcs Stem decay constants.
- * @param stem_brs Stem branching ratios.
- * @param P Fissions/second.
- * @param t1 Final time.
- * @param t0 Initial time (default = 0).
- * @return
+ * @param row0 Row of the populations the decay starts from.
  */
-double product_data::cont_prod_stem(vector<int> &stem, vector<double> &stem_dcs, vector<double> &stem_brs, double P, double t1,
-                      double t0 = 0.0) {
-    double res = 0.0;
-    double dt = t1 - t0;
-    auto n = static_cast<int>(stem.size());
-    if (P != 0.0) {
-        double left = P * data.get_yield(stem[0]);
-        for (int q = 0; q < n - 1; ++q) {
-            left = left * stem_brs[q + 1] * stem_dcs[q];
-        }
-
-        double right = 0.0;
-        for (int j = 0; j < n; ++j) {
-            double numer = 1.0 - exp(-1.0 * stem_dcs[j] * dt);
-            double denom = 1.0;
-            for (int k = 0; k < n; ++k) {
-                if (k != j) {
-                    denom = denom * (stem_dcs[k] - stem_dcs[j]);
-                }
+void product_data::gather_decay_pass(int row0) {
+    const chains_data::stem_trie &trie = chains->get_stem_trie();
+    pass_nodes.clear();
+    pass_scales.clear();
+    for (int root : trie.roots) {
+        double N0 = populations.get(row0, trie.isotopes[root]);
+        if (N0 != 0.0) {
+            for (int node = root; node != -1; node = trie.next(node, root)) {
+                pass_nodes.push_back(node);
+                pass_scales.push_back(N0);
             }
-            if (exp(-1.0 * stem_dcs[j] * dt) < 0.9999999403953552) { //This number is based on single precision resolution. If smaller than this, treat the species as stable.
-                denom = denom * stem_dcs[j];
-                right = right + (numer / denom);
-            } else {
-                if (j == n - 1) {
-                    numer = dt;
-                    right = right + (numer / denom);
-                } else {
-                    right = 0.0;
-                    break;
-                }
+        }
+    }
+}
+
+/** Calculates the batch decay for every product at N_TIMES times from T0 in one walk of the stem trie, as
+ * batch_decay_all does for one time.
+ *
+ * @param times Final times.
+ * @param n_times Number of times.
+ * @param t0 Initial time.
+ */
+void product_data::batch_decay_run(const double *times, int n_times, double t0) {
+    const chains_data::stem_trie &trie = chains->get_stem_trie();
+    node_values.resize(trie.size());
+    if (trie.size() > 0) {
+        int row0 = populations.add_time(t0);
+        vector<double> dts(n_times);
+        for (int t = 0; t < n_times; ++t) {
+            dts[t] = times[t] - t0;
+        }
+        fill_decay_tables(decay_tables, dts);
+        gather_decay_pass(row0);
+        batch_decay_times_pass(n_times);
+    }
+
+    for (int t = 0; t < n_times; ++t) {
+        if (trie.size() > 0) {
+            set_node_values(t);
+        }
+        add_totals(times[t]);
+    }
+}
+
+/** Calculates the batch decay for every product at each time of TIMES, starting at T0, as batch_decay_all would
+ * for each time in turn. The stems and their populations at T0 are gathered once, and the kernels sum each stem for
+ * every time while it is in cache. A time equal to T0 adds to the populations the later times start from, so the
+ * times after one are evaluated in a new pass.
+ *
+ * @param times Final times, in the order batch_decay_all would take them.
+ * @param t0 Initial time.
+ */
+void product_data::batch_decay_times(const vector<double> &times, double t0) {
+    if (cram) {
+        for (double t : times) {
+            batch_decay_all(t, t0);
+        }
+        return;
+    }
+    if (expsums) {
+        // one expansion serves every time up to one equal to T0
+        expsum_solver::expansion sums;
+        for (size_t i = 0; i < times.size(); ++i) {
+            if (i == 0 || times[i - 1] == t0) {
+                sums = expsums->expand(isotope_populations(populations.add_time(t0)), {}, 0.0);
             }
+            add_isotope_totals(times[i], expsums->evaluate(sums, times[i] - t0));
         }
-        res = left * right;
+        return;
     }
-    return res;
+    size_t first = 0;
+    while (first < times.size()) {
+        size_t last = first;
+        while (last + 1 < times.size() && times[last] != t0) {
+            ++last;
+        }
+        batch_decay_run(times.data() + first, static_cast<int>(last + 1 - first), t0);
+        first = last + 1;
+    }
+}
+
+/** Sums the stems of PASS_NODES with the continuous production solution (vs batch decay), from the exponentials in
+ * DECAY_FACTORS and GROWTH_FACTORS. Each sum is the population of the last isotope of a stem at the end of the time
+ * step, per unit production rate of its first isotope. Fills PASS_SUMS.
+ *
+ * @param dt Length of the time step.
+ */
+void product_data::cont_prod_pass(double dt) {
+    const bateman_kernels &kernels = active_kernels();
+    stem_arrays stems = chains->get_stem_arrays();
+    bucket_pass();
+    auto sums = [&](int chunk) {
+        int first = chunk_firsts[chunk];
+        kernels.cont_sums(stems, chunk_lengths[chunk], bucket_nodes.data() + first, chunk_firsts[chunk + 1] - first,
+                          decay_factors.data(), growth_factors.data(), dt, bucket_sums.data() + first);
+    };
+    run_tasks(static_cast<int>(chunk_lengths.size()), sums);
+    unbucket_pass();
+}
+
+/** Sums the stems of PASS_NODES with the solution for a production rate rising linearly from zero, from the
+ * exponentials in DECAY_FACTORS and RAMP_FACTORS. The continuous production kernels take RAMP_FACTORS in place of
+ * GROWTH_FACTORS, and DT * DT / 2 in place of DT for a stable last isotope, so each sum is the population of the
+ * last isotope of a stem at the end of the time step, per unit rate of increase of the production rate of its first
+ * isotope. Fills PASS_SUMS.
+ *
+ * @param dt Length of the time step.
+ */
+void product_data::ramp_prod_pass(double dt) {
+    const bateman_kernels &kernels = active_kernels();
+    stem_arrays stems = chains->get_stem_arrays();
+    bucket_pass();
+    auto sums = [&](int chunk) {
+        int first = chunk_firsts[chunk];
+        kernels.cont_sums(stems, chunk_lengths[chunk], bucket_nodes.data() + first, chunk_firsts[chunk + 1] - first,
+                          decay_factors.data(), ramp_factors.data(), dt * dt / 2.0, bucket_sums.data() + first);
+    };
+    run_tasks(static_cast<int>(chunk_lengths.size()), sums);
+    unbucket_pass();
 }
 
 /** Calculates the population after decay using continuous production solution for the given isotope (IZA). Works
@@ -293,74 +905,275 @@ double product_data::cont_prod_stem(vector<int> &stem, vector<double> &stem_dcs,
  * @return
  */
 double product_data::cont_prod(int iZA, double P, double t1, double t0 = 0.0, bool add = true) {
+    const chains_data::stem_trie &trie = chains->get_stem_trie();
     double res = 0.0;
-    vector <vector<int>> stems = chains.get_stems(iZA);
-    vector <vector<double>> stems_dcs = chains.get_stems_dcs(iZA);
-    vector <vector<double>> stems_brs = chains.get_stems_brs(iZA);
 
-    for (int i = 0; i < stems.size(); ++i) {
-        res = res + cont_prod_stem(stems[i], stems_dcs[i], stems_brs[i], P, t1, t0);
+    if (P != 0.0) {
+        fill_decay_factors(decay_factors, t1 - t0);
+        fill_growth_factors();
+        pass_nodes.clear();
+        pass_scales.clear();
+        for (int node : trie.stems_of(iZA)) {
+            pass_nodes.push_back(node);
+            pass_scales.push_back(P * data->get_yield(trie.isotopes[trie.root_of[node]]));
+        }
+        cont_prod_pass(t1 - t0);
+        for (size_t k = 0; k < pass_nodes.size(); ++k) {
+            res = res + pass_scales[k] * pass_sums[k];
+        }
     }
 
     if (add) {
-        populations[t1][iZA] = res + get_population(iZA,t1);
+        int col = populations.add_product(iZA);
+        populations.at(populations.add_time(t1), col) += res;
     }
 
     return res;
 }
 
 
-/** Calculates the population for all products using a continuous production solution.
+/** Calculates the population for all products using a continuous production solution. Walks the stem trie once,
+ * as batch_decay_all does. With the CRAM or EXPSUM solver, the production of every isotope is advanced from T0 to T1
+ * at once.
  *
  * @param P Fissions/Second
  * @param t1 Final time.
  * @param t0 Initial time (default = 0).
  */
 void product_data::cont_prod_all(double P, double t1, double t0 = 0.0) {
+    if (cram) {
+        vector<double> source(data->n_isotopes());
+        for (int id = 0; id < data->n_isotopes(); ++id) {
+            source[id] = P * data->get_yield_id(id);
+        }
+        add_isotope_totals(t1, cram->advance(vector<double>(data->n_isotopes(), 0.0), source, t1 - t0));
+        return;
+    }
+    if (expsums) {
+        vector<double> source(data->n_isotopes());
+        for (int id = 0; id < data->n_isotopes(); ++id) {
+            source[id] = P * data->get_yield_id(id);
+        }
+        add_isotope_totals(t1, expsums->evaluate(expsums->expand({}, source, t1 - t0), t1 - t0));
+        return;
+    }
+    const chains_data::stem_trie &trie = chains->get_stem_trie();
+    node_values.resize(trie.size());
+    fill_decay_factors(decay_factors, t1 - t0);
+    fill_growth_factors();
+    pass_nodes.clear();
+    pass_scales.clear();
+    for (int root : trie.roots) {
+        double R = P * data->get_yield(trie.isotopes[root]);
+        for (int node = root; node != -1; node = trie.next(node, root)) {
+            node_values[node] = 0.0;
+            if (P != 0.0) {
+                pass_nodes.push_back(node);
+                pass_scales.push_back(R);
+            }
+        }
+    }
+    cont_prod_pass(t1 - t0);
+    for (size_t k = 0; k < pass_nodes.size(); ++k) {
+        node_values[pass_nodes[k]] = pass_scales[k] * pass_sums[k];
+    }
+
+    add_totals(t1);
+}
+
+/** Calculates the population for all products with a fission rate that changes linearly from P at T0 to P_END at
+ * T1, as the continuous production solution at P plus the solution for a rate rising from zero at
+ * (P_END - P) / (T1 - T0). A step at constant power goes to cont_prod_all. With the CRAM or EXPSUM solver, the
+ * production of every isotope is advanced from T0 to T1 at once.
+ *
+ * @param P Fissions/Second at T0.
+ * @param P_end Fissions/Second at T1.
+ * @param t1 Final time.
+ * @param t0 Initial time.
+ */
+void product_data::ramp_prod_all(double P, double P_end, double t1, double t0) {
+    if (P == P_end) {
+        cont_prod_all(P, t1, t0);
+        return;
+    }
+    double slope = (P_end - P) / (t1 - t0);
+    if (cram || expsums) {
+        vector<double> source(data->n_isotopes());
+        vector<double> ramp(data->n_isotopes());
+        for (int id = 0; id < data->n_isotopes(); ++id) {
+            source[id] = P * data->get_yield_id(id);
+            ramp[id] = slope * data->get_yield_id(id);
+        }
+        if (cram) {
+            add_isotope_totals(t1, cram->advance(vector<double>(data->n_isotopes(), 0.0), source, t1 - t0, ramp));
+        } else {
+            add_isotope_totals(t1, expsums->evaluate(expsums->expand({}, source, t1 - t0, ramp), t1 - t0));
+        }
+        return;
+    }
+    const chains_data::stem_trie &trie = chains->get_stem_trie();
+    node_values.resize(trie.size());
+    fill_decay_factors(decay_factors, t1 - t0);
+    fill_growth_factors();
+    fill_ramp_factors(t1 - t0);
+    pass_nodes.clear();
+    pass_scales.clear();
+    for (int root : trie.roots) {
+        double yield = data->get_yield(trie.isotopes[root]);
+        for (int node = root; node != -1; node = trie.next(node, root)) {
+            node_values[node] = 0.0;
+            pass_nodes.push_back(node);
+            pass_scales.push_back(yield);
+        }
+    }
+    cont_prod_pass(t1 - t0);
+    for (size_t k = 0; k < pass_nodes.size(); ++k) {
+        node_values[pass_nodes[k]] = P * pass_scales[k] * pass_sums[k];
+    }
+    ramp_prod_pass(t1 - t0);
+    for (size_t k = 0; k < pass_nodes.size(); ++k) {
+        node_values[pass_nodes[k]] += slope * pass_scales[k] * pass_sums[k];
+    }
+
+    add_totals(t1);
+}
+
+/** Finds the response of every product to an irradiation step of length DT. The batch decay and continuous
+ * production sums of every stem trie node are found as batch_decay_all and cont_prod_all find them, and the sums of
+ * the stems from each first isotope to each product are added together, so a step only takes one entry per first
+ * isotope and product.
+ *
+ * @param dt Length of the step.
+ * @return Response of every product.
+ */
+product_data::step_response product_data::build_response(double dt) {
+    const chains_data::stem_trie &trie = chains->get_stem_trie();
+    pass_nodes.resize(trie.size());
+    for (int node = 0; node < trie.size(); ++node) {
+        pass_nodes[node] = node;
+    }
+    fill_decay_factors(decay_factors, dt);
+    batch_decay_pass();
+    vector<double> decay_sums(pass_sums.begin(), pass_sums.begin() + trie.size());
+    fill_growth_factors();
+    cont_prod_pass(dt);
+    vector<double> cont_sums(pass_sums.begin(), pass_sums.begin() + trie.size());
+    fill_ramp_factors(dt);
+    ramp_prod_pass(dt);
+
+    step_response response;
+    response.offsets.assign(1, 0);
+    vector<int> entries(trie.size(), -1); // entry of each root node for the current product
     for (int product : products) {
-        cont_prod(product, P, t1, t0);
+        double unit = 0.0;
+        double ramp = 0.0;
+        int first = static_cast<int>(response.root_cols.size());
+        for (int node : trie.stems_of(product)) {
+            int root = trie.root_of[node];
+            unit = unit + data->get_yield(trie.isotopes[root]) * cont_sums[node];
+            ramp = ramp + data->get_yield(trie.isotopes[root]) * pass_sums[node];
+            if (entries[root] < first) {
+                entries[root] = static_cast<int>(response.root_cols.size());
+                response.root_cols.push_back(populations.add_product(trie.isotopes[root]));
+                response.decays.push_back(0.0);
+            }
+            response.decays[entries[root]] += decay_sums[node];
+        }
+        response.units.push_back(unit);
+        response.ramps.push_back(ramp);
+        response.offsets.push_back(static_cast<int>(response.root_cols.size()));
     }
+    return response;
 }
 
-/** Calcuates the population after decay using batch decay solution given a stem using an indefinite integral, used
- * to calculate definite integral to batch production function.
+/** Advances every product over the irradiation step from T0 to T1 as batch_decay_all and then ramp_prod_all would,
+ * by superposing the response build_response found for a step of the same length.
  *
- * @param stem Decay stem.
- * @param stem_dcs Stem decay constants.
- * @param stem_brs Stem branching ratios.
+ * @param P Fissions/Second at T0.
+ * @param P_end Fissions/Second at T1.
  * @param t1 Final time.
- * @param t0 Intial time (no default).
- * @return Calculated population at time T1.
+ * @param t0 Initial time.
+ * @param response Response of every product to a step of length T1 - T0.
  */
-double product_data::batch_rate_indef_stem(vector<int> &stem, vector<double> &stem_dcs, vector<double> &stem_brs, double t1, double t0) {
-    double res = 0.0;
-    double N0 = populations[t0][stem[0]];
-    double dt = t1 - t0;
-    auto n = static_cast<int>(stem.size());
-    if (N0 != 0.0) {
-        double left = N0;
-        for (int q = 0; q < n - 1; ++q) {
-            left = left * stem_brs[q + 1] * stem_dcs[q];
-        }
-
-        double right = 0.0;
-        for (int j = 0; j < n; ++j) {
-            double numer = -1.0 * exp(-1.0 * stem_dcs[j] * dt);
-            double denom = stem_dcs[j];
-            for (int k = 0; k < n; ++k) {
-                if (k != j) {
-                    denom = denom * (stem_dcs[k] - stem_dcs[j]);
-                }
+void product_data::superpose_step(double P, double P_end, double t1, double t0, const step_response &response) {
+    double slope = (P_end - P) / (t1 - t0);
+    product_cols.resize(products.size());
+    for (size_t i = 0; i < products.size(); ++i) {
+        product_cols[i] = populations.add_product(products[i]);
+    }
+    int row0 = populations.add_time(t0);
+    int row = populations.add_time(t1);
+    for (size_t i = 0; i < products.size(); ++i) {
+        double total = 0.0;
+        for (int k = response.offsets[i]; k < response.offsets[i + 1]; ++k) {
+            total = total + populations.at(row0, response.root_cols[k]) * response.decays[k];
+        }
+        populations.at(row, product_cols[i]) += total;
+        populations.at(row, product_cols[i]) += P * response.units[i];
+        if (P_end != P) {
+            populations.at(row, product_cols[i]) += slope * response.ramps[i];
+        }
+    }
+}
+
+/** Irradiates the products through STEPS from 0.0, as batch_decay_all and ramp_prod_all would for each step in
+ * turn. The stem sums of a step only depend on its length, so for a length that several steps share the response
+ * of every product is found once by build_response, and each of those steps superposes it over the populations at
+ * its start and its production rate, without walking the stems. The response of a length is dropped after its last
+ * step. Steps of a length no other step has, and every step with the CRAM or EXPSUM solver, are evaluated on their
+ * own.
+ *
+ * @param steps End time and fissions/second at the start and at the end of each step, in order.
+ */
+void product_data::irradiate(const vector<tuple<double, double, double>> &steps) {
+    map<double, int> steps_left;
+    double t_last = 0.0;
+    for (auto &step : steps) {
+        ++steps_left[get<0>(step) - t_last];
+        t_last = get<0>(step);
+    }
+    map<double, step_response> responses;
+    t_last = 0.0;
+    for (auto &step : steps) {
+        double t_cur = get<0>(step);
+        double dt = t_cur - t_last;
+        if (cram || expsums || (steps_left[dt] == 1 && responses.count(dt) == 0)) {
+            batch_decay_all(t_cur, t_last);
+            ramp_prod_all(get<1>(step), get<2>(step), t_cur, t_last);
+        } else {
+            auto response = responses.find(dt);
+            if (response == responses.end()) {
+                response = responses.emplace(dt, build_response(dt)).first;
+            }
+            superpose_step(get<1>(step), get<2>(step), t_cur, t_last, response->second);
+            if (steps_left[dt] == 1) {
+                responses.erase(response);
             }
-            right = right + (numer / denom);
         }
-        res = stem_dcs[n - 1] * left * right;
+        --steps_left[dt];
+        t_last = t_cur;
     }
-    return res;
 }
 
-/** Calculates the gamma spectrum for isotope IZA by evaluating the definite integral from the
- * batch_rate_indef_stem function.
+/** Sums the stems of PASS_NODES with the definite integral of the batch decay solution over a count window, from
+ * the exponentials at its start and end in DECAY_FACTORS and DECAY_FACTORS_END. Multiplied by the decay constant of
+ * the last isotope of a stem, each sum is the number of decays of that isotope in the window per unit population
+ * of the first isotope at the irradiation end time. Fills PASS_SUMS.
+ */
+void product_data::batch_rate_pass() {
+    const bateman_kernels &kernels = active_kernels();
+    stem_arrays stems = chains->get_stem_arrays();
+    bucket_pass();
+    auto sums = [&](int chunk) {
+        int first = chunk_firsts[chunk];
+        kernels.rate_sums(stems, chunk_lengths[chunk], bucket_nodes.data() + first, chunk_firsts[chunk + 1] - first,
+                          decay_factors.data(), decay_factors_end.data(), bucket_sums.data() + first);
+    };
+    run_tasks(static_cast<int>(chunk_lengths.size()), sums);
+    unbucket_pass();
+}
+
+/** Calculates the gamma spectrum for isotope IZA by adding up the decays batch_rate_pass finds for each of its stems.
  *
  * @param iZA Unique isotope hash.
  * @param t1 Lower time of interval.
@@ -370,109 +1183,399 @@ double product_data::batch_rate_indef_stem(vector<int> &stem, vector<double> &st
  * @return
  */
 vector <pair<double, double>> product_data::batch_spectrum(int iZA, double t1, double t2, double t0 = 0.0, bool add = true) {
-    vector <pair<double, double>> res;
-    vector <vector<int>> stems = chains.get_stems(iZA);
-    vector <vector<double>> stems_dcs = chains.get_stems_dcs(iZA);
-    vector <vector<double>> stems_brs = chains.get_stems_brs(iZA);
+    const chains_data::stem_trie &trie = chains->get_stem_trie();
+    array_view<int> stems = trie.stems_of(iZA);
 
-    vector<double> batch_rate;
-    double batch_rate_cur;
-    for (int i = 0; i < stems.size(); ++i) {
-        batch_rate_cur = batch_rate_indef_stem(stems[i], stems_dcs[i], stems_brs[i], t2, t0);
-        batch_rate_cur = batch_rate_cur - batch_rate_indef_stem(stems[i], stems_dcs[i], stems_brs[i], t1, t0);
-        batch_rate.push_back(batch_rate_cur);
+    double batch_rate = 0.0;
+    if (stems.size() > 0) {
+        int row0 = populations.add_time(t0);
+        fill_decay_factors(decay_factors, t1 - t0);
+        fill_decay_factors(decay_factors_end, t2 - t0);
+        const vector<double> &node_dcs = chains->get_node_dcs();
+        pass_nodes.clear();
+        pass_scales.clear();
+        for (int node : stems) {
+            double N0 = populations.get(row0, trie.isotopes[trie.root_of[node]]);
+            if (N0 != 0.0 && node_dcs[node] != 0.0) {
+                pass_nodes.push_back(node);
+                pass_scales.push_back(node_dcs[node] * N0);
+            }
+        }
+        batch_rate_pass();
+        for (size_t k = 0; k < pass_nodes.size(); ++k) {
+            batch_rate = batch_rate + pass_scales[k] * pass_sums[k];
+        }
     }
 
-    for (int j = 0; j < data.n_gammas(iZA); ++j) {
-        double emissions = 0.0;
+    return add_spectrum(iZA, batch_rate, t1, t2, add);
+}
 
-        for (int i = 0; i < stems.size(); ++i) {
-            emissions = emissions + batch_rate[i];
-        }
-        emissions = emissions * data.get_gamma_intensity(iZA, j);
-        res.emplace_back(data.get_gamma_energy(iZA, j), emissions);
+/** Splits the decays of isotope IZA in a count window into its gamma lines.
+ *
+ * @param iZA Unique isotope hash.
+ * @param batch_rate Decays of IZA between T1 and T2.
+ * @param t1 Lower time of interval.
+ * @param t2 Upper time of interval.
+ * @param add If true, adds the emissions to SPECTRA.
+ * @return List of PAIRs of gamma energy and emissions.
+ */
+vector <pair<double, double>> product_data::add_spectrum(int iZA, double batch_rate, double t1, double t2, bool add) {
+    vector <pair<double, double>> res;
+    int id = data->get_id(iZA);
+    int n_gammas = (id < 0) ? 0 : data->n_gammas_id(id);
+    int row = (add && n_gammas > 0) ? spectra.add_window(make_pair(t1, t2)) : -1;
+    for (int j = 0; j < n_gammas; ++j) {
+        double emissions = batch_rate * data->get_gamma_intensity_id(id, j);
+        double Eg = data->get_gamma_energy_id(id, j);
+        res.emplace_back(Eg, emissions);
 
         if (add) {
-            if (spectra[make_pair(t1, t2)][iZA].count(data.get_gamma_energy(iZA, j)) > 0) {
-                spectra[make_pair(t1, t2)][iZA][data.get_gamma_energy(iZA, j)] =
-                        spectra[make_pair(t1, t2)][iZA][data.get_gamma_energy(iZA, j)] + emissions;
-            } else {
-                spectra[make_pair(t1, t2)][iZA][data.get_gamma_energy(iZA, j)] = emissions;
-            }
+            spectra.at(row, data->get_gamma_line_id(id, j)) += emissions;
         }
     }
 
     return res;
 }
 
-/** Calculates the gamma spectrum for all products. Saved into SPECTRA field.
+/** Calculates the gamma spectrum for all products. Saved into SPECTRA field. Walks the stem trie once, as
+ * batch_decay_all does. With the CRAM solver, every isotope is advanced to T1, and the populations integrated over
+ * the window are the populations from a production rate equal to those at T1 from T1 to T2. With the EXPSUM solver,
+ * the sums of exponentials from T0 are integrated over the window.
  *
  * @param t1 Initial time.
  * @param t2 Final time.
  * @param t0 Offset from 0.
  */
 void product_data::batch_spectrum_all(double t1, double t2, double t0 = 0.0) {
-    for (int product : products) {
-        batch_spectrum(product, t1, t2, t0);
+    if (cram) {
+        int row0 = populations.add_time(t0);
+        vector<double> start = cram->advance(isotope_populations(row0), {}, t1 - t0);
+        vector<double> integral = cram->advance(vector<double>(data->n_isotopes(), 0.0), start, t2 - t1);
+        for (int product : products) {
+            int id = data->get_id(product);
+            add_spectrum(product, data->get_DC_id(id) * integral[id], t1, t2, true);
+        }
+        return;
+    }
+    if (expsums) {
+        add_isotope_spectra(t1, t2, expsums->expand(isotope_populations(populations.add_time(t0)), {}, 0.0), t0);
+        return;
+    }
+    const chains_data::stem_trie &trie = chains->get_stem_trie();
+    node_values.resize(trie.size());
+    if (trie.size() > 0) {
+        int row0 = populations.add_time(t0);
+        fill_decay_factors(decay_factors, t1 - t0);
+        fill_decay_factors(decay_factors_end, t2 - t0);
+        const vector<double> &node_dcs = chains->get_node_dcs();
+        pass_nodes.clear();
+        pass_scales.clear();
+        for (int root : trie.roots) {
+            double N0 = populations.get(row0, trie.isotopes[root]);
+            for (int node = root; node != -1; node = trie.next(node, root)) {
+                node_values[node] = 0.0;
+                if (N0 != 0.0 && node_dcs[node] != 0.0) {
+                    pass_nodes.push_back(node);
+                    pass_scales.push_back(node_dcs[node] * N0);
+                }
+            }
+        }
+        batch_rate_pass();
+        for (size_t k = 0; k < pass_nodes.size(); ++k) {
+            node_values[pass_nodes[k]] = pass_scales[k] * pass_sums[k];
+        }
     }
+
+    product_totals.resize(products.size());
+    fill_product_totals(product_totals.data());
+    add_spectra(t1, t2, product_totals.data());
 }
 
-/** Saves population data to file.
+/** As batch_rate_pass, over N_TIMES count windows with the exponentials at their starts and ends in DECAY_TABLES
+ * and DECAY_TABLES_END. Fills PASS_SUMS with the sums of each window after those of the window before.
  *
- * @param pops_out String filename of output file.
+ * @param n_times Number of count windows.
  */
-void product_data::save_populations(string pops_out) {
-    ofstream pops_file;
-    pops_file.open(pops_out);
-    vector<double> times = get_keys(populations);
-    sort(times.begin(), times.end());
-    sort(products.begin(), products.end());
+void product_data::batch_rate_times_pass(int n_times) {
+    const bateman_kernels &kernels = active_kernels();
+    stem_arrays stems = chains->get_stem_arrays();
+    bucket_pass();
+    auto n_pass = static_cast<int>(pass_nodes.size());
+    auto table_size = static_cast<int>(chains->get_rate_dcs().size());
+    bucket_sums.resize(static_cast<size_t>(n_pass) * n_times);
+    auto sums = [&](int chunk) {
+        int first = chunk_firsts[chunk];
+        kernels.rate_times_sums(stems, chunk_lengths[chunk], bucket_nodes.data() + first,
+                                chunk_firsts[chunk + 1] - first, decay_tables.data(), decay_tables_end.data(), n_times,
+                                table_size, bucket_sums.data() + first, n_pass);
+    };
+    run_tasks(static_cast<int>(chunk_lengths.size()), sums);
+    unbucket_pass(n_times);
+}
 
-    pops_file << 'Z';
-    for (int product : products) {
-        pops_file << ',' << product / 10000;
+/** Calculates the gamma spectra of all products in each count window of WINDOWS, as batch_spectrum_all would for
+ * each window in turn. The windows are walked WINDOWS_PER_PASS at a time, each in one stem pass with the
+ * exponentials at its start and end, so every term is integrated over its window before the terms are added. The
+ * exponential table of each distinct boundary of a pass is found once, so back to back windows share the table of
+ * the boundary between them.
+ *
+ * @param windows PAIRs of start and end time of each count window.
+ * @param t0 Offset from 0 (irradiation end time).
+ */
+void product_data::batch_spectrum_windows(const vector<pair<double, double>> &windows, double t0) {
+    if (cram) {
+        for (auto &window : windows) {
+            batch_spectrum_all(window.first, window.second, t0);
+        }
+        return;
+    }
+    if (expsums) {
+        expsum_solver::expansion sums = expsums->expand(isotope_populations(populations.add_time(t0)), {}, 0.0);
+        for (auto &window : windows) {
+            add_isotope_spectra(window.first, window.second, sums, t0);
+        }
+        return;
+    }
+    const chains_data::stem_trie &trie = chains->get_stem_trie();
+    node_values.assign(trie.size(), 0.0);
+    if (trie.size() > 0 && !windows.empty()) {
+        int row0 = populations.add_time(t0);
+        const vector<double> &node_dcs = chains->get_node_dcs();
+        pass_nodes.clear();
+        pass_scales.clear();
+        for (int root : trie.roots) {
+            double N0 = populations.get(row0, trie.isotopes[root]);
+            for (int node = root; node != -1; node = trie.next(node, root)) {
+                if (N0 != 0.0 && node_dcs[node] != 0.0) {
+                    pass_nodes.push_back(node);
+                    pass_scales.push_back(node_dcs[node] * N0);
+                }
+            }
+        }
     }
-    pops_file << '\n';
 
-    pops_file << 'A';
-    for (int product : products) {
+    size_t table_size = chains->get_rate_dcs().size();
+    vector<double> bounds, dts, bound_tables;
+    product_totals.resize(products.size());
+    spectra.reserve_windows(static_cast<int>(windows.size()));
+    for (size_t first = 0; first < windows.size(); first += WINDOWS_PER_PASS) {
+        int n_pass_windows = static_cast<int>(min(static_cast<size_t>(WINDOWS_PER_PASS), windows.size() - first));
+        if (trie.size() > 0) {
+            bounds.clear();
+            for (int w = 0; w < n_pass_windows; ++w) {
+                bounds.push_back(windows[first + w].first);
+                bounds.push_back(windows[first + w].second);
+            }
+            sort(bounds.begin(), bounds.end());
+            bounds.erase(unique(bounds.begin(), bounds.end()), bounds.end());
+            dts.resize(bounds.size());
+            for (size_t b = 0; b < bounds.size(); ++b) {
+                dts[b] = bounds[b] - t0;
+            }
+            fill_decay_tables(bound_tables, dts);
+
+            // the tables of the start and end of each window, from those of its boundaries
+            decay_tables.resize(n_pass_windows * table_size);
+            decay_tables_end.resize(n_pass_windows * table_size);
+            for (int w = 0; w < n_pass_windows; ++w) {
+                auto start = lower_bound(bounds.begin(), bounds.end(), windows[first + w].first) - bounds.begin();
+                auto end = lower_bound(bounds.begin(), bounds.end(), windows[first + w].second) - bounds.begin();
+                copy_n(bound_tables.begin() + start * table_size, table_size, decay_tables.begin() + w * table_size);
+                copy_n(bound_tables.begin() + end * table_size, table_size,
+                       decay_tables_end.begin() + w * table_size);
+            }
+            batch_rate_times_pass(n_pass_windows);
+        }
+        for (int w = 0; w < n_pass_windows; ++w) {
+            if (trie.size() > 0) {
+                set_node_values(w);
+            }
+            fill_product_totals(product_totals.data());
+            add_spectra(windows[first + w].first, windows[first + w].second, product_totals.data());
+        }
+    }
+}
+
+/** Writes the Z, A, I, half-life and energy header rows of a populations file for the products COLUMNS.
+ *
+ * @param file Output file.
+ * @param columns Products of the columns, in order.
+ */
+void product_data::save_header(ofstream &file, const vector<int> &columns) const {
+    file << 'Z';
+    for (int product : columns) {
+        file << ',' << product / 10000;
+    }
+    file << '\n';
+
+    file << 'A';
+    for (int product : columns) {
         int Z = product / 10000;
         int I = (product - Z * 10000) / 1000;
-        pops_file << ',' << product - Z * 10000 - I * 1000;
+        file << ',' << product - Z * 10000 - I * 1000;
     }
-    pops_file << '\n';
+    file << '\n';
 
-    pops_file << 'I';
-    for (int product : products) {
+    file << 'I';
+    for (int product : columns) {
         int Z = product / 10000;
-        pops_file << ',' << (product - Z * 10000) / 1000;
+        file << ',' << (product - Z * 10000) / 1000;
     }
-    pops_file << '\n';
+    file << '\n';
 
-    pops_file << "t_1/2";
+    file << "t_1/2";
     cout.precision(5);
-    for (int product : products) {
-        pops_file << ',' << data.get_halflife(product) << scientific;
+    for (int product : columns) {
+        file << ',' << data->get_halflife(product) << scientific;
     }
-    pops_file << '\n';
+    file << '\n';
 
-    pops_file << "t (s) / E (keV)";
+    file << "t (s) / E (keV)";
     cout.precision(5);
-    for (int product : products) {
-        pops_file << ',' << data.get_energy(product) << scientific;
+    for (int product : columns) {
+        file << ',' << data->get_energy(product) << scientific;
     }
-    pops_file << '\n';
+    file << '\n';
+}
+
+/** Saves population data to file.
+ *
+ * @param pops_out String filename of output file.
+ */
+void product_data::save_populations(string pops_out) {
+    ofstream pops_file;
+    pops_file.open(pops_out);
+    vector<double> times = populations.get_times();
+    sort(products.begin(), products.end());
+
+    save_header(pops_file, products);
 
     for (double time : times) {
+        int row = populations.find_time(time);
         pops_file << time;
         for (int product : products) {
-            pops_file << ',' << populations[time][product];
+            pops_file << ',' << populations.get(row, product);
         }
         pops_file << '\n';
     }
 
 }
 
+/** Streams the population, or the activity, of every product at each time of a grid after T0 to a file laid out as
+ * the populations file, without adding the times to POPULATIONS. A linear grid spaces N_POINTS times evenly from
+ * T_START to T_END, and its exponentials come from one table of step factors, each table the one before it times
+ * the factors; a log grid spaces the times from T0 evenly in their logarithm, and takes a table of exponentials per
+ * time. The stems are summed SERIES_TIMES_PER_PASS times at a time, and each row is written once summed, so the
+ * memory held does not grow with N_POINTS. With the CRAM solver every isotope is advanced from one time to the next,
+ * and with the EXPSUM solver one expansion from T0 is evaluated at every time.
+ *
+ * @param series_out Location of the output file.
+ * @param t_start First time (seconds), after T0 for a log grid.
+ * @param t_end Last time (seconds), after T_START.
+ * @param n_points Number of times, at least 2.
+ * @param log_grid If true the times are spaced evenly in log(T - T0), otherwise in T.
+ * @param activities If true the activities (decays/second) are written instead of the populations.
+ * @param t0 Offset from 0 (irradiation end time).
+ * @return false if the grid is not valid or the file could not be opened.
+ */
+bool product_data::save_series(const string &series_out, double t_start, double t_end, int n_points, bool log_grid,
+                               bool activities, double t0) {
+    if (n_points < 2 || t_start < t0 || t_end <= t_start || (log_grid && t_start == t0)) {
+        return false;
+    }
+    ofstream series_file(series_out);
+    if (!series_file.is_open()) {
+        return false;
+    }
+    // the columns are the products in ascending order, as in the populations file
+    vector<size_t> column_products(products.size());
+    for (size_t i = 0; i < products.size(); ++i) {
+        column_products[i] = i;
+    }
+    sort(column_products.begin(), column_products.end(),
+         [&](size_t a, size_t b) { return products[a] < products[b]; });
+    vector<int> columns(products.size());
+    vector<double> scales(products.size(), 1.0);
+    for (size_t c = 0; c < columns.size(); ++c) {
+        columns[c] = products[column_products[c]];
+        if (activities) {
+            scales[c] = data->get_DC(columns[c]);
+        }
+    }
+    save_header(series_file, columns);
+
+    // time of point K from T0, the last exactly T_END
+    double step = (t_end - t_start) / (n_points - 1);
+    double ratio = log_grid ? log((t_end - t0) / (t_start - t0)) / (n_points - 1) : 0.0;
+    auto grid_dt = [&](int k) {
+        if (k == n_points - 1) {
+            return t_end - t0;
+        }
+        return log_grid ? (t_start - t0) * exp(ratio * k) : t_start - t0 + step * k;
+    };
+
+    int row0 = populations.add_time(t0);
+    product_totals.resize(products.size());
+    auto write_row = [&](double dt, const double *totals) {
+        series_file << t0 + dt;
+        for (size_t c = 0; c < columns.size(); ++c) {
+            series_file << ',' << scales[c] * totals[column_products[c]];
+        }
+        series_file << '\n';
+    };
+    auto write_isotopes = [&](double dt, const vector<double> &isotopes) {
+        for (size_t i = 0; i < products.size(); ++i) {
+            product_totals[i] = isotopes[data->get_id(products[i])];
+        }
+        write_row(dt, product_totals.data());
+    };
+
+    if (cram) {
+        vector<double> isotopes = isotope_populations(row0);
+        double dt_last = 0.0;
+        for (int k = 0; k < n_points; ++k) {
+            double dt = grid_dt(k);
+            isotopes = cram->advance(isotopes, {}, dt - dt_last);
+            dt_last = dt;
+            write_isotopes(dt, isotopes);
+        }
+        return true;
+    }
+    if (expsums) {
+        expsum_solver::expansion sums = expsums->expand(isotope_populations(row0), {}, 0.0);
+        for (int k = 0; k < n_points; ++k) {
+            write_isotopes(grid_dt(k), expsums->evaluate(sums, grid_dt(k)));
+        }
+        return true;
+    }
+    const chains_data::stem_trie &trie = chains->get_stem_trie();
+    node_values.assign(trie.size(), 0.0);
+    gather_decay_pass(row0);
+    for (int first = 0; first < n_points; first += SERIES_TIMES_PER_PASS) {
+        int n_times = min(SERIES_TIMES_PER_PASS, n_points - first);
+        if (log_grid) {
+            vector<double> dts(n_times);
+            for (int t = 0; t < n_times; ++t) {
+                dts[t] = grid_dt(first + t);
+            }
+            fill_decay_tables(decay_tables, dts);
+        } else {
+            fill_decay_steps(decay_tables, grid_dt(first), step, n_times);
+        }
+        if (trie.size() > 0) {
+            batch_decay_times_pass(n_times);
+        }
+        for (int t = 0; t < n_times; ++t) {
+            if (trie.size() > 0) {
+                set_node_values(t);
+            }
+            fill_product_totals(product_totals.data());
+            write_row(grid_dt(first + t), product_totals.data());
+        }
+    }
+    return true;
+}
+
 
 /** Saves gamma spectra data to file.
  *
@@ -481,14 +1584,13 @@ void product_data::save_populations(string pops_out) {
 void product_data::save_spectra(string gammas_out) {
     ofstream gammas_file;
     gammas_file.open(gammas_out);
-    vector <pair<double, double>> times = get_keys(spectra);
-    sort(times.begin(), times.end());
+    vector <pair<double, double>> times = spectra.get_windows();
     sort(products.begin(), products.end());
 
     gammas_file << ",Z";
     for (int product : products) {
         int Z = product / 10000;
-        for (int j = 0; j < data.n_gammas(product); ++j) {
+        for (int j = 0; j < data->n_gammas(product); ++j) {
             gammas_file << ',' << Z;
         }
     }
@@ -499,7 +1601,7 @@ void product_data::save_spectra(string gammas_out) {
         int Z = product / 10000;
         int I = (product - Z * 10000) / 1000;
         int A = product - Z * 10000 - I * 1000;
-        for (int j = 0; j < data.n_gammas(product); ++j) {
+        for (int j = 0; j < data->n_gammas(product); ++j) {
             gammas_file << ',' << A;
         }
     }
@@ -509,7 +1611,7 @@ void product_data::save_spectra(string gammas_out) {
     for (int product : products) {
         int Z = product / 10000;
         int I = (product - Z * 10000) / 1000;
-        for (int j = 0; j < data.n_gammas(product); ++j) {
+        for (int j = 0; j < data->n_gammas(product); ++j) {
             gammas_file << ',' << I;
         }
     }
@@ -517,33 +1619,35 @@ void product_data::save_spectra(string gammas_out) {
 
     gammas_file << ",t_1/2";
     for (int product : products) {
-        for (int j = 0; j < data.n_gammas(product); ++j) {
-            gammas_file << ',' << data.get_halflife(product);
+        for (int j = 0; j < data->n_gammas(product); ++j) {
+            gammas_file << ',' << data->get_halflife(product);
         }
     }
     gammas_file << '\n';
 
     gammas_file << ",E_level (keV)";
     for (int product : products) {
-        for (int j = 0; j < data.n_gammas(product); ++j) {
-            gammas_file << ',' << data.get_energy(product);
+        for (int j = 0; j < data->n_gammas(product); ++j) {
+            gammas_file << ',' << data->get_energy(product);
         }
     }
     gammas_file << '\n';
 
     gammas_file << "t0 (s),t1 (s)/E_gamma (keV)";
     for (int product : products) {
-        for (int j = 0; j < data.n_gammas(product); ++j) {
-            gammas_file << ',' << data.get_gamma_energy(product, j);
+        for (int j = 0; j < data->n_gammas(product); ++j) {
+            gammas_file << ',' << data->get_gamma_energy(product, j);
         }
     }
     gammas_file << '\n';
 
     for (auto &time : times) {
+        int row = spectra.find_window(time);
         gammas_file << get<0>(time) << ',' << get<1>(time);
         for (int product : products) {
-            for (int k = 0; k < data.n_gammas(product); ++k) {
-                gammas_file << ',' << spectra[time][product][data.get_gamma_energy(product, k)];
+            int id = data->get_id(product);
+            for (int k = 0; k < data->n_gammas(product); ++k) {
+                gammas_file << ',' << spectra.at(row, data->get_gamma_line_id(id, k));
             }
         }
         gammas_file << '\n';
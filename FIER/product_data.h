@@ -4,47 +4,248 @@
 
 #include "species_data.h"
 #include "chains_data.h"
+#include "cram_solver.h"
+#include "expsum_solver.h"
+
+/** Most stems of a pass the Bateman kernels sum in one task of a thread pool.*/
+const int PASS_CHUNK = 512;
+/** Most products whose totals one task of a thread pool adds up.*/
+const int PRODUCT_CHUNK = 16;
+/** Most count windows one stem pass of batch_spectrum_windows evaluates, which bounds the pass sums it holds however
+ * many windows there are.
+ */
+const int WINDOWS_PER_PASS = 64;
+/** Most times of a series one stem pass of save_series evaluates, so a series of any length is streamed to its file
+ * with the pass sums of this many times held at once.
+ */
+const int SERIES_TIMES_PER_PASS = 64;
+
+/** Dense table of populations with one row per time and one column per isotope. Times are matched exactly, as keys
+ * of a map<double, ...> would be, and entries that were never set read as 0.0.
+ */
+class population_matrix {
+    /** Row of each time.*/
+    map<double, int> time_rows;
+    /** Column of each isotope.*/
+    unordered_map<int, int> product_columns;
+    /** Isotope of each column.*/
+    vector<int> column_products;
+    /** Populations, N_COLUMNS values per row.*/
+    vector<double> values;
+
+public:
+    int add_time(double t);
+    int add_product(int iZA);
+
+    int find_time(double t) const;
+    int find_product(int iZA) const;
+
+    vector<double> get_times() const;
+    /** @return Isotope of each column.*/
+    const vector<int> &get_products() const { return column_products; }
+
+    /** @return Number of columns.*/
+    int n_products() const { return static_cast<int>(column_products.size()); }
+
+    /** @return Population in ROW and COL.*/
+    double &at(int row, int col) { return values[static_cast<size_t>(row) * column_products.size() + col]; }
+    /** @return Population in ROW and COL.*/
+    double at(int row, int col) const { return values[static_cast<size_t>(row) * column_products.size() + col]; }
+
+    double get(int row, int iZA) const;
+    double get(int iZA, double t) const;
+};
+
+/** Dense table of gamma emissions with one row per count window and one column per gamma line of the species data,
+ * numbered as by species_data::get_gamma_line_id. Count windows are matched exactly and entries that were never set
+ * read as 0.0.
+ */
+class spectrum_matrix {
+    /** Row of each count window.*/
+    map<pair<double, double>, int> window_rows;
+    /** Number of gamma lines.*/
+    int n_lines = 0;
+    /** Emissions, N_LINES values per row.*/
+    vector<double> values;
+
+public:
+    spectrum_matrix() = default;
+    explicit spectrum_matrix(int n_lines_in) : n_lines(n_lines_in) {}
+
+    void reserve_windows(int n_more);
+    int add_window(pair<double, double> window);
+    int find_window(pair<double, double> window) const;
+
+    vector<pair<double, double>> get_windows() const;
+
+    /** @return Number of gamma lines.*/
+    int get_n_lines() const { return n_lines; }
+
+    /** @return Emissions of LINE in ROW.*/
+    double &at(int row, int line) { return values[static_cast<size_t>(row) * n_lines + line]; }
+    /** @return Emissions of LINE in ROW.*/
+    double at(int row, int line) const { return values[static_cast<size_t>(row) * n_lines + line]; }
+};
+
 /**
  * Holds information about the fission products modeled by FIER. This will end up in the output files.
  */
 class product_data {
-    /** Species data bundled as a species_data object.*/
-    species_data data;
-    /** Chain and stem data bundled as a chains_data object.*/
-    chains_data chains;
+    /** Species data bundled as a species_data object, shared with the other classes.*/
+    shared_ptr<const species_data> data;
+    /** Chain and stem data bundled as a chains_data object, shared with the other classes.*/
+    shared_ptr<const chains_data> chains;
     /** List of decay products.*/
     vector<int> products;
-    /** All populations, represented as a map of isotope(int IZA) and quantity (double), then mapped with time (double) */
-    map<double, map<int, double> > populations;
-    /** Gamma spectra.*/
-    map <pair<double, double>, map<int, map < double, double>> > spectra;
-    /** Input irradiation scheme. A list of PAIRed time intervals in seconds.*/
-    vector <pair<double, double>> irrad_scheme;
+    /** All populations, with a row for every time (double) and a column for every isotope (int IZA).*/
+    population_matrix populations;
+    /** Gamma spectra, with a row for every count window and a column for every gamma line.*/
+    spectrum_matrix spectra;
+    /** Input irradiation scheme. A list of end times in seconds, each with the fissions/second at the start and at
+     * the end of the step, which are the same for a step at constant power.
+     */
+    vector <tuple<double, double, double>> irrad_scheme;
     /** List of times to determine population after irradiation.*/
     vector<double> after_irrad;
     /** Scheme of counts.*/
     vector <pair<double, double>> count_scheme;
 
+    /** Contribution of the stem of each stem trie node, from the last walk of the trie.*/
+    vector<double> node_values;
+    /** Total of the stems of each product in NODE_VALUES, in the order of PRODUCTS.*/
+    vector<double> product_totals;
+    /** exp(-DC * dt) of each distinct stem decay constant (chains_data::get_rate_dcs) over the time step being
+     * evaluated, shared by every stem.
+     */
+    vector<double> decay_factors;
+    /** 1 - DECAY_FACTORS, for continuous production.*/
+    vector<double> growth_factors;
+    /** (DC * dt - GROWTH_FACTORS) / DC, for production that rises linearly over the time step.*/
+    vector<double> ramp_factors;
+    /** DECAY_FACTORS at the end of the count window being evaluated.*/
+    vector<double> decay_factors_end;
+    /** Stem trie nodes summed by the Bateman kernels in the pass being evaluated.*/
+    vector<int> pass_nodes;
+    /** Factor the sum of each node of PASS_NODES is multiplied by.*/
+    vector<double> pass_scales;
+    /** Sum of each node of PASS_NODES.*/
+    vector<double> pass_sums;
+    /** PASS_NODES grouped by stem length: bucket L (1 to SPECIALIZED_STEM_LENGTH) holds the stems of length L, and
+     * bucket 0 the longer ones.
+     */
+    vector<int> bucket_nodes;
+    /** Start of each bucket in BUCKET_NODES, and the end of the last.*/
+    vector<int> bucket_offsets;
+    /** Index in PASS_NODES of each node of BUCKET_NODES.*/
+    vector<int> bucket_order;
+    /** Sum of each node of BUCKET_NODES.*/
+    vector<double> bucket_sums;
+    /** Start in BUCKET_NODES of each chunk of at most PASS_CHUNK nodes of one bucket, and the end of the last.*/
+    vector<int> chunk_firsts;
+    /** Bucket of each chunk.*/
+    vector<int> chunk_lengths;
+    /** Column in POPULATIONS of each product, so that each product has its own slot in a row.*/
+    vector<int> product_cols;
+    /** Threads the stem sums and product loops run on, or nullptr to run them on the calling thread.*/
+    shared_ptr<thread_pool> pool;
+
+    /** Populations of every product at the end of an irradiation step of one length, from the populations at its
+     * start and its production rate, as irradiate reuses them for every step of that length.
+     */
+    struct step_response {
+        /** First entry of each product (in the order of PRODUCTS) in ROOT_COLS and DECAYS, and the end of the last.*/
+        vector<int> offsets;
+        /** Column in POPULATIONS of the first isotope of the stems of each entry.*/
+        vector<int> root_cols;
+        /** Population of the product at the end of the step per unit population of the isotope of ROOT_COLS at
+         * its start, summed over the stems from it.
+         */
+        vector<double> decays;
+        /** Population of each product at the end of the step per fission/second, from zero.*/
+        vector<double> units;
+        /** Population of each product at the end of the step per fission/second/second of a fission rate rising
+         * from zero at its start, from zero.
+         */
+        vector<double> ramps;
+    };
+    /** Matrix exponential solver used instead of the stems when the deck selects SOLVER:CRAM, otherwise nullptr.*/
+    shared_ptr<const cram_solver> cram;
+    /** Sums of exponentials solver used instead of the stems when the deck selects SOLVER:EXPSUM, otherwise
+     * nullptr.
+     */
+    shared_ptr<const expsum_solver> expsums;
+    /** DECAY_FACTORS of every time of a multi-time pass, one table after another.*/
+    vector<double> decay_tables;
+    /** DECAY_FACTORS_END of every count window of a multi-time pass, one table after another.*/
+    vector<double> decay_tables_end;
+
+    double stems_total(int iZA) const;
+    void fill_decay_factors(vector<double> &factors, double dt) const;
+    void fill_growth_factors();
+    void fill_ramp_factors(double dt);
+    void fill_decay_tables(vector<double> &tables, const vector<double> &dts) const;
+    void fill_decay_steps(vector<double> &tables, double dt_first, double step, int n_steps) const;
+
+    /** Runs TASK(I) for I from 0 to N - 1, across POOL if there is one.*/
+    template<typename Task>
+    void run_tasks(int n, Task &task) {
+        if (pool) {
+            pool->run(n, task);
+        } else {
+            for (int i = 0; i < n; ++i) {
+                task(i);
+            }
+        }
+    }
+
+    void bucket_pass();
+    void unbucket_pass(int n_times = 1);
+    void batch_decay_pass();
+    void cont_prod_pass(double dt);
+    void ramp_prod_pass(double dt);
+    void batch_rate_pass();
+    void batch_decay_times_pass(int n_times);
+    void batch_rate_times_pass(int n_times);
+    void set_node_values(int time);
+    void add_totals(double t);
+    void fill_product_totals(double *totals);
+    void add_spectra(double t1, double t2, const double *decays);
+
+    void gather_decay_pass(int row0);
+    void batch_decay_run(const double *times, int n_times, double t0);
+    step_response build_response(double dt);
+    void superpose_step(double P, double P_end, double t1, double t0, const step_response &response);
+
+    vector<double> isotope_populations(int row) const;
+    void add_isotope_totals(double t, const vector<double> &totals);
+    void add_isotope_spectra(double t1, double t2, const expsum_solver::expansion &sums, double t0);
+
+    vector<pair<double, double>> add_spectrum(int iZA, double batch_rate, double t1, double t2, bool add);
+
 public:
 
 
-    void import_species_data(species_data data_in);
-    void import_chains_data(chains_data chains_in);
+    void import_species_data(shared_ptr<const species_data> data_in);
+    void import_chains_data(shared_ptr<const chains_data> chains_in);
+    void set_threads(int n_threads);
+    bool set_solver(const string &name);
+    string get_solver() const;
 
     void initialize(map<int, double> init_pops);
 
     double get_population(int iZA, double t);
-    map<double, map<int, double>> get_populations();
+    const population_matrix &get_populations() const;
 
     void set_population(int iZA, double t, double pop_in);
 
     double get_emissions(int iZA, double t1, double t2, double Eg);
     double get_emissions(int iZA, pair<double, double> t_key, double Eg);
 
-    map<pair<double, double>, map<int, map<double, double>>> get_spectra();
+    const spectrum_matrix &get_spectra() const;
 
     void add_irrad(double t, double P);
-    vector<pair<double, double>> get_irrad_scheme();
+    void add_irrad(double t, double P, double P_end);
+    vector<tuple<double, double, double>> get_irrad_scheme();
 
     void add_after(double t);
     vector<double> get_after_irrad();
@@ -54,19 +255,23 @@ public:
 
     map<int, double> get_initial();
 
-    double batch_decay_stem(vector<int> &stem, vector<double> &stem_dcs, vector<double> &stem_brs, double t1, double t0);
     double batch_decay(int iZA, double t1, double t0, bool add);
     void batch_decay_all(double t1, double t0);
+    void batch_decay_times(const vector<double> &times, double t0);
 
-    double cont_prod_stem(vector<int> &stem, vector<double> &stem_dcs, vector<double> &stem_brs, double P, double t1, double t0);
     double cont_prod(int iZA, double P, double t1, double t0, bool add);
     void cont_prod_all(double P, double t1, double t0);
+    void ramp_prod_all(double P, double P_end, double t1, double t0);
+    void irradiate(const vector<tuple<double, double, double>> &steps);
 
-    double batch_rate_indef_stem(vector<int> &stem, vector<double> &stem_dcs, vector<double> &stem_brs, double t1, double t0);
     vector<pair<double, double>> batch_spectrum(int iZA, double t1, double t2, double t0, bool add);
     void batch_spectrum_all(double t1, double t2, double t0);
+    void batch_spectrum_windows(const vector<pair<double, double>> &windows, double t0);
 
+    void save_header(ofstream &file, const vector<int> &columns) const;
     void save_populations(string pops_out);
+    bool save_series(const string &series_out, double t_start, double t_end, int n_points, bool log_grid,
+                     bool activities, double t0);
     void save_spectra(string gammas_out);
 };
 
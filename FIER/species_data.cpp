@@ -8,26 +8,516 @@
 
 #include "species_data.h"
 #include "helper_functions.h"
+#include <cstring> // for reading the binary cache
+#include <thread> // for parallel imports
+#include <future> // for parallel imports
+#include <exception> // for passing parse errors between threads
+#include <filesystem> // for listing the yields library
+
+/** Smallest piece of a data file parsed on its own thread, in bytes.*/
+static const size_t IMPORT_CHUNK_SIZE = 1 << 18;
+
+/** Number of threads used to parse one data file.
+ *
+ * @return Number of hardware threads, at least 1.
+ */
+static size_t import_threads() {
+    return max(1u, thread::hardware_concurrency());
+}
+
+/** Identifies FIER nuclear data cache files.*/
+static const char CACHE_MAGIC[8] = {'F', 'I', 'E', 'R', 'N', 'D', 'C', '\0'};
+/** Layout version of the nuclear data cache. Increment whenever the layout written by save_cache changes.*/
+static const uint32_t CACHE_VERSION = 2;
+
+/** Identifies FIER yields library files.*/
+static const char YIELDS_MAGIC[8] = {'F', 'I', 'E', 'R', 'Y', 'L', 'D', '\0'};
+/** Layout version of the yields library. Increment whenever the layout written by save_yields_library changes.*/
+static const uint32_t YIELDS_VERSION = 2;
+/** Size of the yields library header: magic, version, slot count, record count and the hash of the index and
+ * records.
+ */
+static const size_t YIELDS_HEADER_SIZE = 32;
+/** Longest yields file name (without extension) a library slot can hold, including the terminating 0.*/
+static const size_t YIELDS_KEY_SIZE = 24;
+
+/** One slot of the yields library hash index. KEY is the lower case yields file name, and the file's
+ * records are RECORDS[OFFSET] to RECORDS[OFFSET + COUNT - 1]. Empty slots have an empty key.
+ */
+struct yields_slot {
+    char key[YIELDS_KEY_SIZE];
+    uint64_t offset;
+    uint64_t count;
+};
+
+/** One yield in the yields library.*/
+struct yields_entry {
+    int32_t iZA;
+    int32_t padding;
+    double yield;
+    double yield_sig;
+};
+
+/** Normalizes a yields library key so that lookups ignore case.
+ *
+ * @param key Yields file name without directory or extension.
+ * @return KEY in lower case.
+ */
+static string yields_key(string key) {
+    transform(key.begin(), key.end(), key.begin(), ::tolower);
+    return key;
+}
+
+/** Reads every line of a data file into records, using PARSE to turn a line into a record. The lines are
+ * read from a memory map of the file, and large files are split into line-aligned chunks that are parsed on
+ * separate threads. The chunks are joined in file order, so the records are in the same order as the lines.
+ * Parse errors are rethrown on the calling thread.
+ *
+ * @param filename String name of the data file.
+ * @param parse Function turning a line and a token buffer into a record.
+ * @param records Filled with one record per line.
+ * @return TRUE if the file was read, FALSE if it could not be opened.
+ */
+template<typename Record>
+static bool read_records(string filename, Record (*parse)(string_view, vector<string_view> &),
+                         vector<Record> &records) {
+    records.clear();
+    mapped_file file;
+    if (!file.open(filename)) {
+        return false;
+    }
+    const char *first = file.data();
+    const char *last = file.data() + file.size();
+
+    // split at line ends into chunks of at least IMPORT_CHUNK_SIZE bytes
+    size_t n_chunks = max<size_t>(1, min<size_t>(import_threads(), file.size() / IMPORT_CHUNK_SIZE));
+    vector<const char *> bounds;
+    bounds.push_back(first);
+    for (size_t i = 1; i < n_chunks; ++i) {
+        const char *bound = max(bounds.back(), first + file.size() * i / n_chunks);
+        while (bound != last && bound != first && *(bound - 1) != '\n') {
+            ++bound;
+        }
+        bounds.push_back(bound);
+    }
+    bounds.push_back(last);
+
+    vector<vector<Record> > chunk_records(n_chunks);
+    vector<exception_ptr> errors(n_chunks);
+    auto parse_chunk = [&](size_t c) {
+        try {
+            vector<string_view> parts;
+            const char *pos = bounds[c];
+            while (pos < bounds[c + 1]) {
+                auto line_end = static_cast<const char *>(memchr(pos, '\n', bounds[c + 1] - pos));
+                if (line_end == nullptr) {
+                    line_end = bounds[c + 1];
+                }
+                chunk_records[c].push_back(parse(string_view(pos, line_end - pos), parts));
+                pos = line_end + 1;
+            }
+        } catch (...) {
+            errors[c] = current_exception();
+        }
+    };
+    vector<thread> workers;
+    for (size_t c = 1; c < n_chunks; ++c) {
+        workers.emplace_back(parse_chunk, c);
+    }
+    parse_chunk(0);
+    for (thread &worker : workers) {
+        worker.join();
+    }
+    for (exception_ptr &error : errors) {
+        if (error) {
+            rethrow_exception(error);
+        }
+    }
+
+    size_t n_records = 0;
+    for (auto &chunk : chunk_records) {
+        n_records = n_records + chunk.size();
+    }
+    records.reserve(n_records);
+    for (auto &chunk : chunk_records) {
+        records.insert(records.end(), chunk.begin(), chunk.end());
+    }
+    return true;
+}
+
+/** Writes a zero halflife warning to the error log.
+ *
+ * @param iZA Unique hash of isotope.
+ * @param error_file Error file name, NONE for no log.
+ */
+static void log_zero_halflife(int iZA, string error_file) {
+    if (error_file != "NONE") {
+        ofstream error_log;
+        error_log.open(error_file, ios_base::app);
+        error_log << "WARNING: 0 halflife for = " << iZA << '\n';
+        error_log.close();
+    }
+}
+
+/** Parses one line of a yields file.
+ *
+ * @param line Line of the file.
+ * @param parts Token buffer reused between lines.
+ * @return Yield of the isotope on the line.
+ */
+species_data::yield_record species_data::parse_yield(string_view line, vector<string_view> &parts) {
+    split_view(line, ',', parts, 5);
+    int Z = to_int(parts[0]);
+    int A = to_int(parts[1]);
+    int I = to_int(parts[2]);
+    double Y = to_double(parts[3]) / 100.0;
+    double Y_sig = to_double(parts[4]) / 100.0;
+    int iZA = Z * 10000 + A + I * 1000;
+    return {iZA, Y, Y_sig};
+}
+
+/** Parses one line of an isotopes file. Halflives of 0.9e35 s or more are stable, and halflives of 0 are
+ * replaced with 1e-6 s.
+ *
+ * @param line Line of the file.
+ * @param parts Token buffer reused between lines.
+ * @return Data of the isotope on the line.
+ */
+species_data::isotope_record species_data::parse_isotope(string_view line, vector<string_view> &parts) {
+    split_view(line, ',', parts, 6);
+    int Z = to_int(parts[0]);
+    int A = to_int(parts[1]);
+    int I = to_int(parts[2]);
+    double E = to_double(parts[3]);
+    double halflife = to_double(parts[4]);
+    double halflife_sig = to_double(parts[5]);
+    int iZA = Z * 10000 + A + I * 1000;
+    if (halflife >= 0.9e35) {
+        halflife = numeric_limits<double>::infinity();
+        halflife_sig = 0.0;
+    }
+    bool zero_halflife = (halflife == 0.0);
+    if (zero_halflife) {
+        halflife = 1e-6;
+    }
+    return {iZA, E, halflife, halflife_sig, zero_halflife};
+}
+
+/** Parses one line of a decays file. Halflives are corrected the same way as in parse_isotope.
+ *
+ * @param line Line of the file.
+ * @param parts Token buffer reused between lines.
+ * @return Decay mode on the line.
+ */
+species_data::decay_record species_data::parse_decay(string_view line, vector<string_view> &parts) {
+    split_view(line, ',', parts, 10);
+    int Zp = to_int(parts[0]);
+    int Ap = to_int(parts[1]);
+    int Ip = to_int(parts[2]);
+    double halflife = to_double(parts[3]);
+    double halflife_sig = to_double(parts[4]);
+    double branching = to_double(parts[5]) / 100.0;
+    double branching_sig = to_double(parts[6]) / 100.0;
+    int Zd = to_int(parts[7]);
+    int Ad = to_int(parts[8]);
+    int Id = to_int(parts[9]);
+    int iZAp = Zp * 10000 + Ap + Ip * 1000;
+    int iZAd = Zd * 10000 + Ad + Id * 1000;
+    if (halflife >= 0.9e35) {
+        halflife = numeric_limits<double>::infinity();
+        halflife_sig = 0.0;
+    }
+    bool zero_halflife = (halflife == 0.0);
+    if (zero_halflife) {
+        halflife = 1e-6;
+    }
+    return {iZAp, iZAd, halflife, halflife_sig, branching, branching_sig, zero_halflife};
+}
+
+/** Parses one line of a gammas file.
+ *
+ * @param line Line of the file.
+ * @param parts Token buffer reused between lines.
+ * @return Gamma line on the line.
+ */
+species_data::gamma_record species_data::parse_gamma(string_view line, vector<string_view> &parts) {
+    split_view(line, ',', parts, 7);
+    int Z = to_int(parts[0]);
+    int A = to_int(parts[1]);
+    int I = to_int(parts[2]);
+    double Eg = to_double(parts[3]);
+    double Eg_sig = to_double(parts[4]);
+    double Ig = to_double(parts[5]) / 100.0;
+    double Ig_sig = to_double(parts[6]) / 100.0;
+    int iZA = Z * 10000 + A + I * 1000;
+    return {iZA, Eg, Eg_sig, Ig, Ig_sig};
+}
+
+/** Gives IZA the next isotope ID if it does not have one yet. Every per-isotope array grows by one entry,
+ * holding no data: no yield, no halflife, no decay modes and no gamma lines.
+ *
+ * @param iZA Unique hash of isotope.
+ * @return Isotope ID of IZA.
+ */
+int species_data::add_isotope(int iZA) {
+    int id = get_id(iZA);
+    if (id >= 0) {
+        return id;
+    }
+    id = n_isotopes();
+    edit_table();
+    table->ids.emplace(iZA, id);
+    table->isotopes.push_back(iZA);
+    yields.push_back(0.0);
+    table->yields_sig.push_back(0.0);
+    table->yield_flags.push_back(0);
+    table->energies.push_back(0.0);
+    halflives.push_back(0.0);
+    table->halflives_sig.push_back(0.0);
+    table->halflife_flags.push_back(0);
+    dcs.push_back((log(2.0)) / 0.0);
+    table->decay_offsets.push_back(static_cast<int>(table->decay_daughters.size()));
+    table->decay_counts.push_back(0);
+    table->gamma_offsets.push_back(table->gamma_offsets.back());
+    return id;
+}
+
+/** Sets the halflife of isotope ID and updates its decay constant to match.
+ *
+ * @param id Isotope ID.
+ * @param halflife New halflife.
+ */
+void species_data::set_halflife_id(int id, double halflife) {
+    halflives[id] = halflife;
+    dcs[id] = (log(2.0)) / halflife;
+    if (!table->halflife_flags[id]) {
+        edit_table().halflife_flags[id] = 1;
+    }
+}
+
+/** Removes the Nth decay mode of isotope ID. The modes after it move down one place.
+ *
+ * @param id Isotope ID.
+ * @param n Decay mode to remove.
+ */
+void species_data::remove_decay_id(int id, int n) {
+    edit_table();
+    int first = table->decay_offsets[id] + n;
+    int last = table->decay_offsets[id] + table->decay_counts[id];
+    copy(table->decay_daughters.begin() + first + 1, table->decay_daughters.begin() + last, table->decay_daughters.begin() + first);
+    copy(decay_brs.begin() + first + 1, decay_brs.begin() + last, decay_brs.begin() + first);
+    copy(table->decay_brs_sig.begin() + first + 1, table->decay_brs_sig.begin() + last, table->decay_brs_sig.begin() + first);
+    table->decay_counts[id] = table->decay_counts[id] - 1;
+}
+
+/** Lists the isotopes flagged in INCLUDE in ascending order of their unique hash, the order in which the
+ * data is checked, sampled and written.
+ *
+ * @param include One flag per isotope ID.
+ * @return Isotope IDs with a non-zero flag.
+ */
+vector<int> species_data::sorted_ids(const vector<char> &include) const {
+    vector<int> res;
+    for (int id = 0; id < n_isotopes(); ++id) {
+        if (include[id]) {
+            res.push_back(id);
+        }
+    }
+    sort(res.begin(), res.end(), [&](int a, int b) { return table->isotopes[a] < table->isotopes[b]; });
+    return res;
+}
+
+/** Retrieves all yields as a map of isotopes and values.
+ *
+ * @return Yield of every fission fragment.
+ */
+map<int, double> species_data::get_yields() const {
+    map<int, double> res;
+    for (int id : sorted_ids(table->yield_flags)) {
+        res.emplace_hint(res.end(), table->isotopes[id], yields[id]);
+    }
+    return res;
+}
+
+/** Retrieves the fission fragments, the isotopes with a yield entry.
+ *
+ * @return Unique hashes of the fragments in ascending order.
+ */
+vector<int> species_data::get_fragments() const {
+    vector<int> res;
+    for (int id : sorted_ids(table->yield_flags)) {
+        res.push_back(table->isotopes[id]);
+    }
+    return res;
+}
+
+/** Hashes everything build_chains reads: the isotopes, decay constants, decay modes and fission fragments.
+ * Decay chains built from data with the same hash are the same.
+ *
+ * @return 64 bit FNV-1a hash.
+ */
+uint64_t species_data::chains_hash() const {
+    string bytes;
+    cache_write_vector(bytes, table->isotopes);
+    cache_write_vector(bytes, dcs);
+    cache_write_vector(bytes, table->decay_counts);
+    cache_write_vector(bytes, table->decay_daughters);
+    cache_write_vector(bytes, decay_brs);
+    cache_write_vector(bytes, table->yield_flags);
+    return fnv1a_hash(bytes.data(), bytes.size());
+}
+
+/** Stores parsed yields in YIELDS and YIELDS_SIG.
+ *
+ * @param records Yields in file order.
+ */
+void species_data::apply_yields(const vector<yield_record> &records) {
+    edit_table();
+    for (const yield_record &record : records) {
+        int id = add_isotope(record.iZA);
+        yields[id] = record.yield;
+        table->yields_sig[id] = record.yield_sig;
+        table->yield_flags[id] = 1;
+    }
+}
+
+/** Stores parsed isotopes in ENERGIES, HALFLIVES and HALFLIVES_SIG.
+ *
+ * @param records Isotopes in file order.
+ * @param error_file Optional error file name.
+ */
+void species_data::apply_isotopes(const vector<isotope_record> &records, string error_file) {
+    edit_table();
+    for (const isotope_record &record : records) {
+        if (record.zero_halflife) {
+            log_zero_halflife(record.iZA, error_file);
+        }
+        int id = add_isotope(record.iZA);
+        table->energies[id] = record.energy;
+        set_halflife_id(id, record.halflife);
+        table->halflives_sig[id] = record.halflife_sig;
+    }
+}
+
+/** Stores parsed decay modes in the decay arrays, and parent halflives in HALFLIVES and HALFLIVES_SIG.
+ * The decay arrays are laid out again so that the modes of each isotope stay contiguous, with any modes
+ * already stored ahead of the new ones.
+ *
+ * @param records Decay modes in file order.
+ * @param error_file Optional error file name.
+ */
+void species_data::apply_decays(const vector<decay_record> &records, string error_file) {
+    edit_table();
+    vector<int> parents;
+    vector<int> daughters;
+    parents.reserve(records.size());
+    daughters.reserve(records.size());
+    for (const decay_record &record : records) {
+        if (record.zero_halflife) {
+            log_zero_halflife(record.parent, error_file);
+        }
+        int parent = add_isotope(record.parent);
+        daughters.push_back(add_isotope(record.daughter));
+        set_halflife_id(parent, record.halflife);
+        table->halflives_sig[parent] = record.halflife_sig;
+        parents.push_back(parent);
+    }
+
+    int n = n_isotopes();
+    vector<int> new_counts(table->decay_counts);
+    for (int parent : parents) {
+        new_counts[parent] = new_counts[parent] + 1;
+    }
+    vector<int> new_offsets(n);
+    int n_modes = 0;
+    for (int id = 0; id < n; ++id) {
+        new_offsets[id] = n_modes;
+        n_modes = n_modes + new_counts[id];
+    }
+    vector<int> new_daughters(n_modes);
+    vector<double> new_brs(n_modes);
+    vector<double> new_brs_sig(n_modes);
+    for (int id = 0; id < n; ++id) {
+        for (int j = 0; j < table->decay_counts[id]; ++j) {
+            new_daughters[new_offsets[id] + j] = table->decay_daughters[table->decay_offsets[id] + j];
+            new_brs[new_offsets[id] + j] = decay_brs[table->decay_offsets[id] + j];
+            new_brs_sig[new_offsets[id] + j] = table->decay_brs_sig[table->decay_offsets[id] + j];
+        }
+    }
+    for (size_t i = 0; i < records.size(); ++i) {
+        int slot = new_offsets[parents[i]] + table->decay_counts[parents[i]];
+        new_daughters[slot] = daughters[i];
+        new_brs[slot] = records[i].branching;
+        new_brs_sig[slot] = records[i].branching_sig;
+        table->decay_counts[parents[i]] = table->decay_counts[parents[i]] + 1;
+    }
+    table->decay_offsets.swap(new_offsets);
+    table->decay_daughters.swap(new_daughters);
+    decay_brs.swap(new_brs);
+    table->decay_brs_sig.swap(new_brs_sig);
+}
+
+/** Stores parsed gamma lines in the gamma arrays. The arrays are laid out again so that the lines of each
+ * isotope stay contiguous, with any lines already stored ahead of the new ones.
+ *
+ * @param records Gamma lines in file order.
+ */
+void species_data::apply_gammas(const vector<gamma_record> &records) {
+    edit_table();
+    vector<int> owners;
+    owners.reserve(records.size());
+    for (const gamma_record &record : records) {
+        owners.push_back(add_isotope(record.iZA));
+    }
+
+    int n = n_isotopes();
+    vector<int> new_offsets(n + 1, 0);
+    for (int id = 0; id < n; ++id) {
+        new_offsets[id + 1] = n_gammas_id(id);
+    }
+    for (int owner : owners) {
+        new_offsets[owner + 1] = new_offsets[owner + 1] + 1;
+    }
+    for (int id = 0; id < n; ++id) {
+        new_offsets[id + 1] = new_offsets[id + 1] + new_offsets[id];
+    }
+    int n_lines = new_offsets[n];
+    vector<double> new_energies(n_lines);
+    vector<double> new_energies_sig(n_lines);
+    vector<double> new_intensities(n_lines);
+    vector<double> new_intensities_sig(n_lines);
+    vector<int> filled(n);
+    for (int id = 0; id < n; ++id) {
+        for (int j = 0; j < n_gammas_id(id); ++j) {
+            new_energies[new_offsets[id] + j] = table->gamma_energies[table->gamma_offsets[id] + j];
+            new_energies_sig[new_offsets[id] + j] = table->gamma_energies_sig[table->gamma_offsets[id] + j];
+            new_intensities[new_offsets[id] + j] = gamma_intensities[table->gamma_offsets[id] + j];
+            new_intensities_sig[new_offsets[id] + j] = table->gamma_intensities_sig[table->gamma_offsets[id] + j];
+        }
+        filled[id] = n_gammas_id(id);
+    }
+    for (size_t i = 0; i < records.size(); ++i) {
+        int slot = new_offsets[owners[i]] + filled[owners[i]];
+        new_energies[slot] = records[i].energy;
+        new_energies_sig[slot] = records[i].energy_sig;
+        new_intensities[slot] = records[i].intensity;
+        new_intensities_sig[slot] = records[i].intensity_sig;
+        filled[owners[i]] = filled[owners[i]] + 1;
+    }
+    table->gamma_offsets.swap(new_offsets);
+    table->gamma_energies.swap(new_energies);
+    table->gamma_energies_sig.swap(new_energies_sig);
+    gamma_intensities.swap(new_intensities);
+    table->gamma_intensities_sig.swap(new_intensities_sig);
+}
 
 /** Imports yields from YIELDS_FILENAME.
  * @param yields_filename String name of the file with yields.
  */
 void species_data::import_yields(string yields_filename) {
-    string line;
-    ifstream yields_file(yields_filename);
-    if (yields_file.is_open()) {
-        while (getline(yields_file, line)) {
-            vector <string> parts = split(line, ',');
-            int Z = stoi(parts[0]);
-            int A = stoi(parts[1]);
-            int I = stoi(parts[2]);
-            double Y = stod(parts[3]) / 100.0;
-            double Y_sig = stod(parts[4]) / 100.0;
-            int iZA = Z * 10000 + A + I * 1000;
-            yields[iZA] = Y;
-            yields_sig[iZA] = Y_sig;
-        }
-        yields_file.close();
+    vector<yield_record> records;
+    if (read_records(yields_filename, parse_yield, records)) {
+        apply_yields(records);
     } else cout << "ERROR: Cannot find yields file.\n";
 }
 
@@ -37,43 +527,9 @@ void species_data::import_yields(string yields_filename) {
  * @param error_file Optional error file name.
  */
 void species_data::import_decays(string decays_filename, string error_file ) {
-    string line;
-    ifstream decays_file(decays_filename);
-    if (decays_file.is_open()) {
-        while (getline(decays_file, line)) {
-            vector <string> parts = split(line, ',');
-            int Zp = stoi(parts[0]);
-            int Ap = stoi(parts[1]);
-            int Ip = stoi(parts[2]);
-            double halflife = stod(parts[3]);
-            double halflife_sig = stod(parts[4]);
-            double branching = stod(parts[5]) / 100.0;
-            double branching_sig = stod(parts[6]) / 100.0;
-            int Zd = stoi(parts[7]);
-            int Ad = stoi(parts[8]);
-            int Id = stoi(parts[9]);
-            int iZAp = Zp * 10000 + Ap + Ip * 1000;
-            int iZAd = Zd * 10000 + Ad + Id * 1000;
-            if (halflife >= 0.9e35) {
-                halflife = numeric_limits<double>::infinity();
-                halflife_sig = 0.0;
-            }
-            if (halflife == 0.0) {
-                halflife = 1e-6;
-                if (error_file != "NONE") {
-                    ofstream error_log;
-                    error_log.open(error_file, ios_base::app);
-                    error_log << "WARNING: 0 halflife for = " << iZAp << '\n';
-                    error_log.close();
-                }
-            }
-
-            halflives[iZAp] = halflife;
-            halflives_sig[iZAp] = halflife_sig;
-            decays[iZAp].emplace_back(iZAd, branching);
-            decays_sig[iZAp].emplace_back(iZAd, branching_sig);
-        }
-        decays_file.close();
+    vector<decay_record> records;
+    if (read_records(decays_filename, parse_decay, records)) {
+        apply_decays(records, error_file);
     } else cout << "ERROR: Cannot find decays file.\n";
 }
 
@@ -83,38 +539,63 @@ void species_data::import_decays(string decays_filename, string error_file ) {
  * @param error_file String of a file to output errors (OPTIONAL).
  */
 void species_data::import_isotopes(string isotopes_filename, string error_file) {
-    string line;
-    ifstream isotopes_file(isotopes_filename);
-    if (isotopes_file.is_open()) {
-        while (getline(isotopes_file, line)) {
-            vector <string> parts = split(line, ',');
-
-            int Z = stoi(parts[0]);
-            int A = stoi(parts[1]);
-            int I = stoi(parts[2]);
-            double E = stod(parts[3]);
-            double halflife = stod(parts[4]);
-            double halflife_sig = stod(parts[5]);
-            int iZA = Z * 10000 + A + I * 1000;
-            if (halflife >= 0.9e35) {
-                halflife = numeric_limits<double>::infinity();
-                halflife_sig = 0.0;
-            }
-            if (halflife == 0.0) {
-                halflife = 1e-6;
-                if (error_file != "NONE") {
-                    ofstream error_log;
-                    error_log.open(error_file, ios_base::app);
-                    error_log << "WARNING: 0 halflife for = " << iZA << '\n';
-                    error_log.close();
-                }
-            }
-            energies[iZA] = E;
-            halflives[iZA] = halflife;
-            halflives_sig[iZA] = halflife_sig;
-        }
-        isotopes_file.close();
+    vector<isotope_record> records;
+    if (read_records(isotopes_filename, parse_isotope, records)) {
+        apply_isotopes(records, error_file);
+    } else cout << "ERROR: Cannot find isotopes file.\n";
+}
+
+/** Imports gamma data from GAMMAS_FILENAME into GAMMAS field.
+ *
+ * @param gammas_filename String name of gamma data.
+ */
+void species_data::import_gammas(string gammas_filename) {
+    vector<gamma_record> records;
+    if (read_records(gammas_filename, parse_gamma, records)) {
+        apply_gammas(records);
+    } else cout << "ERROR: Cannot find decays file.\n";
+}
+
+/** Imports the isotopes, decays, gammas and yields files at the same time. Each file is read and parsed
+ * on its own thread (large files are further split by read_records), then the records are stored in the
+ * same order as import_isotopes, import_decays, import_gammas and import_yields would store them, so the
+ * result does not depend on which file finishes first.
+ *
+ * @param isotopes_filename String of the file holding isotope data.
+ * @param decays_filename String of filename with decay data.
+ * @param gammas_filename String name of gamma data.
+ * @param yields_filename String name of the file with yields, NONE if the yields are imported separately.
+ * @param error_file Optional error file name.
+ */
+void species_data::import_all(string isotopes_filename, string decays_filename, string gammas_filename,
+                              string yields_filename, string error_file) {
+    vector<isotope_record> isotope_records;
+    vector<decay_record> decay_records;
+    vector<gamma_record> gamma_records;
+    vector<yield_record> yield_records;
+    auto isotopes_read = async(launch::async, [&]() {
+        return read_records(isotopes_filename, parse_isotope, isotope_records);
+    });
+    auto decays_read = async(launch::async, [&]() {
+        return read_records(decays_filename, parse_decay, decay_records);
+    });
+    auto gammas_read = async(launch::async, [&]() {
+        return read_records(gammas_filename, parse_gamma, gamma_records);
+    });
+    bool yields_read = (yields_filename == "NONE") || read_records(yields_filename, parse_yield, yield_records);
+
+    if (isotopes_read.get()) {
+        apply_isotopes(isotope_records, error_file);
     } else cout << "ERROR: Cannot find isotopes file.\n";
+    if (decays_read.get()) {
+        apply_decays(decay_records, error_file);
+    } else cout << "ERROR: Cannot find decays file.\n";
+    if (gammas_read.get()) {
+        apply_gammas(gamma_records);
+    } else cout << "ERROR: Cannot find decays file.\n";
+    if (yields_read) {
+        apply_yields(yield_records);
+    } else cout << "ERROR: Cannot find yields file.\n";
 }
 
 /** Checks nuclear data parameters. Looks for inaccuracies, such
@@ -124,11 +605,21 @@ void species_data::import_isotopes(string isotopes_filename, string error_file)
  * @param error_file Optional error file location.
  */
 void species_data::check_data(bool change, string error_file) {
+    edit_table();
     // check that unstable fragments have a decay daughter
-    vector<int> fragments = get_keys(yields);
-    for (int frag : fragments) {
-        if ((n_decays(frag) == 0) && (get_DC(frag) != 0.0))
+    // a stranded fragment's yield moves to the first isobar with decay data, where fragments already
+    // checked count as having decay data
+    vector<int> fragments = sorted_ids(table->yield_flags);
+    vector<char> checked(n_isotopes(), 0);
+    auto has_decay_data = [&](int iZA) {
+        int id = get_id(iZA);
+        return (id >= 0) && (table->decay_counts[id] > 0 || checked[id]);
+    };
+    for (int frag_id : fragments) {
+        checked[frag_id] = 1;
+        if ((n_decays_id(frag_id) == 0) && (get_DC_id(frag_id) != 0.0))
         {
+            int frag = table->isotopes[frag_id];
             int Z = frag / 10000;
             int I = (frag - Z * 10000) / 1000;
             int A = frag - Z * 10000 - I * 1000;
@@ -143,12 +634,14 @@ void species_data::check_data(bool change, string error_file) {
                 if (change) {
                     int newiZA = Z * 10000 + A;
                     int nextZ = Z;
-                    while (decays.find(newiZA) == decays.end()) {
+                    while (!has_decay_data(newiZA)) {
                         nextZ = nextZ + 1;
                         newiZA = nextZ * 10000 + A;
                     }
-                    yields[newiZA] = yields[newiZA] + yields[frag];
-                    yields[frag] = 0.0;
+                    int new_id = get_id(newiZA);
+                    yields[new_id] = yields[new_id] + yields[frag_id];
+                    table->yield_flags[new_id] = 1;
+                    yields[frag_id] = 0.0;
                     if (error_file != "NONE") {
                         ofstream error_log;
                         error_log.open(error_file, ios_base::app);
@@ -167,12 +660,14 @@ void species_data::check_data(bool change, string error_file) {
                 if (change) {
                     int newiZA = (Z + 1) * 10000 + A;
                     int nextZ = Z + 1;
-                    while (decays.find(newiZA) == decays.end()) {
+                    while (!has_decay_data(newiZA)) {
                         nextZ = nextZ + 1;
                         newiZA = nextZ * 10000 + A;
                     }
-                    yields[newiZA] = yields[newiZA] + yields[frag];
-                    yields[frag] = 0.0;
+                    int new_id = get_id(newiZA);
+                    yields[new_id] = yields[new_id] + yields[frag_id];
+                    table->yield_flags[new_id] = 1;
+                    yields[frag_id] = 0.0;
                     if (error_file != "NONE") {
                         ofstream error_log;
                         error_log.open(error_file, ios_base::app);
@@ -185,18 +680,23 @@ void species_data::check_data(bool change, string error_file) {
     }
 
     // check that species with non-infinite half-lives have decay modes
-    vector<int> species = get_keys(halflives);
-    for (int specie : species) {
-        if ((n_decays(specie) == 0) && (halflives[specie] <= 0.9e35)) 
+    // fragments without a halflife are checked as having a halflife of 0
+    vector<char> include(n_isotopes());
+    for (int id = 0; id < n_isotopes(); ++id) {
+        include[id] = table->halflife_flags[id] || table->yield_flags[id];
+    }
+    vector<int> species = sorted_ids(include);
+    for (int id : species) {
+        if ((n_decays_id(id) == 0) && (halflives[id] <= 0.9e35))
         {
             if (error_file != "NONE") {
                 ofstream error_log;
                 error_log.open(error_file, ios_base::app);
-                error_log << "WARNING: unstable species with no decay modes: " << specie << '\n';
+                error_log << "WARNING: unstable species with no decay modes: " << table->isotopes[id] << '\n';
                 error_log.close();
             }
             if (change) {
-                halflives[specie] = numeric_limits<double>::infinity();
+                set_halflife_id(id, numeric_limits<double>::infinity());
                 if (error_file != "NONE") {
                     ofstream error_log;
                     error_log.open(error_file, ios_base::app);
@@ -208,28 +708,26 @@ void species_data::check_data(bool change, string error_file) {
     }
 
     // check for degenerate decay modes
-    species = get_keys(decays);
-    for (int specie : species) {
-        if (halflives[specie] < 0.9e35) {
-            for (int j = 0; j < n_decays(specie); ++j) {
-                for (int k = 0; k < n_decays(specie); ++k) {
+    // fragments are checked along with every isotope that has decay modes
+    for (int id = 0; id < n_isotopes(); ++id) {
+        include[id] = (table->decay_counts[id] > 0) || table->yield_flags[id];
+    }
+    species = sorted_ids(include);
+    for (int id : species) {
+        if (halflives[id] < 0.9e35) {
+            for (int j = 0; j < n_decays_id(id); ++j) {
+                for (int k = 0; k < n_decays_id(id); ++k) {
                     if (j != k) {
-                        if (get_decay_daughteriZA(specie, j) == get_decay_daughteriZA(specie, k)) {
+                        if (get_decay_daughter_id(id, j) == get_decay_daughter_id(id, k)) {
                             if (error_file != "NONE") {
                                 ofstream error_log;
                                 error_log.open(error_file, ios_base::app);
-                                error_log << "WARNING: degenerate decay modes in " << specie << '\n';
+                                error_log << "WARNING: degenerate decay modes in " << table->isotopes[id] << '\n';
                                 error_log.close();
                             }
 
                             if (change) {
-                                vector <pair<int, double>> old_decays = decays[specie];
-                                decays[specie].clear();
-                                for (int q = 0; q < old_decays.size(); q++) {
-                                    if (q != k) {
-                                        decays[specie].push_back(old_decays[q]);
-                                    }
-                                }
+                                remove_decay_id(id, k);
 
                                 if (error_file != "NONE") {
                                     ofstream error_log;
@@ -248,25 +746,25 @@ void species_data::check_data(bool change, string error_file) {
 
     // check that all decays add to 100
     double tol = 0.001;
-    for (int specie : species) {
-        if (halflives[specie] < 0.9e35) {
+    for (int id : species) {
+        if (halflives[id] < 0.9e35) {
             double BR_tot = 0.0;
-            for (int j = 0; j < n_decays(specie); ++j) {
-                BR_tot = BR_tot + get_decay_branching(specie, j);
+            for (int j = 0; j < n_decays_id(id); ++j) {
+                BR_tot = BR_tot + get_decay_branching_id(id, j);
             }
             if (abs(BR_tot - 1.0) > tol) {
                 if (error_file != "NONE") {
                     ofstream error_log;
                     error_log.open(error_file, ios_base::app);
-                    error_log << "WARNING: species decays do not add to 100% within tolerance: " << specie
+                    error_log << "WARNING: species decays do not add to 100% within tolerance: " << table->isotopes[id]
                             << '\n';
                     error_log << "         BR total = " << BR_tot * 100.0 << "%\n";
                     error_log.close();
                 }
 
                 if (change) {
-                    for (int j = 0; j < n_decays(specie); ++j) {
-                        decays[specie][j] = make_pair(get<0>(decays[specie][j]), (get_decay_branching(specie, j) * (1.0 / BR_tot)));
+                    for (int j = 0; j < n_decays_id(id); ++j) {
+                        decay_brs[table->decay_offsets[id] + j] = get_decay_branching_id(id, j) * (1.0 / BR_tot);
                     }
                     if (error_file != "NONE") {
                         ofstream error_log;
@@ -282,12 +780,13 @@ void species_data::check_data(bool change, string error_file) {
 }
 
 /** Statistically samples the data and outputs it as a new species_data object. Used in monte-carlo
- * analysis to propagate error.
+ * analysis to propagate error. The sample shares the isotope table of this object and only owns the varied
+ * yields, halflives, branching ratios and gamma intensities.
  *
  * @return Sampled data packed into a species_data object.
  */
-species_data species_data::gaussian_sample() {
-    species_data res;
+species_data species_data::gaussian_sample() const {
+    species_data res = *this;
 
     unsigned seed = static_cast<unsigned int>(std::chrono::system_clock::now().time_since_epoch().count());
     mt19937 generator(seed);
@@ -295,89 +794,342 @@ species_data species_data::gaussian_sample() {
     // dist(generator) gives uniform pseudo-random number between 0 and 1
 
     // vary independent fission yields
-    vector<int> yield_keys = get_keys(yields);
-    map<int, double> yields_varied;
-    for (int yield_key : yield_keys) {
-        double vard =
-                sqrt(2.0) * yields_sig[yield_key] * erfinv(2.0 * dist(generator) - 1.0) + yields[yield_key];
+    for (int id : sorted_ids(table->yield_flags)) {
+        double vard = sqrt(2.0) * table->yields_sig[id] * erfinv(2.0 * dist(generator) - 1.0) + yields[id];
         if (vard <= 0.0) {
-            vard = yields[yield_key];
+            vard = yields[id];
         }
-        yields_varied[yield_key] = vard;
+        res.yields[id] = vard;
     }
-    res.set_yields(yields_varied);
 
     // vary halflives
-    vector<int> halflives_keys = get_keys(halflives);
-    map<int, double> halflives_varied;
-    for (int halflives_key : halflives_keys) {
-        double vard = sqrt(2.0) * halflives_sig[halflives_key] * erfinv(2.0 * dist(generator) - 1.0) +
-                      halflives[halflives_key];
+    for (int id : sorted_ids(table->halflife_flags)) {
+        double vard = sqrt(2.0) * table->halflives_sig[id] * erfinv(2.0 * dist(generator) - 1.0) + halflives[id];
         if (vard <= 0.0) {
-            vard = halflives[halflives_key];
+            vard = halflives[id];
         }
-        halflives_varied[halflives_key] = vard;
+        res.set_halflife_id(id, vard);
     }
-    res.set_halflives(halflives_varied);
 
     // vary branching ratios
-    vector<int> decays_keys = get_keys(decays);
-    map < int, vector < pair < int, double > > > decays_varied = decays;
-    for (int decays_key : decays_keys) {
-        for (int j = 0; j < decays[decays_key].size(); ++j) {
-            double sigma = get<1>(decays_sig[decays_key][j]);
-            double mu = get<1>(decays[decays_key][j]);
+    for (int id = 0; id < n_isotopes(); ++id) {
+        for (int j = table->decay_offsets[id]; j < table->decay_offsets[id] + table->decay_counts[id]; ++j) {
+            double sigma = table->decay_brs_sig[j];
+            double mu = decay_brs[j];
             double vard = sqrt(2.0) * sigma * erfinv(2.0 * dist(generator) - 1.0) + mu;
             if (vard <= 0.0) {
                 vard = mu;
             }
-            int daughter = get<0>(decays[decays_key][j]);
-            decays_varied[decays_key][j] = make_pair(daughter, vard);
+            res.decay_brs[j] = vard;
         }
     }
-    res.set_decays(decays_varied);
 
     // vary gamma intensities
-    vector<int> gammas_keys = get_keys(gammas);
-    map < int, vector < pair < double, double > > > gammas_varied = gammas;
-    for (int gammas_key : gammas_keys) {
-        for (int j = 0; j < gammas[gammas_key].size(); ++j) {
-            double sigma = get<1>(gammas_sig[gammas_key][j]);
-            double mu = get<1>(gammas[gammas_key][j]);
-            double vard = sqrt(2.0) * sigma * erfinv(2.0 * dist(generator) - 1.0) + mu;
-            if (vard <= 0.0) {
-                vard = mu;
-            }
-            double Eg = get<0>(gammas[gammas_key][j]);
-            gammas_varied[gammas_key][j] = make_pair(Eg, vard);
+    for (size_t j = 0; j < gamma_intensities.size(); ++j) {
+        double sigma = table->gamma_intensities_sig[j];
+        double mu = gamma_intensities[j];
+        double vard = sqrt(2.0) * sigma * erfinv(2.0 * dist(generator) - 1.0) + mu;
+        if (vard <= 0.0) {
+            vard = mu;
         }
+        res.gamma_intensities[j] = vard;
     }
-    res.set_gammas(gammas_varied);
 
     return res;
 }
-    /** Imports gamma data from GAMMAS_FILENAME into GAMMAS field.
-     *
-     * @param gammas_filename String name of gamma data.
-     */
-    void species_data::import_gammas(string gammas_filename) {
-        string line;
-        ifstream gammas_file(gammas_filename);
-        if (gammas_file.is_open()) {
-            while (getline(gammas_file, line)) {
-                vector <string> parts = split(line, ',');
-                int Z = stoi(parts[0]);
-                int A = stoi(parts[1]);
-                int I = stoi(parts[2]);
-                double Eg = stod(parts[3]);
-                double Eg_sig = stod(parts[4]);
-                double Ig = stod(parts[5]) / 100.0;
-                double Ig_sig = stod(parts[6]) / 100.0;
-                int iZA = Z * 10000 + A + I * 1000;
-                gammas[iZA].emplace_back(Eg, Ig);
-                gammas_sig[iZA].emplace_back(Eg_sig, Ig_sig);
-            }
-            gammas_file.close();
-        } else cout << "ERROR: Cannot find decays file.\n";
 
+/** Reads isotope, decay and gamma files and saves them to a binary cache file. The file starts with a header
+ * holding a magic string, the layout version, and the size and FNV-1a hash of the payload. The payload records
+ * the names of the source files followed by the isotope, decay and gamma arrays exactly as they are held in
+ * memory, so they can be loaded without any text parsing, and the isotopes given a 0 halflife in the files.
+ *
+ * @param cache_filename String name of the cache file.
+ * @param sources Names of the isotopes, decays and gammas files, in that order.
+ * @return TRUE if the cache was written.
+ */
+bool species_data::save_cache(string cache_filename, vector<string> sources) {
+    vector<isotope_record> isotope_records;
+    vector<decay_record> decay_records;
+    vector<gamma_record> gamma_records;
+    if (sources.size() != 3 || !read_records(sources[0], parse_isotope, isotope_records) ||
+        !read_records(sources[1], parse_decay, decay_records) ||
+        !read_records(sources[2], parse_gamma, gamma_records)) {
+        cout << "ERROR: Cannot read the data files for the nuclear data cache.\n";
+        return false;
+    }
+    species_data data;
+    data.apply_isotopes(isotope_records, "NONE");
+    data.apply_decays(decay_records, "NONE");
+    data.apply_gammas(gamma_records);
+    vector<int> zero_halflives;
+    for (isotope_record &record : isotope_records) {
+        if (record.zero_halflife) {
+            zero_halflives.push_back(record.iZA);
+        }
+    }
+    for (decay_record &record : decay_records) {
+        if (record.zero_halflife) {
+            zero_halflives.push_back(record.parent);
+        }
+    }
+
+    string payload;
+    cache_write(payload, static_cast<uint32_t>(sources.size()));
+    for (string &source : sources) {
+        cache_write(payload, static_cast<uint32_t>(source.size()));
+        payload.append(source);
+    }
+    size_t n = data.table->isotopes.size();
+    cache_write(payload, static_cast<uint64_t>(n));
+    cache_write(payload, data.table->isotopes.data(), n);
+    cache_write(payload, data.table->energies.data(), n);
+    cache_write(payload, data.halflives.data(), n);
+    cache_write(payload, data.table->halflives_sig.data(), n);
+    cache_write(payload, data.table->halflife_flags.data(), n);
+    cache_write(payload, data.table->decay_counts.data(), n);
+    size_t n_modes = data.table->decay_daughters.size();
+    cache_write(payload, static_cast<uint64_t>(n_modes));
+    cache_write(payload, data.table->decay_daughters.data(), n_modes);
+    cache_write(payload, data.decay_brs.data(), n_modes);
+    cache_write(payload, data.table->decay_brs_sig.data(), n_modes);
+    cache_write(payload, data.table->gamma_offsets.data(), n + 1);
+    size_t n_lines = data.table->gamma_energies.size();
+    cache_write(payload, static_cast<uint64_t>(n_lines));
+    cache_write(payload, data.table->gamma_energies.data(), n_lines);
+    cache_write(payload, data.table->gamma_energies_sig.data(), n_lines);
+    cache_write(payload, data.gamma_intensities.data(), n_lines);
+    cache_write(payload, data.table->gamma_intensities_sig.data(), n_lines);
+    cache_write(payload, static_cast<uint64_t>(zero_halflives.size()));
+    cache_write(payload, zero_halflives.data(), zero_halflives.size());
+
+    if (!write_cache_file(cache_filename, CACHE_MAGIC, CACHE_VERSION, payload)) {
+        cout << "ERROR: Cannot write nuclear data cache file.\n";
+        return false;
+    }
+    return true;
+}
+
+/** Imports isotope, decay and gamma data from a binary cache file written by save_cache. The file is
+ * memory-mapped and its arrays copied straight into the data arrays. The cache is rejected if it is older
+ * than any of SOURCES, was built from different files, has a different layout version, fails its hash or
+ * holds inconsistent offsets. Nothing is imported when the cache is rejected. Yields already imported are
+ * kept.
+ *
+ * @param cache_filename String name of the cache file.
+ * @param sources Names of the isotopes, decays and gammas files the cache must have been built from.
+ * @param error_file Optional error file name.
+ * @return TRUE if the cache was loaded, FALSE if it is missing, stale or invalid.
+ */
+bool species_data::import_cache(string cache_filename, vector<string> sources, string error_file) {
+    for (string &source : sources) {
+        if (!up_to_date(cache_filename, source)) {
+            return false;
+        }
+    }
+
+    mapped_file cache_file;
+    cache_reader reader;
+    if (!open_cache_file(cache_file, cache_filename, CACHE_MAGIC, CACHE_VERSION, reader)) {
+        return false;
+    }
+    auto n_sources = reader.read<uint32_t>();
+    if (n_sources != sources.size()) {
+        return false;
+    }
+    for (string &source : sources) {
+        if (reader.read_string() != source) {
+            return false;
+        }
+    }
+
+    species_data cached;
+    auto n = reader.read<uint64_t>();
+    reader.read_vector(cached.table->isotopes, n);
+    reader.read_vector(cached.table->energies, n);
+    reader.read_vector(cached.halflives, n);
+    reader.read_vector(cached.table->halflives_sig, n);
+    reader.read_vector(cached.table->halflife_flags, n);
+    reader.read_vector(cached.table->decay_counts, n);
+    auto n_modes = reader.read<uint64_t>();
+    reader.read_vector(cached.table->decay_daughters, n_modes);
+    reader.read_vector(cached.decay_brs, n_modes);
+    reader.read_vector(cached.table->decay_brs_sig, n_modes);
+    reader.read_vector(cached.table->gamma_offsets, n + 1);
+    auto n_lines = reader.read<uint64_t>();
+    reader.read_vector(cached.table->gamma_energies, n_lines);
+    reader.read_vector(cached.table->gamma_energies_sig, n_lines);
+    reader.read_vector(cached.gamma_intensities, n_lines);
+    reader.read_vector(cached.table->gamma_intensities_sig, n_lines);
+    vector<int> zero_halflives;
+    reader.read_vector(zero_halflives, reader.read<uint64_t>());
+    if (!reader.ok || reader.pos != reader.end) {
+        return false;
+    }
+
+    // rebuild the ID lookup and the decay offsets, checking that every offset and daughter is in range
+    uint64_t n_stored = 0;
+    for (size_t id = 0; id < n; ++id) {
+        if (!cached.table->ids.emplace(cached.table->isotopes[id], static_cast<int>(id)).second || cached.table->decay_counts[id] < 0 ||
+            cached.table->gamma_offsets[id] > cached.table->gamma_offsets[id + 1]) {
+            return false;
+        }
+        cached.table->decay_offsets.push_back(static_cast<int>(n_stored));
+        cached.dcs.push_back((log(2.0)) / cached.halflives[id]);
+        n_stored = n_stored + cached.table->decay_counts[id];
+    }
+    if (n_stored != n_modes || cached.table->gamma_offsets[0] != 0 || cached.table->gamma_offsets[n] != static_cast<int>(n_lines)) {
+        return false;
+    }
+    for (int daughter : cached.table->decay_daughters) {
+        if (daughter < 0 || daughter >= static_cast<int>(n)) {
+            return false;
+        }
+    }
+    cached.yields.assign(n, 0.0);
+    cached.table->yields_sig.assign(n, 0.0);
+    cached.table->yield_flags.assign(n, 0);
+
+    for (int id : sorted_ids(table->yield_flags)) {
+        int cached_id = cached.add_isotope(table->isotopes[id]);
+        cached.yields[cached_id] = yields[id];
+        cached.table->yields_sig[cached_id] = table->yields_sig[id];
+        cached.table->yield_flags[cached_id] = 1;
+    }
+    *this = move(cached);
+    for (int iZA : zero_halflives) {
+        log_zero_halflife(iZA, error_file);
+    }
+    return true;
+}
+
+/** Packs every .csv yields file in YIELDS_DIRECTORY into one yields library. The library starts with a
+ * header, followed by an open addressing hash index keyed on the lower case file name (e.g. 235u_fission)
+ * and then the parsed yields of every file. Looking up a fissioning system therefore costs one hash and a
+ * few probes, and its yields are read without any text parsing. Files are packed in name order, and files
+ * that cannot be read are left out, so decks using them fall back to the file.
+ *
+ * @param yields_directory Directory holding the yields files.
+ * @param library_filename String name of the library file.
+ * @return Number of yields files packed, -1 if the library could not be written.
+ */
+int species_data::save_yields_library(string yields_directory, string library_filename) {
+    vector<filesystem::path> files;
+    error_code error;
+    for (auto &entry : filesystem::directory_iterator(yields_directory, error)) {
+        string stem = entry.path().stem().string();
+        if (entry.path().extension() == ".csv" && stem.size() < YIELDS_KEY_SIZE) {
+            files.push_back(entry.path());
+        }
+    }
+    sort(files.begin(), files.end());
+
+    size_t n_slots = 1;
+    while (n_slots < 2 * files.size()) {
+        n_slots = n_slots * 2;
+    }
+    vector<yields_slot> slots(n_slots);
+    memset(slots.data(), 0, n_slots * sizeof(yields_slot));
+    vector<yields_entry> entries;
+    vector<yield_record> records;
+    int n_packed = 0;
+    for (auto &path : files) {
+        if (!read_records(path.string(), parse_yield, records)) {
+            cout << "WARNING: Cannot read yields file " << path.string() << ", left out of the yields library.\n";
+            continue;
+        }
+        ++n_packed;
+        string key = yields_key(path.stem().string());
+        size_t slot = fnv1a_hash(key.data(), key.size()) & (n_slots - 1);
+        while (slots[slot].key[0] != '\0') {
+            slot = (slot + 1) & (n_slots - 1);
+        }
+        memcpy(slots[slot].key, key.data(), key.size());
+        slots[slot].offset = entries.size();
+        slots[slot].count = records.size();
+        for (yield_record &record : records) {
+            entries.push_back({record.iZA, 0, record.yield, record.yield_sig});
+        }
+    }
+
+    string body;
+    cache_write(body, slots.data(), slots.size());
+    cache_write(body, entries.data(), entries.size());
+    string header;
+    header.append(YIELDS_MAGIC, sizeof(YIELDS_MAGIC));
+    cache_write(header, YIELDS_VERSION);
+    cache_write(header, static_cast<uint32_t>(n_slots));
+    cache_write(header, static_cast<uint64_t>(entries.size()));
+    cache_write(header, fnv1a_hash(body.data(), body.size()));
+
+    ofstream library_file(library_filename, ios::binary);
+    if (!library_file.is_open()) {
+        cout << "ERROR: Cannot write yields library file.\n";
+        return -1;
     }
+    library_file.write(header.data(), header.size());
+    library_file.write(body.data(), body.size());
+    library_file.close();
+    return n_packed;
+}
+
+/** Imports the yields of one fissioning system from a yields library written by save_yields_library. The
+ * library is memory-mapped, KEY is looked up in its hash index and the matching yields are stored in YIELDS
+ * and YIELDS_SIG exactly as import_yields would store them from the original file.
+ *
+ * @param library_filename String name of the library file.
+ * @param key Name of the yields file in the library, without directory or extension (e.g. 235U_fission).
+ * @return TRUE if the yields were imported, FALSE if the library is missing, invalid or does not hold KEY.
+ */
+bool species_data::import_yields_library(string library_filename, string key) {
+    mapped_file library_file;
+    if (!library_file.open(library_filename) || library_file.size() < YIELDS_HEADER_SIZE) {
+        return false;
+    }
+    cache_reader header = {library_file.data(), library_file.data() + YIELDS_HEADER_SIZE, true};
+    char magic[sizeof(YIELDS_MAGIC)];
+    header.read(magic, sizeof(magic));
+    auto version = header.read<uint32_t>();
+    auto n_slots = header.read<uint32_t>();
+    auto n_entries = header.read<uint64_t>();
+    auto body_hash = header.read<uint64_t>();
+    size_t index_size = n_slots * sizeof(yields_slot);
+    if (memcmp(magic, YIELDS_MAGIC, sizeof(YIELDS_MAGIC)) != 0 || version != YIELDS_VERSION || n_slots == 0 ||
+        (n_slots & (n_slots - 1)) != 0 ||
+        library_file.size() != YIELDS_HEADER_SIZE + index_size + n_entries * sizeof(yields_entry)) {
+        return false;
+    }
+    const char *index = library_file.data() + YIELDS_HEADER_SIZE;
+    if (fnv1a_hash(index, index_size + n_entries * sizeof(yields_entry)) != body_hash) {
+        return false;
+    }
+
+    key = yields_key(key);
+    if (key.empty() || key.size() >= YIELDS_KEY_SIZE) {
+        return false;
+    }
+    size_t slot = fnv1a_hash(key.data(), key.size()) & (n_slots - 1);
+    for (size_t probe = 0; probe < n_slots; ++probe) {
+        yields_slot entry_slot;
+        memcpy(&entry_slot, index + slot * sizeof(yields_slot), sizeof(yields_slot));
+        if (entry_slot.key[0] == '\0') {
+            return false;
+        }
+        if (strncmp(entry_slot.key, key.c_str(), YIELDS_KEY_SIZE) == 0) {
+            if (entry_slot.offset > n_entries || entry_slot.count > n_entries - entry_slot.offset) {
+                return false;
+            }
+            vector<yields_entry> entries(entry_slot.count);
+            memcpy(entries.data(), index + index_size + entry_slot.offset * sizeof(yields_entry),
+                   entry_slot.count * sizeof(yields_entry));
+            vector<yield_record> records;
+            records.reserve(entries.size());
+            for (yields_entry &entry : entries) {
+                records.push_back({entry.iZA, entry.yield, entry.yield_sig});
+            }
+            apply_yields(records);
+            return true;
+        }
+        slot = (slot + 1) & (n_slots - 1);
+    }
+    return false;
+}
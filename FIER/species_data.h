@@ -5,36 +5,132 @@
 #include <fstream> // for file output
 #include <string> // for working with strings
 #include <map> // for dictionary type memory
+#include <unordered_map> // for isotope ID lookup
 #include <cmath> // for basic math functions
 #include <vector> // for dynamic memory
 #include <sstream> // for string operations
 #include <random> // for random number generation
+#include <string_view> // for tokenizing without copies
+#include <memory> // for sharing the isotope table
 
 
 using namespace std;
 /** Holds nuclear data pulled from files. Also contains
  * methods that operate on that data.
+ *
+ * Every isotope seen in the data files is given a dense isotope ID (0, 1, 2, ...) in the order it is first
+ * read. Per-isotope quantities are stored in arrays indexed by that ID, and the decay modes and gamma lines
+ * of all isotopes are stored back to back with per-isotope offsets. Isotopes can be accessed either by their
+ * unique hash (iZA) or, without a lookup, by their isotope ID.
  */
 class species_data {
-    /** Each field is a map of two quantities.*/
-    /** Isotope (int) fission yields (double)*/
-    map<int, double> yields;
-    /** Isotope (int) fission yield uncertainties (double)*/
-    map<int, double> yields_sig;
-    /** Isotope (int) excitation energies (double)*/
-    map<int, double> energies;
-    /** Isotope (int) halflives (double)*/
-    map<int, double> halflives;
-    /** Isotope (int) halflives_sig (double)*/
-    map<int, double> halflives_sig;
-    /** Isotope (int) and a list (vector) of each decay daughter (int) (pair)ed with the branching ratio (double).*/
-    map<int, vector<pair < int, double> > > decays;
-    /** Isotope (int) and a list (vector) of each decay daughter (int) (pair)ed with the branching ratio (double) UNCERTAINTY.*/
-    map<int, vector<pair < int, double> > > decays_sig;
-    /** Isotope (int) and a list (vector) of each gamma energy (double) and intensity (double)*/
-    map<int, vector<pair < double, double> > > gammas;
-    /** Isotope (int) and a list (vector) of each gamma energy (double) and intensity (double) UNCERTAINTY*/
-    map<int, vector<pair < double, double> > > gammas_sig;
+    /** Isotope table, decay modes and gamma lines: everything except the values varied by gaussian_sample.
+     * Copies of a species_data share one table, and a table that is shared is copied before it is changed.
+     */
+    struct isotope_table {
+        /** Unique hash (int) of each isotope, indexed by isotope ID.*/
+        vector<int> isotopes;
+        /** Isotope ID (int) of each unique hash (int).*/
+        unordered_map<int, int> ids;
+        /** Fission yield uncertainty (double) of each isotope ID.*/
+        vector<double> yields_sig;
+        /** 1 if the isotope has a fission yield entry (it is a fission fragment), 0 otherwise.*/
+        vector<char> yield_flags;
+        /** Excitation energy (double) of each isotope ID.*/
+        vector<double> energies;
+        /** Halflife uncertainty (double) of each isotope ID.*/
+        vector<double> halflives_sig;
+        /** 1 if a halflife was read for the isotope, 0 otherwise.*/
+        vector<char> halflife_flags;
+        /** Start of the decay modes of each isotope ID in DECAY_DAUGHTERS, DECAY_BRS and DECAY_BRS_SIG.*/
+        vector<int> decay_offsets;
+        /** Number of decay modes of each isotope ID. Removing decay modes lowers the count and leaves the space unused.*/
+        vector<int> decay_counts;
+        /** Isotope ID (int) of the daughter of each decay mode.*/
+        vector<int> decay_daughters;
+        /** Branching ratio UNCERTAINTY (double) of each decay mode.*/
+        vector<double> decay_brs_sig;
+        /** Gamma lines of isotope ID i are entries GAMMA_OFFSETS[i] to GAMMA_OFFSETS[i + 1] - 1 of the gamma arrays.*/
+        vector<int> gamma_offsets = vector<int>(1, 0);
+        /** Energy (double) of each gamma line.*/
+        vector<double> gamma_energies;
+        /** Energy UNCERTAINTY (double) of each gamma line.*/
+        vector<double> gamma_energies_sig;
+        /** Intensity UNCERTAINTY (double) of each gamma line.*/
+        vector<double> gamma_intensities_sig;
+    };
+    /** Isotope table, possibly shared with other copies.*/
+    shared_ptr<isotope_table> table = make_shared<isotope_table>();
+    /** Fission yield (double) of each isotope ID.*/
+    vector<double> yields;
+    /** Halflife (double) of each isotope ID. 0 if no halflife was read.*/
+    vector<double> halflives;
+    /** Decay constant ln(2)/halflife (double) of each isotope ID.*/
+    vector<double> dcs;
+    /** Branching ratio (double) of each decay mode.*/
+    vector<double> decay_brs;
+    /** Intensity (double) of each gamma line.*/
+    vector<double> gamma_intensities;
+
+    /** One line of a yields file.*/
+    struct yield_record {
+        int iZA;
+        double yield;
+        double yield_sig;
+    };
+    /** One line of an isotopes file, with the halflife already corrected.*/
+    struct isotope_record {
+        int iZA;
+        double energy;
+        double halflife;
+        double halflife_sig;
+        bool zero_halflife;
+    };
+    /** One line of a decays file, with the halflife already corrected.*/
+    struct decay_record {
+        int parent;
+        int daughter;
+        double halflife;
+        double halflife_sig;
+        double branching;
+        double branching_sig;
+        bool zero_halflife;
+    };
+    /** One line of a gammas file.*/
+    struct gamma_record {
+        int iZA;
+        double energy;
+        double energy_sig;
+        double intensity;
+        double intensity_sig;
+    };
+
+    static yield_record parse_yield(string_view line, vector<string_view> &parts);
+    static isotope_record parse_isotope(string_view line, vector<string_view> &parts);
+    static decay_record parse_decay(string_view line, vector<string_view> &parts);
+    static gamma_record parse_gamma(string_view line, vector<string_view> &parts);
+
+    /** Makes sure TABLE is not shared before it is changed.
+     *
+     * @return The isotope table, owned by this object alone.
+     */
+    isotope_table &edit_table() {
+        if (table.use_count() > 1) {
+            table = make_shared<isotope_table>(*table);
+        }
+        return *table;
+    }
+
+    int add_isotope(int iZA);
+    void set_halflife_id(int id, double halflife);
+    void remove_decay_id(int id, int n);
+
+    void apply_yields(const vector<yield_record> &records);
+    void apply_isotopes(const vector<isotope_record> &records, string error_file);
+    void apply_decays(const vector<decay_record> &records, string error_file);
+    void apply_gammas(const vector<gamma_record> &records);
+
+    vector<int> sorted_ids(const vector<char> &include) const;
 
 public:
     /** Imports yields from YIELDS_FILENAME.
@@ -42,20 +138,72 @@ public:
      */
     void import_yields(string yields_filename);
 
+    /** Imports the isotopes, decays, gammas and yields files at the same time. Gives the same result as
+     * calling import_isotopes, import_decays, import_gammas and import_yields one after another.
+     *
+     * @param isotopes_filename String of the file holding isotope data.
+     * @param decays_filename String of filename with decay data.
+     * @param gammas_filename String name of gamma data.
+     * @param yields_filename String name of the file with yields, NONE if the yields are imported separately.
+     * @param error_file Optional error file name.
+     */
+    void import_all(string isotopes_filename, string decays_filename, string gammas_filename,
+                    string yields_filename, string error_file = "NONE");
+
+    /** Number of isotopes in the data. Isotope IDs run from 0 to n_isotopes() - 1.
+     *
+     * @return Number of isotopes.
+     */
+    int n_isotopes() const {
+        return static_cast<int>(table->isotopes.size());
+    }
+
+    /** Looks up the isotope ID of an isotope.
+     *
+     * @param iZA Unique hash of isotope.
+     * @return Isotope ID of IZA, -1 if IZA is not in the data.
+     */
+    int get_id(int iZA) const {
+        auto it = table->ids.find(iZA);
+        return (it == table->ids.end()) ? -1 : it->second;
+    }
+
+    /** Retrieves the unique hash of an isotope ID.
+     *
+     * @param id Isotope ID.
+     * @return Unique hash of isotope.
+     */
+    int get_iZA(int id) const {
+        return table->isotopes[id];
+    }
+
     /**
      * Retrieves yield of isotope ISA from YIELDS.
      * @param iZA Unique hash of isotope.
      * @return Yield of IZA.
      */
-    double get_yield(int iZA) {return yields[iZA];}
+    double get_yield(int iZA) const {
+        int id = get_id(iZA);
+        return (id < 0) ? 0.0 : yields[id];
+    }
+
+    /** Retrieves yield of isotope ID from YIELDS.
+     * @param id Isotope ID.
+     * @return Yield of ID.
+     */
+    double get_yield_id(int id) const {
+        return yields[id];
+    }
 
-    /** Sets the value of YIELDS[IZA].
+    /** Sets the value of YIELDS[IZA], making IZA a fission fragment.
      *
      * @param iZA Uniqure hash of isotope.
      * @param yield_in Yield of isotope IZA.
      */
     void set_yield(int iZA, double yield_in) {
-        yields[iZA] = yield_in;
+        int id = add_isotope(iZA);
+        yields[id] = yield_in;
+        edit_table().yield_flags[id] = 1;
     }
 
     /** Retrieves yield uncertainty from YIELDS_SIG for isotope IZA.
@@ -63,25 +211,29 @@ public:
      * @param iZA Unique hash of isotope.
      * @return Yield uncertainty of IZA.
      */
-    double get_yield_sig(int iZA) {
-        return yields_sig[iZA];
+    double get_yield_sig(int iZA) const {
+        int id = get_id(iZA);
+        return (id < 0) ? 0.0 : table->yields_sig[id];
     }
 
     /** Retrieves all yields as a map of isotopes and values.
      *
-     * @return YIELDS.
+     * @return Yield of every fission fragment.
      */
-    map<int, double> get_yields() {
-        return yields;
-    }
+    map<int, double> get_yields() const;
 
-    /** Sets the value class field YIELDS.
+    /** Retrieves the fission fragments, the isotopes with a yield entry.
      *
-     * @param yields_in Map of all yields.
+     * @return Unique hashes of the fragments in ascending order.
      */
-    void set_yields(map<int, double> yields_in) {
-        yields = yields_in;
-    }
+    vector<int> get_fragments() const;
+
+    /** Hashes everything build_chains reads: the isotopes, decay constants, decay modes and fission fragments.
+     * Decay chains built from data with the same hash are the same.
+     *
+     * @return 64 bit FNV-1a hash.
+     */
+    uint64_t chains_hash() const;
 
     /** Imports all isotopes from file.
      *
@@ -97,8 +249,18 @@ public:
      * @param iZA Unique hash of isotope.
      * @return Energy of isotope IZA.
      */
-    double get_energy(int iZA) {
-        return energies[iZA];
+    double get_energy(int iZA) const {
+        int id = get_id(iZA);
+        return (id < 0) ? 0.0 : table->energies[id];
+    }
+
+    /** Retrieves excitation energy of isotope ID from ENERGIES.
+     *
+     * @param id Isotope ID.
+     * @return Energy of isotope ID.
+     */
+    double get_energy_id(int id) const {
+        return table->energies[id];
     }
 
     /** Retrieves halflife of isotope IZA from HALFLIVES.
@@ -106,26 +268,28 @@ public:
      * @param iZA Unique hash of isotope.
      * @return Halflife.
      */
-    double get_halflife(int iZA) {
-        return halflives[iZA];
+    double get_halflife(int iZA) const {
+        int id = get_id(iZA);
+        return (id < 0) ? 0.0 : halflives[id];
     }
 
-    /** Retrieves uncertainty of the halflife of isotope IZA from HALFLIVES_SIG.
+    /** Retrieves halflife of isotope ID from HALFLIVES.
      *
-     * @param iZA Unique hash of isotope.
-     * @return Uncertainty of halflife.
+     * @param id Isotope ID.
+     * @return Halflife.
      */
-    double get_halflife_sig(int iZA) {
-        return halflives_sig[iZA];
+    double get_halflife_id(int id) const {
+        return halflives[id];
     }
 
-    /** Sets HALFLIVES as a map of isotopes and halflives determiend by HALFLIVES_IN.
+    /** Retrieves uncertainty of the halflife of isotope IZA from HALFLIVES_SIG.
      *
-     * @param halflives_in Input map.
+     * @param iZA Unique hash of isotope.
+     * @return Uncertainty of halflife.
      */
-    int set_halflives(map<int, double> halflives_in) {
-        halflives = halflives_in;
-        return 0;
+    double get_halflife_sig(int iZA) const {
+        int id = get_id(iZA);
+        return (id < 0) ? 0.0 : table->halflives_sig[id];
     }
 
     /** Calculates decay constant of IZA from HALFLIVES.
@@ -133,8 +297,18 @@ public:
      * @param iZA Unique hash of isotope IZA.
      * @return The decay constant: ln(2)/HALFLIVES[IZA].
      */
-    double get_DC(int iZA) {
-        return (log(2.0)) / halflives[iZA];
+    double get_DC(int iZA) const {
+        int id = get_id(iZA);
+        return (id < 0) ? (log(2.0)) / 0.0 : dcs[id];
+    }
+
+    /** Retrieves the decay constant of isotope ID.
+     *
+     * @param id Isotope ID.
+     * @return The decay constant: ln(2)/HALFLIVES[ID].
+     */
+    double get_DC_id(int id) const {
+        return dcs[id];
     }
 
     // function to get Z,A,I decay constant uncertainty, iZA access overload
@@ -143,8 +317,8 @@ public:
      * @param iZA Unique hash of isotope.
      * @return Propagated uncertainty of decay constant calculation.
      */
-    double get_DC_sig(int iZA) {
-        double res = ((log(2.0)) / halflives_sig[iZA]) * (halflives_sig[iZA] / halflives[iZA]);
+    double get_DC_sig(int iZA) const {
+        double res = ((log(2.0)) / get_halflife_sig(iZA)) * (get_halflife_sig(iZA) / get_halflife(iZA));
         if (res != res) {
             res = 0.0;
         }
@@ -164,9 +338,18 @@ public:
      * @param n Generation of decay daughter.
      * @return Unique hash of daughter isotope.
      */
-    int get_decay_daughteriZA(int iZA, int n) {
-        int iZAd = get<0>(decays[iZA][n]);
-        return iZAd;
+    int get_decay_daughteriZA(int iZA, int n) const {
+        return table->isotopes[get_decay_daughter_id(get_id(iZA), n)];
+    }
+
+    /** Retrieves the isotope ID of the Nth decay daughter of isotope ID.
+     *
+     * @param id Isotope ID of parent.
+     * @param n Generation of decay daughter.
+     * @return Isotope ID of daughter.
+     */
+    int get_decay_daughter_id(int id, int n) const {
+        return table->decay_daughters[table->decay_offsets[id] + n];
     }
 
     /** Gets the branching ratio for the Nth decay daughter of IZA.
@@ -175,8 +358,18 @@ public:
      * @param n Generation of decay daughter.
      * @return Branching ratio.
      */
-    double get_decay_branching(int iZA, int n) {
-        return get<1>(decays[iZA][n]);
+    double get_decay_branching(int iZA, int n) const {
+        return get_decay_branching_id(get_id(iZA), n);
+    }
+
+    /** Gets the branching ratio for the Nth decay daughter of isotope ID.
+     *
+     * @param id Isotope ID of parent.
+     * @param n Generation of decay daughter.
+     * @return Branching ratio.
+     */
+    double get_decay_branching_id(int id, int n) const {
+        return decay_brs[table->decay_offsets[id] + n];
     }
 
     /** Retrieves branching ratio uncertainty for the Nth decay daughter of IZA.
@@ -185,8 +378,8 @@ public:
      * @param n Generation of decay daughter.
      * @return Branching ratio uncertainty.
      */
-    double get_decay_branching_sig(int iZA, int n) {
-        return get<1>(decays_sig[iZA][n]);
+    double get_decay_branching_sig(int iZA, int n) const {
+        return table->decay_brs_sig[table->decay_offsets[get_id(iZA)] + n];
     }
 
     /** Retrieves the number of decay modes of isotope IZA.
@@ -194,23 +387,29 @@ public:
      * @param iZA Unique hash of isotope.
      * @return Number of decay modes.
      */
-    int n_decays(int iZA) {
-        return static_cast<int>(decays[iZA].size());
+    int n_decays(int iZA) const {
+        int id = get_id(iZA);
+        return (id < 0) ? 0 : table->decay_counts[id];
     }
 
-    /** Removes decay modes (by clearing DECAYS[IZA]) to make a species stable.
+    /** Retrieves the number of decay modes of isotope ID.
      *
-     * @param iZA Unique hash of isotope.
+     * @param id Isotope ID.
+     * @return Number of decay modes.
      */
-    void remove_decays(int iZA) {
-        decays[iZA].clear();
+    int n_decays_id(int id) const {
+        return table->decay_counts[id];
     }
 
-    /** Sets DECAYS to be the function argument DECAYS_IN.
-     * @param decays_in A map<int, vector<pair<int,double>>> of decays/uncertainties for each isotope.
+    /** Removes decay modes to make a species stable.
+     *
+     * @param iZA Unique hash of isotope.
      */
-    void set_decays(map<int, vector<pair < int, double> > > decays_in ){
-        decays = decays_in;
+    void remove_decays(int iZA) {
+        int id = get_id(iZA);
+        if (id >= 0) {
+            edit_table().decay_counts[id] = 0;
+        }
     }
 
     /** Find the branching ratio between PARENT isotope and DAUGHTER isotope.
@@ -219,11 +418,23 @@ public:
      * @param daughter Unique hash of daughter isotope.
      * @return Branching ratio. This is 0 if no ratio exists.
      */
-    double find_decay_branching(int parent, int daughter) {
+    double find_decay_branching(int parent, int daughter) const {
+        int parent_id = get_id(parent);
+        int daughter_id = get_id(daughter);
+        return (parent_id < 0 || daughter_id < 0) ? 0.0 : find_decay_branching_id(parent_id, daughter_id);
+    }
+
+    /** Find the branching ratio between two isotope IDs.
+     *
+     * @param parent Isotope ID of parent.
+     * @param daughter Isotope ID of daughter.
+     * @return Branching ratio. This is 0 if no ratio exists.
+     */
+    double find_decay_branching_id(int parent, int daughter) const {
         double res = 0.0;
-        for (int i = 0; i < n_decays(parent); ++i) {
-            if (get_decay_daughteriZA(parent, i) == daughter) {
-                res = get_decay_branching(parent, i);
+        for (int i = 0; i < n_decays_id(parent); ++i) {
+            if (get_decay_daughter_id(parent, i) == daughter) {
+                res = get_decay_branching_id(parent, i);
             }
         }
 
@@ -241,8 +452,18 @@ public:
      * @param n Energy number to be looked up.
      * @return Gamma energy n.
      */
-    double get_gamma_energy(int iZA, int n) {
-        return get<0>(gammas[iZA][n]);
+    double get_gamma_energy(int iZA, int n) const {
+        return get_gamma_energy_id(get_id(iZA), n);
+    }
+
+    /** Retrieves the Nth gamma energy of isotope ID.
+     *
+     * @param id Isotope ID.
+     * @param n Energy number to be looked up.
+     * @return Gamma energy n.
+     */
+    double get_gamma_energy_id(int id, int n) const {
+        return table->gamma_energies[table->gamma_offsets[id] + n];
     }
 
     /** Retrieves the Nth gamma energy intensity of isotope IZA.
@@ -251,8 +472,18 @@ public:
      * @param n Energy number.
      * @return Gamma intensity.
      */
-    double get_gamma_intensity(int iZA, int n) {
-        return get<1>(gammas[iZA][n]);
+    double get_gamma_intensity(int iZA, int n) const {
+        return get_gamma_intensity_id(get_id(iZA), n);
+    }
+
+    /** Retrieves the Nth gamma intensity of isotope ID.
+     *
+     * @param id Isotope ID.
+     * @param n Energy number.
+     * @return Gamma intensity.
+     */
+    double get_gamma_intensity_id(int id, int n) const {
+        return gamma_intensities[table->gamma_offsets[id] + n];
     }
 
     /** Number of gammas stored for isotope IZA.
@@ -260,18 +491,37 @@ public:
      * @param iZA Unique isotope hash.
      * @return Number of gamma values in GAMMAS.
      */
-    int n_gammas(int iZA) {
-        return static_cast<int>(gammas[iZA].size());
+    int n_gammas(int iZA) const {
+        int id = get_id(iZA);
+        return (id < 0) ? 0 : n_gammas_id(id);
+    }
+
+    /** Number of gammas stored for isotope ID.
+     *
+     * @param id Isotope ID.
+     * @return Number of gamma lines.
+     */
+    int n_gammas_id(int id) const {
+        return table->gamma_offsets[id + 1] - table->gamma_offsets[id];
     }
 
+    /** Index of the Nth gamma line of isotope ID among the gamma lines of all isotopes. The lines of an isotope have
+     * consecutive indices, so its Nth line is line get_gamma_line_id(id, 0) + n.
+     *
+     * @param id Isotope ID.
+     * @param n Energy number.
+     * @return Gamma line index, from 0 to n_gamma_lines() - 1.
+     */
+    int get_gamma_line_id(int id, int n) const {
+        return table->gamma_offsets[id] + n;
+    }
 
-    // function to set the gammas field
-    /** Sets the gammas field with GAMMAS_IN.
-     * @param gammas_in Premade map of gamma energies/intensities.
+    /** Number of gamma lines stored for all isotopes.
+     *
+     * @return Number of gamma lines.
      */
-    int set_gammas(map<int, vector<pair < double, double> > > gammas_in ){
-        gammas = gammas_in;
-        return 0;
+    int n_gamma_lines() const {
+        return table->gamma_offsets.back();
     }
 
     /** Checks nuclear data parameters.
@@ -286,7 +536,40 @@ public:
      *
      * @return Sampled data packed into a species_data object.
      */
-    species_data gaussian_sample() ;
+    species_data gaussian_sample() const;
+
+    /** Reads isotope, decay and gamma files and saves them to a binary cache file.
+     *
+     * @param cache_filename String name of the cache file.
+     * @param sources Names of the isotopes, decays and gammas files, in that order.
+     * @return TRUE if the cache was written.
+     */
+    static bool save_cache(string cache_filename, vector<string> sources);
+
+    /** Imports isotope, decay and gamma data from a binary cache file.
+     *
+     * @param cache_filename String name of the cache file.
+     * @param sources Names of the isotopes, decays and gammas files the cache must have been built from.
+     * @param error_file Optional error file name.
+     * @return TRUE if the cache was loaded, FALSE if it is missing, stale or invalid.
+     */
+    bool import_cache(string cache_filename, vector<string> sources, string error_file = "NONE");
+
+    /** Packs every yields file in a directory into one indexed yields library.
+     *
+     * @param yields_directory Directory holding the yields files.
+     * @param library_filename String name of the library file.
+     * @return Number of yields files packed, -1 if the library could not be written.
+     */
+    static int save_yields_library(string yields_directory, string library_filename);
+
+    /** Imports the yields of one fissioning system from a yields library.
+     *
+     * @param library_filename String name of the library file.
+     * @param key Name of the yields file in the library, without directory or extension (e.g. 235U_fission).
+     * @return TRUE if the yields were imported, FALSE if the library is missing, invalid or does not hold KEY.
+     */
+    bool import_yields_library(string library_filename, string key);
 };
 
-#endif
\ No newline at end of file
+#endif
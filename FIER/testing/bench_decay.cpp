@@ -0,0 +1,252 @@
+/**@file bench_decay.cpp
+ *
+ * Measures chains_data::build_chains, on 1 thread up to one per hardware thread, and product_data::batch_decay_all
+ * with each Bateman kernel implementation the CPU supports on a full 235U fission product set, and counts the heap
+ * allocations batch_decay_all makes per call. The kernels read the stems of chains_data in place, so once the
+ * population entries and pass buffers of a time step exist a call should not allocate at all. The batch decay sums of
+ * every stem are also timed on their own, with all stems in one call to the generic loops and with the stems bucketed
+ * by length as product_data runs them, so the kernels specialized on stem length can be compared. Last, a list of
+ * times after irradiation is evaluated with one batch_decay_all call per time and with one batch_decay_times call,
+ * and batch_decay_all is timed on 1 thread up to one per hardware thread, and with the EXPSUM solver, which walks the
+ * decay graph once instead of every stem. Finally, a history of 1000 irradiation steps of the same length is run one
+ * batch_decay_all and cont_prod_all call per step, and with one irradiate call, which reuses one response per step
+ * length, and the same history is run as 20 steps that ramp the fission rate linearly. The gamma spectra of 1000
+ * back to back count windows are found with one batch_spectrum_all call per window and with one
+ * batch_spectrum_windows call, which finds the exponentials of each window boundary once.
+ *
+ * Run with make bench, or: bench_decay.exe yields/235U_fission.csv
+ */
+
+#include "../product_data.h"
+#include <atomic> // for counting allocations across threads
+
+/** Number of calls to operator new since the program started.*/
+static atomic<long> n_allocations(0);
+
+void *operator new(size_t size) {
+    n_allocations.fetch_add(1, memory_order_relaxed);
+    void *p = malloc(size == 0 ? 1 : size);
+    if (p == nullptr) {
+        throw bad_alloc();
+    }
+    return p;
+}
+
+void operator delete(void *p) noexcept {
+    free(p);
+}
+
+void operator delete(void *p, size_t) noexcept {
+    free(p);
+}
+
+int main(int argc, char *argv[]) {
+    string yields_file = (argc > 1) ? argv[1] : "yields/235U_fission.csv";
+    int repeats = (argc > 2) ? stoi(argv[2]) : 200;
+    if (!ifstream(yields_file).is_open()) {
+        cout << "ERROR: Cannot find " << yields_file << '\n';
+        return 1;
+    }
+
+    species_data data;
+    data.import_all("input_data/isotopes.csv", "input_data/decays.csv", "input_data/gammas.csv", yields_file);
+    data.check_data(true);
+    auto nuclear_data = make_shared<const species_data>(move(data));
+
+    // chain building on 1, 2, 4, ... threads, up to one per hardware thread
+    shared_ptr<chains_data> chains;
+    vector<pair<int, double>> t_builds;
+    for (int n_threads = 1; ; n_threads = min(2 * n_threads, worker_threads(0))) {
+        chains = make_shared<chains_data>();
+        chains->import_species_data(nuclear_data);
+        auto t_chains = chrono::steady_clock::now();
+        chains->build_chains("NONE", n_threads);
+        chrono::duration<double> t_build = chrono::steady_clock::now() - t_chains;
+        t_builds.emplace_back(n_threads, t_build.count());
+        if (n_threads == worker_threads(0)) {
+            break;
+        }
+    }
+    chains->extract_stems();
+
+    product_data products;
+    products.import_species_data(nuclear_data);
+    products.import_chains_data(chains);
+    double t_irrad = 3600.0;
+    double t = t_irrad + 600.0;
+    products.cont_prod_all(1.0e10, t_irrad, 0.0);
+
+    // the first call creates the POPULATIONS entries at T, later calls only add to them
+    products.batch_decay_all(t, t_irrad);
+
+    // batch decay sums of every stem, all at once through the generic loops and bucketed by stem length
+    stem_arrays stems = chains->get_stem_arrays();
+    auto n_nodes = static_cast<int>(chains->get_stem_trie().size());
+    vector<int> nodes(n_nodes);
+    vector<vector<int>> buckets(SPECIALIZED_STEM_LENGTH + 1);
+    for (int node = 0; node < n_nodes; ++node) {
+        nodes[node] = node;
+        buckets[(stems.lengths[node] <= SPECIALIZED_STEM_LENGTH) ? stems.lengths[node] : 0].push_back(node);
+    }
+    const vector<double> &rate_dcs = chains->get_rate_dcs();
+    vector<double> decay(rate_dcs.size()), sums(n_nodes);
+    for (size_t i = 0; i < rate_dcs.size(); ++i) {
+        decay[i] = exp(-1.0 * rate_dcs[i] * (t - t_irrad));
+    }
+    vector<tuple<const bateman_kernels *, double, double>> t_sums;
+    for (const bateman_kernels *kernels : supported_kernels()) {
+        auto t_start = chrono::steady_clock::now();
+        for (int i = 0; i < repeats; ++i) {
+            kernels->batch_sums(stems, 0, nodes.data(), n_nodes, decay.data(), sums.data());
+        }
+        chrono::duration<double> t_mixed = chrono::steady_clock::now() - t_start;
+        t_start = chrono::steady_clock::now();
+        for (int i = 0; i < repeats; ++i) {
+            double *out = sums.data();
+            for (int length = 0; length <= SPECIALIZED_STEM_LENGTH; ++length) {
+                auto n_bucket = static_cast<int>(buckets[length].size());
+                kernels->batch_sums(stems, length, buckets[length].data(), n_bucket, decay.data(), out);
+                out += n_bucket;
+            }
+        }
+        chrono::duration<double> t_bucketed = chrono::steady_clock::now() - t_start;
+        t_sums.emplace_back(kernels, t_mixed.count() / repeats, t_bucketed.count() / repeats);
+    }
+
+    vector<pair<const bateman_kernels *, double>> t_calls;
+    long allocations = 0;
+    for (const bateman_kernels *kernels : supported_kernels()) {
+        select_kernels(kernels->name);
+        long allocations_before = n_allocations.load();
+        auto t_start = chrono::steady_clock::now();
+        for (int i = 0; i < repeats; ++i) {
+            products.batch_decay_all(t, t_irrad);
+        }
+        chrono::duration<double> t_elapsed = chrono::steady_clock::now() - t_start;
+        allocations += n_allocations.load() - allocations_before;
+        t_calls.emplace_back(kernels, t_elapsed.count() / repeats);
+    }
+
+    // the times of a POPULATIONS block, one call per time against one call for all of them
+    vector<double> after_times;
+    for (int i = 1; i <= 16; ++i) {
+        after_times.push_back(t_irrad + 60.0 * i * i);
+    }
+    select_kernels(scalar_kernels().name);
+    auto t_start = chrono::steady_clock::now();
+    for (int i = 0; i < repeats; ++i) {
+        for (double t_after : after_times) {
+            products.batch_decay_all(t_after, t_irrad);
+        }
+    }
+    chrono::duration<double> t_each = chrono::steady_clock::now() - t_start;
+    t_start = chrono::steady_clock::now();
+    for (int i = 0; i < repeats; ++i) {
+        products.batch_decay_times(after_times, t_irrad);
+    }
+    chrono::duration<double> t_batched = chrono::steady_clock::now() - t_start;
+
+    // batch_decay_all on 1, 2, 4, ... threads, up to one per hardware thread
+    vector<pair<int, double>> t_threads;
+    for (int n_threads = 1; ; n_threads = min(2 * n_threads, worker_threads(0))) {
+        products.set_threads(n_threads);
+        t_start = chrono::steady_clock::now();
+        for (int i = 0; i < repeats; ++i) {
+            products.batch_decay_all(t, t_irrad);
+        }
+        chrono::duration<double> t_elapsed = chrono::steady_clock::now() - t_start;
+        t_threads.emplace_back(n_threads, t_elapsed.count() / repeats);
+        if (n_threads == worker_threads(0)) {
+            break;
+        }
+    }
+    products.set_threads(1);
+
+    // batch_decay_all with the EXPSUM solver, on a copy so the stem calls above keep their populations
+    expsum_solver expsums(nuclear_data, *chains);
+    product_data graph_products = products;
+    graph_products.set_solver("EXPSUM");
+    t_start = chrono::steady_clock::now();
+    for (int i = 0; i < repeats; ++i) {
+        graph_products.batch_decay_all(t, t_irrad);
+    }
+    chrono::duration<double> t_graph = chrono::steady_clock::now() - t_start;
+
+    // a long irradiation history, step by step and with the stem sums shared between its steps
+    vector<tuple<double, double, double>> history, ramps;
+    for (int i = 1; i <= 1000; ++i) {
+        double P = 1.0e10 * (1.0 + 0.5 * sin(0.01 * i));
+        history.emplace_back(60.0 * i, P, P);
+        if (i % 50 == 0) {
+            ramps.emplace_back(60.0 * i, 1.0e10 * (1.0 + 0.5 * sin(0.01 * (i - 50))), P);
+        }
+    }
+    product_data stepped_products;
+    stepped_products.import_species_data(nuclear_data);
+    stepped_products.import_chains_data(chains);
+    product_data history_products = stepped_products;
+    product_data ramp_products = stepped_products;
+    t_start = chrono::steady_clock::now();
+    double t_step = 0.0;
+    for (auto &step : history) {
+        stepped_products.batch_decay_all(get<0>(step), t_step);
+        stepped_products.cont_prod_all(get<1>(step), get<0>(step), t_step);
+        t_step = get<0>(step);
+    }
+    chrono::duration<double> t_stepped = chrono::steady_clock::now() - t_start;
+    t_start = chrono::steady_clock::now();
+    history_products.irradiate(history);
+    chrono::duration<double> t_history = chrono::steady_clock::now() - t_start;
+    t_start = chrono::steady_clock::now();
+    ramp_products.irradiate(ramps);
+    chrono::duration<double> t_ramps = chrono::steady_clock::now() - t_start;
+
+    // back to back count windows, one call per window against one call for all of them
+    vector<pair<double, double>> windows;
+    for (int i = 0; i < 1000; ++i) {
+        windows.emplace_back(t_irrad + 60.0 * i, t_irrad + 60.0 * (i + 1));
+    }
+    product_data window_products = products;
+    t_start = chrono::steady_clock::now();
+    for (auto &window : windows) {
+        window_products.batch_spectrum_all(window.first, window.second, t_irrad);
+    }
+    chrono::duration<double> t_windows_each = chrono::steady_clock::now() - t_start;
+    window_products = products;
+    t_start = chrono::steady_clock::now();
+    window_products.batch_spectrum_windows(windows, t_irrad);
+    chrono::duration<double> t_windows = chrono::steady_clock::now() - t_start;
+
+    for (auto &t_build : t_builds) {
+        cout << "build_chains on " << t_build.first << " threads: " << t_build.second * 1.0e3 << " ms" << '\n';
+    }
+    cout << "batch decay sums over " << n_nodes << " stems (" << repeats << " calls)" << '\n';
+    for (auto &t_sum : t_sums) {
+        cout << "   time per call, " << get<0>(t_sum)->name << " kernels: " << get<1>(t_sum) * 1.0e3
+             << " ms all at once, " << get<2>(t_sum) * 1.0e3 << " ms by stem length" << '\n';
+    }
+    cout << after_times.size() << " times after irradiation, " << scalar_kernels().name << " kernels: "
+         << t_each.count() / repeats * 1.0e3 << " ms with batch_decay_all per time, "
+         << t_batched.count() / repeats * 1.0e3 << " ms with batch_decay_times" << '\n';
+    cout << "batch_decay_all over " << chains->get_products().size() << " products (" << repeats << " calls)" << '\n';
+    for (auto &t_call : t_calls) {
+        cout << "   time per call, " << t_call.first->name << " kernels: " << t_call.second * 1.0e3 << " ms" << '\n';
+    }
+    for (auto &t_thread : t_threads) {
+        cout << "   time per call on " << t_thread.first << " threads: " << t_thread.second * 1.0e3 << " ms" << '\n';
+    }
+    cout << "   time per call with the EXPSUM solver over " << expsums.n_rows() << " isotopes and "
+         << expsums.n_terms() << " terms (" << stems.offsets[n_nodes] << " stem entries): "
+         << t_graph.count() / repeats * 1.0e3 << " ms" << '\n';
+    cout << history.size() << " irradiation steps: " << t_stepped.count() * 1.0e3 << " ms step by step, "
+         << t_history.count() * 1.0e3 << " ms with irradiate, " << t_ramps.count() * 1.0e3 << " ms as "
+         << ramps.size() << " linear ramps" << '\n';
+    cout << windows.size() << " count windows: " << t_windows_each.count() * 1.0e3 << " ms with batch_spectrum_all per "
+         << "window, " << t_windows.count() * 1.0e3 << " ms with batch_spectrum_windows" << '\n';
+    cout << "   heap allocations per call: " << static_cast<double>(allocations) / repeats / t_calls.size() << '\n';
+    if (allocations != 0) {
+        cout << "ERROR: batch_decay_all allocated " << allocations << " times" << '\n';
+        return 1;
+    }
+    return 0;
+}
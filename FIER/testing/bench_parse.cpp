@@ -0,0 +1,90 @@
+/**@file bench_parse.cpp
+ *
+ * Measures CSV parse throughput on a nuclear data file, comparing the split/stoi/stod path FIER used to
+ * read its data files with the split_view/to_int/to_double path it uses now. Both parse every field of every
+ * line and fold the values into a checksum so that neither loop can be optimized away.
+ *
+ * Run with make bench, or: bench_parse.exe input_data/gammas.csv
+ */
+
+#include "../helper_functions.h"
+
+/** Parses every line of CONTENTS with split, stoi and stod.
+ *
+ * @param contents File contents.
+ * @return Checksum of the parsed values.
+ */
+double parse_split(const string &contents) {
+    double checksum = 0.0;
+    istringstream file(contents);
+    string line;
+    while (getline(file, line)) {
+        vector <string> parts = split(line, ',');
+        checksum = checksum + stoi(parts[0]) + stoi(parts[1]) + stoi(parts[2]);
+        for (int i = 3; i < parts.size(); ++i) {
+            checksum = checksum + stod(parts[i]);
+        }
+    }
+    return checksum;
+}
+
+/** Parses every line of CONTENTS with split_view, to_int and to_double.
+ *
+ * @param contents File contents.
+ * @return Checksum of the parsed values.
+ */
+double parse_split_view(const string &contents) {
+    double checksum = 0.0;
+    istringstream file(contents);
+    string line;
+    vector <string_view> parts;
+    while (getline(file, line)) {
+        split_view(line, ',', parts, 3);
+        checksum = checksum + to_int(parts[0]) + to_int(parts[1]) + to_int(parts[2]);
+        for (int i = 3; i < parts.size(); ++i) {
+            checksum = checksum + to_double(parts[i]);
+        }
+    }
+    return checksum;
+}
+
+/** Times REPEATS runs of PARSE over CONTENTS and prints the throughput.
+ *
+ * @param name Label for the output.
+ * @param parse Parser being timed.
+ * @param contents File contents.
+ * @param repeats Number of passes over the contents.
+ * @return Checksum from the last pass.
+ */
+double bench(string name, double (*parse)(const string &), const string &contents, int repeats) {
+    double checksum = 0.0;
+    auto t_start = chrono::steady_clock::now();
+    for (int i = 0; i < repeats; ++i) {
+        checksum = parse(contents);
+    }
+    chrono::duration<double> t_elapsed = chrono::steady_clock::now() - t_start;
+    double megabytes = static_cast<double>(contents.size()) * repeats / 1.0e6;
+    cout << "   " << name << ": " << megabytes / t_elapsed.count() << " MB/s" << '\n';
+    return checksum;
+}
+
+int main(int argc, char *argv[]) {
+    string filename = (argc > 1) ? argv[1] : "input_data/gammas.csv";
+    int repeats = (argc > 2) ? stoi(argv[2]) : 5;
+    ifstream file(filename, ios::binary);
+    if (!file.is_open()) {
+        cout << "ERROR: Cannot find " << filename << '\n';
+        return 1;
+    }
+    string contents((istreambuf_iterator<char>(file)), istreambuf_iterator<char>());
+
+    cout << "Parse throughput on " << filename << " (" << contents.size() / 1.0e6 << " MB, " << repeats
+         << " passes)" << '\n';
+    double before = bench("split + stoi/stod      ", parse_split, contents, repeats);
+    double after = bench("split_view + from_chars", parse_split_view, contents, repeats);
+    if (before != after) {
+        cout << "ERROR: parsers disagree, checksums " << before << " and " << after << '\n';
+        return 1;
+    }
+    return 0;
+}